@@ -8,6 +8,7 @@
 #include <vector>
 #define GLAD_GL_IMPLEMENTATION
 #include "glad/gl.h"
+#include "vertex_layout.h"
 #include <GLFW/glfw3.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -41,6 +42,12 @@ struct Vertex {
   int m_BoneIDs[MAX_BONE_INFLUENCE];
   float m_Weights[MAX_BONE_INFLUENCE];
 };
+using MeshVertexLayout =
+    VertexLayout<Attr<0, GL_FLOAT, 3>, Attr<1, GL_FLOAT, 3>,
+                 Attr<2, GL_FLOAT, 2>, Attr<3, GL_FLOAT, 3>,
+                 Attr<4, GL_FLOAT, 3>, IAttr<5, GL_INT, MAX_BONE_INFLUENCE>,
+                 Attr<6, GL_FLOAT, MAX_BONE_INFLUENCE>>;
+static_assert(MeshVertexLayout::stride == sizeof(Vertex));
 class ShaderProgram {
   unsigned int id;
   void check(void fun(unsigned int, unsigned int, int *), unsigned int sid,
@@ -191,26 +198,7 @@ public:
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
                  indices.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, Normal));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, TexCoords));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, Tangent));
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, Bitangent));
-    glEnableVertexAttribArray(5);
-    glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex),
-                           (void *)offsetof(Vertex, m_BoneIDs));
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, m_Weights));
+    MeshVertexLayout::setup();
     glBindVertexArray(0);
     glDeleteBuffers(1, &vbo);
     glDeleteBuffers(1, &ebo);
@@ -280,9 +268,7 @@ public:
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
                  indices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
-                          (void *)0);
-    glEnableVertexAttribArray(0);
+    PositionLayout::setup();
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glDeleteBuffers(1, &vbo);
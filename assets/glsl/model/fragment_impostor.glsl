@@ -0,0 +1,18 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoords;
+in vec3 ViewPos;
+in float Radius;
+uniform sampler2D impostor_color;
+uniform sampler2D impostor_depth;
+uniform mat4 projection;
+void main() {
+    vec4 color = texture(impostor_color, TexCoords);
+    if (color.a < 0.5)
+        discard;
+    // 烘焙时深度0.5在包围球中心，每0.5对应一个半径
+    float offset = (texture(impostor_depth, TexCoords).r - 0.5) * 2.0 * Radius;
+    vec4 clip = projection * vec4(ViewPos.xy, ViewPos.z - offset, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+    FragColor = vec4(color.rgb, 1.0);
+}
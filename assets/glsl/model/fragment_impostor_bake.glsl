@@ -0,0 +1,13 @@
+#version 330 core
+layout (location = 0) out vec4 color;
+layout (location = 1) out vec4 normal;
+layout (location = 2) out float depth;
+in vec2 TexCoords;
+in vec3 Normal;
+uniform sampler2D diffuse1;
+void main() {
+    color = vec4(texture(diffuse1, TexCoords).rgb, 1.0);
+    normal = vec4(normalize(Normal) * 0.5 + 0.5, 1.0);
+    // 正交投影下是线性的，0.5是包围球中心
+    depth = gl_FragCoord.z;
+}
@@ -0,0 +1,30 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoords;
+// diffuse1换成虚拟纹理，indirection里面是每个page所在的物理slot和实际level
+uniform sampler2D vt_indirection;
+uniform sampler2D vt_physical;
+uniform vec4 vt_info;  // pages_x, pages_y, levels, page_size
+uniform vec4 vt_cache; // tile_size, border, 缓存边长, sparse
+uniform vec2 vt_scale;
+void main() {
+    vec2 uv = fract(TexCoords) * vt_scale;
+    vec2 texel = uv * vt_info.xy * vt_info.w;
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    lod = clamp(lod, 0.0, vt_info.z - 1.0);
+    int level = int(lod);
+    ivec2 pages = max(ivec2(vt_info.xy) >> level, ivec2(1));
+    ivec2 page = min(ivec2(uv * vec2(pages)), pages - 1);
+    vec4 entry = texelFetch(vt_indirection, page, level) * 255.0;
+    float resident = entry.b;
+    if (vt_cache.w > 0.5) {
+        // 整数level，只读indirection说已经commit的那一级
+        FragColor = textureLod(vt_physical, uv, max(float(level), resident));
+        return;
+    }
+    vec2 rpages = max(vt_info.xy / exp2(resident), vec2(1.0));
+    vec2 in_page = fract(uv * rpages);
+    vec2 phys = entry.rg * vt_cache.x + vt_cache.y + in_page * vt_info.w;
+    FragColor = texture(vt_physical, phys / vt_cache.z);
+}
@@ -0,0 +1,18 @@
+#version 330 core
+out uint FragColor;
+in vec2 TexCoords;
+// 输出这个像素需要的page，编码和vt_page_key一致
+uniform int vt_id;
+uniform vec4 vt_info;
+uniform vec2 vt_scale;
+uniform float vt_bias; // feedback的分辨率比屏幕低，需要把lod修正回来
+void main() {
+    vec2 uv = fract(TexCoords) * vt_scale;
+    vec2 texel = uv * vt_info.xy * vt_info.w;
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vt_bias;
+    int level = int(clamp(lod, 0.0, vt_info.z - 1.0));
+    ivec2 pages = max(ivec2(vt_info.xy) >> level, ivec2(1));
+    uvec2 page = uvec2(min(ivec2(uv * vec2(pages)), pages - 1));
+    FragColor = (uint(vt_id) << 24) | (uint(level) << 20) | (page.x << 10) | page.y;
+}
@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+// xyz是世界空间的包围球中心，w是半径
+layout (location = 1) in vec4 aSphere;
+// xy是图集里的格子
+layout (location = 2) in vec4 aCell;
+out vec2 TexCoords;
+out vec3 ViewPos;
+out float Radius;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float grid;
+void main() {
+    // view的前两行就是相机的右方向和上方向
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    vec3 pos = aSphere.xyz + (aCorner.x * right + aCorner.y * up) * aSphere.w;
+    TexCoords = (aCell.xy + aCorner * 0.5 + 0.5) / grid;
+    ViewPos = vec3(view * vec4(pos, 1.0));
+    Radius = aSphere.w;
+    gl_Position = projection * vec4(ViewPos, 1.0);
+}
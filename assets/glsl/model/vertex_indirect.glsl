@@ -0,0 +1,22 @@
+#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// 每个mesh一项，下标是indirect命令里的base instance
+struct Object {
+    mat4 model;
+    vec4 decode_offset;
+    vec4 decode_scale;
+};
+layout (std430, binding = 0) readonly buffer Objects {
+    Object objects[];
+};
+out vec2 TexCoords;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+void main() {
+    Object o = objects[gl_BaseInstance];
+    TexCoords = aTexCoords;
+    gl_Position = projection * view * model * o.model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,35 @@
+#version 460 core
+// 压缩顶点的indirect版本，解码参数从per-object数据中读取
+layout (location = 0) in vec4 aPos;       // snorm16, w为bitangent方向
+layout (location = 1) in vec2 aNormal;    // 八面体snorm16
+layout (location = 2) in vec2 aTexCoords; // half float
+layout (location = 3) in vec2 aTangent;   // 八面体snorm16
+struct Object {
+    mat4 model;
+    vec4 decode_offset;
+    vec4 decode_scale;
+};
+layout (std430, binding = 0) readonly buffer Objects {
+    Object objects[];
+};
+out vec2 TexCoords;
+out vec3 Normal;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+vec3 oct_decode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
+void main() {
+    Object o = objects[gl_BaseInstance];
+    mat4 m = model * o.model;
+    TexCoords = aTexCoords;
+    Normal = mat3(m) * oct_decode(aNormal);
+    vec3 pos = aPos.xyz * o.decode_scale.xyz + o.decode_offset.xyz;
+    gl_Position = projection * view * m * vec4(pos, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+// 压缩顶点，解码参数是每个mesh的包围盒中心和半长
+layout (location = 0) in vec4 aPos;       // snorm16, w为bitangent方向
+layout (location = 1) in vec2 aNormal;    // 八面体snorm16
+layout (location = 2) in vec2 aTexCoords; // half float
+layout (location = 3) in vec2 aTangent;   // 八面体snorm16
+out vec2 TexCoords;
+out vec3 Normal;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 decode_offset;
+uniform vec3 decode_scale;
+vec3 oct_decode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
+void main() {
+    TexCoords = aTexCoords;
+    Normal = mat3(model) * oct_decode(aNormal);
+    vec3 pos = aPos.xyz * decode_scale + decode_offset;
+    gl_Position = projection * view * model * vec4(pos, 1.0);
+}
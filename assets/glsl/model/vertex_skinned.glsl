@@ -0,0 +1,29 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in ivec4 aBoneIDs;
+layout (location = 6) in vec4 aWeights;
+// 所有实例的蒙皮矩阵，每个实例从bone_base开始
+layout (std430, binding = 1) readonly buffer Bones {
+    mat4 bones[];
+};
+out vec2 TexCoords;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+// 静态mesh没有启用location 5和6，读到的是默认值，不能使用
+uniform bool skinned;
+uniform int bone_base;
+void main() {
+    vec4 position = vec4(aPos, 1.0);
+    if (skinned && bone_base >= 0) {
+        mat4 skin = aWeights.x * bones[bone_base + aBoneIDs.x] +
+                    aWeights.y * bones[bone_base + aBoneIDs.y] +
+                    aWeights.z * bones[bone_base + aBoneIDs.z] +
+                    aWeights.w * bones[bone_base + aBoneIDs.w];
+        position = skin * position;
+    }
+    TexCoords = aTexCoords;
+    gl_Position = projection * view * model * position;
+}
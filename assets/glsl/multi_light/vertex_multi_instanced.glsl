@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec3 aNormal;
+// 每个实例一份，mat4占3-6，mat3占7-9
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main() {
+    FragPos = vec3(aModel * vec4(aPos, 1.0));
+    // 法线矩阵在CPU上算好，不再逐顶点求逆
+    Normal = aNormalMatrix * aNormal;
+    TexCoord = vec2(aTexCoord);
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -5,6 +5,7 @@
 #include <vector>
 #define GLAD_GL_IMPLEMENTATION
 #include "glad/gl.h"
+#include "vertex_layout.h"
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #define STB_IMAGE_IMPLEMENTATION
@@ -90,14 +91,7 @@ public:
       glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                    sizeof(unsigned int) * indices.size(), indices.data(),
                    GL_STATIC_DRAW);
-      // position attribute
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
-                            (void *)0);
-      glEnableVertexAttribArray(0);
-      // texture coord attribute
-      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
-                            (void *)(3 * sizeof(float)));
-      glEnableVertexAttribArray(1);
+      PositionUVLayout::setup();
     } else {
       unsigned int vbo, ebo;
       glGenBuffers(1, &vbo);
@@ -112,9 +106,7 @@ public:
       glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                    sizeof(unsigned int) * indices.size(), indices.data(),
                    GL_STATIC_DRAW);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
-                            (void *)0);
-      glEnableVertexAttribArray(0);
+      PositionLayout::setup();
       glBindBuffer(GL_ARRAY_BUFFER, 0); // 解绑
       glBindVertexArray(0);
       glDeleteBuffers(1, &vbo);
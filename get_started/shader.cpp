@@ -5,6 +5,7 @@
 #include <vector>
 #define GLAD_GL_IMPLEMENTATION
 #include "glad/gl.h"
+#include "vertex_layout.h"
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 class ShaderProgram {
@@ -74,9 +75,7 @@ public:
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(float) * indices.size(),
                  indices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
-                          (void *)0);
-    glEnableVertexAttribArray(0);
+    PositionLayout::setup();
     glBindBuffer(GL_ARRAY_BUFFER, 0); // 解绑
     glBindVertexArray(0);
     glDeleteBuffers(1, &vbo);
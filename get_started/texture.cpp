@@ -5,10 +5,15 @@
 #include <vector>
 #define GLAD_GL_IMPLEMENTATION
 #include "glad/gl.h"
+#include "vertex_layout.h"
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+// 位置、颜色、uv
+using PositionColorUVLayout =
+    VertexLayout<Attr<0, GL_FLOAT, 3>, Attr<1, GL_FLOAT, 4>,
+                 Attr<2, GL_FLOAT, 2>>;
 class ShaderProgram {
   unsigned int id;
   void check(void fun(unsigned int, unsigned int, int *), unsigned int sid,
@@ -84,18 +89,7 @@ public:
       glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                    sizeof(unsigned int) * indices.size(), indices.data(),
                    GL_STATIC_DRAW);
-      // position attribute
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float),
-                            (void *)0);
-      glEnableVertexAttribArray(0);
-      // color attribute
-      glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 9 * sizeof(float),
-                            (void *)(3 * sizeof(float)));
-      glEnableVertexAttribArray(1);
-      // texture coord attribute
-      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 9 * sizeof(float),
-                            (void *)(7 * sizeof(float)));
-      glEnableVertexAttribArray(2);
+      PositionColorUVLayout::setup();
     } else {
       unsigned int vbo, ebo;
       glGenBuffers(1, &vbo);
@@ -109,9 +103,7 @@ public:
       glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                    sizeof(unsigned int) * indices.size(), indices.data(),
                    GL_STATIC_DRAW);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
-                            (void *)0);
-      glEnableVertexAttribArray(0);
+      PositionLayout::setup();
       glBindBuffer(GL_ARRAY_BUFFER, 0); // 解绑
       glBindVertexArray(0);
       glDeleteBuffers(1, &vbo);
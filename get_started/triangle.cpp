@@ -3,6 +3,7 @@
 #include <fstream>
 #define GLAD_GL_IMPLEMENTATION
 #include "glad/gl.h"
+#include "vertex_layout.h"
 #include <GLFW/glfw3.h>
 
 void framebuffer_size_callback(GLFWwindow *, int width, int height) {
@@ -62,8 +63,7 @@ void draw_triangle(unsigned int &vao) {
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
   glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
+  PositionLayout::setup();
   glBindBuffer(GL_ARRAY_BUFFER, 0); // 解绑
   glBindVertexArray(0);
   glDeleteBuffers(1, &vbo);
@@ -81,8 +81,7 @@ void draw_rect(unsigned int &vao) {
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
                GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
+  PositionLayout::setup();
   glBindBuffer(GL_ARRAY_BUFFER, 0); // 解绑
   glBindVertexArray(0);
   glDeleteBuffers(1, &vbo);
@@ -0,0 +1,107 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#ifndef GLAD_GL_H_
+#include "glad/gl.h"
+#endif
+/**
+ * @brief 编译期顶点布局
+ * 每一章都在手写glVertexAttribPointer，stride和offset全是魔法数字，改了数组
+ * 忘了改这里就会错位。VertexLayout在编译期算出stride、每个属性的offset和gl类型，
+ * setup()一次性设置好VAO，数据按布局紧密排列。
+ *
+ *   using Layout = VertexLayout<Attr<0, GL_FLOAT, 3>, Attr<1, GL_FLOAT, 2>>;
+ *   Layout::setup();                 // 当前绑定的VAO与VBO
+ *   static_assert(Layout::stride == 5 * sizeof(float));
+ */
+template <GLenum Type> struct GLType;
+template <> struct GLType<GL_FLOAT> { using type = float; };
+template <> struct GLType<GL_HALF_FLOAT> { using type = uint16_t; };
+template <> struct GLType<GL_INT> { using type = int32_t; };
+template <> struct GLType<GL_UNSIGNED_INT> { using type = uint32_t; };
+template <> struct GLType<GL_SHORT> { using type = int16_t; };
+template <> struct GLType<GL_UNSIGNED_SHORT> { using type = uint16_t; };
+template <> struct GLType<GL_BYTE> { using type = int8_t; };
+template <> struct GLType<GL_UNSIGNED_BYTE> { using type = uint8_t; };
+/*
+  Location对应glsl里的layout(location = N)
+  Normalized只对整数类型有效，Integer为true时使用glVertexAttribIPointer(ivec/uvec)
+*/
+template <unsigned int Location, GLenum Type, int Count,
+          bool Normalized = false, bool Integer = false>
+struct Attr {
+  using type = typename GLType<Type>::type;
+  static constexpr unsigned int location = Location;
+  static constexpr GLenum gl_type = Type;
+  static constexpr int count = Count;
+  static constexpr bool normalized = Normalized;
+  static constexpr bool integer = Integer;
+  static constexpr size_t size = sizeof(type) * Count;
+  static_assert(Count >= 1 && Count <= 4, "attribute has 1-4 components");
+  static_assert(!(Integer && Type == GL_FLOAT), "integer attr can't be float");
+};
+template <unsigned int Location, GLenum Type, int Count>
+using IAttr = Attr<Location, Type, Count, false, true>;
+template <typename... Attrs> struct VertexLayout {
+  static constexpr size_t count = sizeof...(Attrs);
+  static constexpr size_t stride = (Attrs::size + ... + 0);
+  static constexpr std::array<size_t, count> offsets = [] {
+    std::array<size_t, count> out = {};
+    size_t sizes[] = {Attrs::size...};
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+      out[i] = offset;
+      offset += sizes[i];
+    }
+    return out;
+  }();
+  template <size_t I>
+  using attr = std::tuple_element_t<I, std::tuple<Attrs...>>;
+  template <size_t I> static constexpr size_t offset = offsets[I];
+  // 紧密排列的一个顶点
+  struct Storage {
+    unsigned char bytes[stride];
+    template <size_t I>
+    void set(const typename attr<I>::type (&value)[attr<I>::count]) {
+      memcpy(bytes + offsets[I], value, attr<I>::size);
+    }
+    template <size_t I> void set(const void *value) {
+      memcpy(bytes + offsets[I], value, attr<I>::size);
+    }
+    template <size_t I> void get(void *value) const {
+      memcpy(value, bytes + offsets[I], attr<I>::size);
+    }
+  };
+  static_assert(sizeof(Storage) == stride);
+  // 设置当前绑定的VAO，base是这个布局在VBO中的起始字节，divisor用于实例化属性
+  static void setup(size_t base = 0, unsigned int divisor = 0) {
+    size_t i = 0;
+    (setup_one<Attrs>(base + offsets[i++], divisor), ...);
+  }
+
+private:
+  template <typename A> static void setup_one(size_t offset, unsigned divisor) {
+    glEnableVertexAttribArray(A::location);
+    if constexpr (A::integer)
+      glVertexAttribIPointer(A::location, A::count, A::gl_type, stride,
+                             (void *)offset);
+    else
+      glVertexAttribPointer(A::location, A::count, A::gl_type,
+                            A::normalized ? GL_TRUE : GL_FALSE, stride,
+                            (void *)offset);
+    if (divisor)
+      glVertexAttribDivisor(A::location, divisor);
+  }
+};
+// 教程里常用的几种
+using PositionLayout = VertexLayout<Attr<0, GL_FLOAT, 3>>;
+using PositionUVLayout = VertexLayout<Attr<0, GL_FLOAT, 3>, Attr<1, GL_FLOAT, 2>>;
+using PositionUVNormalLayout =
+    VertexLayout<Attr<0, GL_FLOAT, 3>, Attr<1, GL_FLOAT, 2>,
+                 Attr<2, GL_FLOAT, 3>>;
+#endif
@@ -36,6 +36,9 @@ void Program::process() {
   for (auto &it : children) {
     it->process();
   }
+  for (auto &it : instanced) {
+    it->process();
+  }
   for (auto &l : light_src) {
     l->process();
   }
@@ -45,6 +48,9 @@ void Program::run() {
   for (auto &it : children) {
     it->program->link();
   }
+  for (auto &it : instanced) {
+    it->program->link();
+  }
   for (auto &l : light_src) {
     l->program->link();
   }
@@ -62,6 +68,17 @@ void Program::run() {
       it->set();
       it->draw();
     }
+    // 每个实例的model矩阵在实例属性里，整组只有一次draw call
+    for (auto &it : instanced) {
+      it->program->use();
+      it->program->set("view", camera->view);
+      it->program->set("projection", camera->projection);
+      it->activate_textures();
+      it->program->set("material.shininess", 64.0f);
+      set_light(it->program);
+      it->program->set("viewPos", camera->cameraPos);
+      it->draw();
+    }
     for (auto &l : light_src) {
       if (l->light_type != 0) {
         l->program->use();
@@ -77,8 +94,10 @@ void Program::run() {
   }
   checkError("run");
 }
-int main() {
+int main(int argc, char **argv) {
   Program program({800, 600});
+  // 第一个参数是额外的箱子数量，用来测试大量实例
+  int extra = argc > 1 ? std::max(0, atoi(argv[1])) : 0;
   std::vector<float> vertices = //
       {
           -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, //
@@ -133,28 +152,37 @@ int main() {
       glm::vec3(2.4f, -0.4f, -3.5f),  glm::vec3(-1.7f, 3.0f, -7.5f),
       glm::vec3(1.3f, -2.0f, -2.5f),  glm::vec3(1.5f, 2.0f, -2.5f),
       glm::vec3(1.5f, 0.2f, -1.5f),   glm::vec3(-1.3f, 1.0f, -1.5f)};
-  for (unsigned int i = 0; i < 10; i++) {
-    std::shared_ptr<Mesh> poly =
-        std::make_shared<Mesh>(vertices, indices, program.window);
-    std::shared_ptr<ImageTexture> texture1 =
-        std::make_shared<ImageTexture>("assets/img/container2.png");
-    poly->insert("material.diffuse", texture1);
-    std::shared_ptr<ImageTexture> texture2 =
-        std::make_shared<ImageTexture>("assets/img/container2_specular.png");
-    poly->insert("material.specular", texture2);
-    poly->program->load_shader("assets/glsl/vertex_multi.glsl",
-                               GL_VERTEX_SHADER);
-    poly->program->load_shader("assets/glsl/fragment_multi.glsl",
-                               GL_FRAGMENT_SHADER);
+  // 所有箱子共用一份几何和贴图
+  std::shared_ptr<InstancedMesh> boxes =
+      std::make_shared<InstancedMesh>(vertices, indices);
+  std::shared_ptr<ImageTexture> texture1 =
+      std::make_shared<ImageTexture>("assets/img/container2.png");
+  boxes->insert("material.diffuse", texture1);
+  std::shared_ptr<ImageTexture> texture2 =
+      std::make_shared<ImageTexture>("assets/img/container2_specular.png");
+  boxes->insert("material.specular", texture2);
+  boxes->program->load_shader("assets/glsl/vertex_multi_instanced.glsl",
+                              GL_VERTEX_SHADER);
+  boxes->program->load_shader("assets/glsl/fragment_multi.glsl",
+                              GL_FRAGMENT_SHADER);
+  for (int i = 0; i < 10 + extra; i++) {
     glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, cubePositions[i]);
+    if (i < 10) {
+      model = glm::translate(model, cubePositions[i]);
+    } else {
+      // 额外的箱子排在后面的方阵里
+      int side = (int)std::ceil(std::sqrt((float)extra));
+      int k = i - 10;
+      glm::vec3 p(1.5f * (k % side - side / 2), -4.0f,
+                  -20.0f - 1.5f * (k / side));
+      model = glm::translate(model, p);
+    }
     float angle = 20.0f * i;
     model =
         glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-
-    poly->model = model;
-    program.push_back(poly);
+    boxes->add(model);
   }
+  program.push_back(boxes);
   glm::vec3 pointLightPositions[] = {
       glm::vec3(0.7f, 0.2f, 2.0f), glm::vec3(2.3f, -3.3f, -4.0f),
       glm::vec3(-4.0f, 2.0f, -12.0f), glm::vec3(0.0f, 0.0f, -3.0f)};
@@ -1,6 +1,8 @@
 #ifndef CAMERA_H
 #define CAMERA_H
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <map>
@@ -8,6 +10,7 @@
 #include <vector>
 #define GLAD_GL_IMPLEMENTATION
 #include "glad/gl.h"
+#include "vertex_layout.h"
 #include <GLFW/glfw3.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -138,15 +141,7 @@ public:
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
                  indices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                          (void *)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                          (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                          (void *)(5 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    PositionUVNormalLayout::setup();
     model = glm::mat4(1.0f);
   }
   ~Mesh() {
@@ -176,6 +171,117 @@ public:
     glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
   }
 };
+/*
+  同一个几何体画很多份。几何只上传一次，每个实例的model矩阵和法线矩阵放在
+  divisor为1的实例属性里，一次glDrawElementsInstanced画完所有实例。
+  法线矩阵在CPU上算好，shader不再对每个顶点求逆。只有改过的实例范围会重新上传，
+  10万个实例也只需要一次draw call。
+*/
+struct InstanceData {
+  glm::mat4 model;
+  glm::mat3 normal; // transpose(inverse(mat3(model)))
+};
+// mat4占location 3-6，mat3占7-9，和vertex_multi_instanced.glsl一致
+using InstanceLayout =
+    VertexLayout<Attr<3, GL_FLOAT, 4>, Attr<4, GL_FLOAT, 4>,
+                 Attr<5, GL_FLOAT, 4>, Attr<6, GL_FLOAT, 4>,
+                 Attr<7, GL_FLOAT, 3>, Attr<8, GL_FLOAT, 3>,
+                 Attr<9, GL_FLOAT, 3>>;
+static_assert(InstanceLayout::stride == sizeof(InstanceData));
+class InstancedMesh {
+  size_t index_count;
+  unsigned int vao, vbo, ebo, instance_vbo;
+  std::vector<InstanceData> instances;
+  size_t capacity = 0; // instance_vbo能放下的实例数
+  size_t dirty_begin = SIZE_MAX, dirty_end = 0;
+  void mark(size_t i) {
+    dirty_begin = std::min(dirty_begin, i);
+    dirty_end = std::max(dirty_end, i + 1);
+  }
+  void upload() {
+    if (dirty_begin >= dirty_end)
+      return;
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    if (instances.size() > capacity) {
+      // 按两倍扩容，属性指针绑定的是buffer对象，重新分配之后仍然有效
+      capacity = std::max(instances.size(), capacity * 2);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * capacity, nullptr,
+                   GL_DYNAMIC_DRAW);
+      dirty_begin = 0;
+      dirty_end = instances.size();
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(InstanceData) * dirty_begin,
+                    sizeof(InstanceData) * (dirty_end - dirty_begin),
+                    instances.data() + dirty_begin);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    dirty_begin = SIZE_MAX;
+    dirty_end = 0;
+  }
+
+public:
+  std::map<std::string, std::shared_ptr<ImageTexture>> textures;
+  std::shared_ptr<ShaderProgram> program = std::make_shared<ShaderProgram>();
+  InstancedMesh(const std::vector<float> &vertices,
+                const std::vector<unsigned int> &indices)
+      : index_count(indices.size()) {
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    glGenBuffers(1, &instance_vbo);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertices.size(),
+                 vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
+                 indices.data(), GL_STATIC_DRAW);
+    PositionUVNormalLayout::setup();
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    InstanceLayout::setup(0, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  ~InstancedMesh() {
+    textures.clear();
+    program.reset();
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ebo);
+    glDeleteBuffers(1, &instance_vbo);
+  }
+  // 返回实例的下标
+  size_t add(const glm::mat4 &model) {
+    instances.push_back({});
+    set(instances.size() - 1, model);
+    return instances.size() - 1;
+  }
+  void set(size_t i, const glm::mat4 &model) {
+    instances[i].model = model;
+    instances[i].normal = glm::transpose(glm::inverse(glm::mat3(model)));
+    mark(i);
+  }
+  const glm::mat4 &get(size_t i) const { return instances[i].model; }
+  size_t size() const { return instances.size(); }
+  void insert(const char *name, std::shared_ptr<ImageTexture> &texture) {
+    textures[name] = std::move(texture);
+  }
+  void activate_textures() {
+    int i = 0;
+    for (auto &t : textures) {
+      t.second->activate(i);
+      program->set(t.first.c_str(), i);
+      i++;
+    }
+  }
+  void process() {}
+  void draw() {
+    upload();
+    glBindVertexArray(vao);
+    glDrawElementsInstanced(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0,
+                            instances.size());
+    glBindVertexArray(0);
+  }
+};
 void framebuffer_size_callback(GLFWwindow *, int width, int height);
 class Camera;
 class Light {
@@ -214,9 +320,7 @@ public:
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
                  indices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
-                          (void *)0);
-    glEnableVertexAttribArray(0);
+    PositionLayout::setup();
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glDeleteBuffers(1, &vbo);
@@ -294,6 +398,7 @@ class Program {
     }
   }
   std::vector<std::shared_ptr<Mesh>> children;
+  std::vector<std::shared_ptr<InstancedMesh>> instanced;
 
 public:
   GLFWwindow *window;
@@ -315,6 +420,7 @@ public:
     for (auto &child : children) {
       child.reset();
     }
+    instanced.clear();
     for (auto &l : light_src) {
       l.reset();
     }
@@ -322,6 +428,9 @@ public:
     glfwTerminate();
   }
   void push_back(std::shared_ptr<Mesh> &poly) { children.push_back(poly); }
+  void push_back(std::shared_ptr<InstancedMesh> &mesh) {
+    instanced.push_back(mesh);
+  }
   void push_back(std::shared_ptr<Light> &light) { light_src.push_back(light); }
   void set_light(std::shared_ptr<ShaderProgram> &program);
   void process();
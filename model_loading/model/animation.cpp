@@ -0,0 +1,319 @@
+#include "animation.h"
+#include <algorithm>
+#include <cmath>
+#include "glad/gl.h"
+#include "import_arena.h"
+#include "thread_pool.h"
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define ANIMATION_SSE 1
+#endif
+// 四元数(x, y, z, w)转成旋转矩阵，再按列乘上缩放
+static glm::mat4 compose(glm::vec4 t, glm::vec4 q, glm::vec4 s) {
+  float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+  float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+  float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+  glm::mat4 m;
+  m[0] = glm::vec4(1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy), 0) * s.x;
+  m[1] = glm::vec4(2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx), 0) * s.y;
+  m[2] = glm::vec4(2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy), 0) * s.z;
+  m[3] = glm::vec4(t.x, t.y, t.z, 1.0f);
+  return m;
+}
+// 没有动画的通道使用局部矩阵分解出来的值，假设没有切变
+static void decompose(const glm::mat4 &m, glm::vec4 &t, glm::vec4 &q,
+                      glm::vec4 &s) {
+  t = glm::vec4(glm::vec3(m[3]), 0.0f);
+  s = glm::vec4(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])),
+                glm::length(glm::vec3(m[2])), 0.0f);
+  glm::vec3 c[3];
+  for (int i = 0; i < 3; i++)
+    c[i] = s[i] > 0.0f ? glm::vec3(m[i]) / s[i] : glm::vec3(0.0f);
+  // c[j][i]是第i行第j列
+  float trace = c[0][0] + c[1][1] + c[2][2];
+  if (trace > 0.0f) {
+    float k = std::sqrt(trace + 1.0f) * 2.0f;
+    q = glm::vec4((c[1][2] - c[2][1]) / k, (c[2][0] - c[0][2]) / k,
+                  (c[0][1] - c[1][0]) / k, 0.25f * k);
+  } else if (c[0][0] > c[1][1] && c[0][0] > c[2][2]) {
+    float k = std::sqrt(1.0f + c[0][0] - c[1][1] - c[2][2]) * 2.0f;
+    q = glm::vec4(0.25f * k, (c[1][0] + c[0][1]) / k,
+                  (c[2][0] + c[0][2]) / k, (c[1][2] - c[2][1]) / k);
+  } else if (c[1][1] > c[2][2]) {
+    float k = std::sqrt(1.0f + c[1][1] - c[0][0] - c[2][2]) * 2.0f;
+    q = glm::vec4((c[1][0] + c[0][1]) / k, 0.25f * k,
+                  (c[2][1] + c[1][2]) / k, (c[2][0] - c[0][2]) / k);
+  } else {
+    float k = std::sqrt(1.0f + c[2][2] - c[0][0] - c[1][1]) * 2.0f;
+    q = glm::vec4((c[2][0] + c[0][2]) / k, (c[2][1] + c[1][2]) / k,
+                  0.25f * k, (c[0][1] - c[1][0]) / k);
+  }
+}
+#ifdef ANIMATION_SSE
+static inline __m128 dot4(__m128 a, __m128 b) {
+  __m128 m = _mm_mul_ps(a, b);
+  __m128 s = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+static inline glm::vec4 lerp4(const glm::vec4 &a, const glm::vec4 &b,
+                              float f) {
+  __m128 va = _mm_loadu_ps(&a.x), vb = _mm_loadu_ps(&b.x);
+  __m128 r = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), _mm_set1_ps(f)));
+  glm::vec4 out;
+  _mm_storeu_ps(&out.x, r);
+  return out;
+}
+// 点积为负时把b取反走短弧，插值后归一化
+static inline glm::vec4 nlerp4(const glm::vec4 &a, const glm::vec4 &b,
+                               float f) {
+  __m128 va = _mm_loadu_ps(&a.x), vb = _mm_loadu_ps(&b.x);
+  __m128 sign = _mm_and_ps(dot4(va, vb), _mm_set1_ps(-0.0f));
+  vb = _mm_xor_ps(vb, sign);
+  __m128 r = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), _mm_set1_ps(f)));
+  r = _mm_div_ps(r, _mm_sqrt_ps(dot4(r, r)));
+  glm::vec4 out;
+  _mm_storeu_ps(&out.x, r);
+  return out;
+}
+#else
+static inline glm::vec4 lerp4(const glm::vec4 &a, const glm::vec4 &b,
+                              float f) {
+  return a + (b - a) * f;
+}
+static inline glm::vec4 nlerp4(const glm::vec4 &a, const glm::vec4 &b,
+                               float f) {
+  glm::vec4 c = glm::dot(a, b) < 0.0f ? -b : b;
+  glm::vec4 r = a + (c - a) * f;
+  return r / std::sqrt(glm::dot(r, r));
+}
+#endif
+static glm::vec4 sample(const AnimationClip &clip, KeyRange range, float time,
+                        bool rotation) {
+  const float *times = clip.times.data() + range.first;
+  const glm::vec4 *values = clip.values.data() + range.first;
+  if (range.count == 1 || time <= times[0])
+    return values[0];
+  if (time >= times[range.count - 1])
+    return values[range.count - 1];
+  size_t k = std::upper_bound(times, times + range.count, time) - times;
+  float f = (time - times[k - 1]) / (times[k] - times[k - 1]);
+  return rotation ? nlerp4(values[k - 1], values[k], f)
+                  : lerp4(values[k - 1], values[k], f);
+}
+int32_t Skeleton::find(const std::string &name) const {
+  auto it = std::find(names.begin(), names.end(), name);
+  return it == names.end() ? -1 : (int32_t)(it - names.begin());
+}
+// 先序遍历，父节点先写入
+static void flatten(const aiNode *node, int32_t parent, Skeleton &out) {
+  int32_t index = (int32_t)out.parent.size();
+  out.parent.push_back(parent);
+  out.local.push_back(to_glm(node->mTransformation));
+  out.names.push_back(node->mName.C_Str());
+  for (unsigned int i = 0; i < node->mNumChildren; i++)
+    flatten(node->mChildren[i], index, out);
+}
+bool build_skeleton(const aiScene *scene, Skeleton &out) {
+  out = Skeleton();
+  flatten(scene->mRootNode, -1, out);
+  std::unordered_map<std::string, int32_t> nodes;
+  for (size_t n = 0; n < out.names.size(); n++)
+    nodes.emplace(out.names[n], (int32_t)n);
+  // 多个mesh可以引用同一根骨骼，按名字合并
+  for (unsigned int m = 0; m < scene->mNumMeshes; m++) {
+    const aiMesh *mesh = scene->mMeshes[m];
+    if (!mesh->HasBones())
+      continue;
+    for (unsigned int b = 0; b < mesh->mNumBones; b++) {
+      const aiBone *bone = mesh->mBones[b];
+      std::string name = bone->mName.C_Str();
+      if (out.bone_index.contains(name))
+        continue;
+      auto node = nodes.find(name);
+      out.bone_index[name] = (int32_t)out.bone_node.size();
+      out.bone_node.push_back(node == nodes.end() ? -1 : node->second);
+      out.bone_offset.push_back(to_glm(bone->mOffsetMatrix));
+    }
+  }
+  out.global_inverse = glm::inverse(out.local[0]);
+  return !out.bone_node.empty();
+}
+// 时间换算成秒，重复或者倒退的帧去掉，upper_bound要求严格递增
+template <typename Key, typename Convert>
+static KeyRange append_keys(AnimationClip &clip, const Key *keys,
+                            unsigned int count, double ticks_per_second,
+                            glm::vec4 fallback, Convert convert) {
+  KeyRange range{(uint32_t)clip.times.size(), 0};
+  for (unsigned int i = 0; i < count; i++) {
+    float time = (float)(keys[i].mTime / ticks_per_second);
+    if (range.count && time <= clip.times.back())
+      continue;
+    clip.times.push_back(time);
+    clip.values.push_back(convert(keys[i].mValue));
+    range.count++;
+  }
+  if (range.count == 0) {
+    clip.times.push_back(0.0f);
+    clip.values.push_back(fallback);
+    range.count = 1;
+  }
+  return range;
+}
+std::vector<AnimationClip> load_animations(const aiScene *scene,
+                                           const Skeleton &skeleton) {
+  std::vector<AnimationClip> clips;
+  auto vector = [](const aiVector3D &v) {
+    return glm::vec4(v.x, v.y, v.z, 0.0f);
+  };
+  auto quaternion = [](const aiQuaternion &q) {
+    return glm::vec4(q.x, q.y, q.z, q.w);
+  };
+  for (unsigned int a = 0; a < scene->mNumAnimations; a++) {
+    const aiAnimation *anim = scene->mAnimations[a];
+    // 不少格式不写这个值，Assimp的约定是25
+    double tps = anim->mTicksPerSecond > 0.0 ? anim->mTicksPerSecond : 25.0;
+    AnimationClip clip;
+    clip.name = anim->mName.C_Str();
+    clip.duration = (float)(anim->mDuration / tps);
+    for (unsigned int c = 0; c < anim->mNumChannels; c++) {
+      const aiNodeAnim *channel = anim->mChannels[c];
+      int32_t node = skeleton.find(channel->mNodeName.C_Str());
+      if (node < 0)
+        continue;
+      glm::vec4 t, r, s;
+      decompose(skeleton.local[node], t, r, s);
+      Track track;
+      track.node = node;
+      track.translation =
+          append_keys(clip, channel->mPositionKeys, channel->mNumPositionKeys,
+                      tps, t, vector);
+      track.rotation =
+          append_keys(clip, channel->mRotationKeys, channel->mNumRotationKeys,
+                      tps, r, quaternion);
+      track.scale = append_keys(clip, channel->mScalingKeys,
+                                channel->mNumScalingKeys, tps, s, vector);
+      clip.tracks.push_back(track);
+    }
+    // 按节点顺序写局部矩阵，访问world时是顺序的
+    std::sort(clip.tracks.begin(), clip.tracks.end(),
+              [](const Track &x, const Track &y) { return x.node < y.node; });
+    clips.push_back(std::move(clip));
+  }
+  return clips;
+}
+void fill_bone_weights(const aiMesh *mesh, const Skeleton &skeleton,
+                       Vertex *out) {
+  for (unsigned int b = 0; b < mesh->mNumBones; b++) {
+    const aiBone *bone = mesh->mBones[b];
+    auto it = skeleton.bone_index.find(bone->mName.C_Str());
+    if (it == skeleton.bone_index.end())
+      continue;
+    for (unsigned int w = 0; w < bone->mNumWeights; w++) {
+      const aiVertexWeight &weight = bone->mWeights[w];
+      if (weight.mVertexId >= mesh->mNumVertices)
+        continue;
+      // 槽满了就替换权重最小的一个
+      Vertex &v = out[weight.mVertexId];
+      int slot = 0;
+      for (int j = 1; j < MAX_BONE_INFLUENCE; j++) {
+        if (v.m_Weights[j] < v.m_Weights[slot])
+          slot = j;
+      }
+      if (weight.mWeight > v.m_Weights[slot]) {
+        v.m_BoneIDs[slot] = it->second;
+        v.m_Weights[slot] = weight.mWeight;
+      }
+    }
+  }
+  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+    float sum = 0.0f;
+    for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+      sum += out[i].m_Weights[j];
+    if (sum > 0.0f) {
+      for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+        out[i].m_Weights[j] /= sum;
+    }
+  }
+}
+void sample_pose(const Skeleton &skeleton, const AnimationClip *clip,
+                 float time, glm::mat4 *world, glm::mat4 *palette) {
+  std::copy(skeleton.local.begin(), skeleton.local.end(), world);
+  if (clip) {
+    for (auto &track : clip->tracks)
+      world[track.node] =
+          compose(sample(*clip, track.translation, time, false),
+                  sample(*clip, track.rotation, time, true),
+                  sample(*clip, track.scale, time, false));
+  }
+  // 父节点在前面，已经是世界矩阵了
+  for (size_t n = 0; n < skeleton.node_count(); n++) {
+    if (skeleton.parent[n] >= 0)
+      world[n] = world[skeleton.parent[n]] * world[n];
+  }
+  for (size_t b = 0; b < skeleton.bone_count(); b++) {
+    int32_t node = skeleton.bone_node[b];
+    palette[b] = node < 0 ? glm::mat4(1.0f)
+                          : skeleton.global_inverse * world[node] *
+                                skeleton.bone_offset[b];
+  }
+}
+Animator::Animator(std::shared_ptr<const Skeleton> _skeleton,
+                   std::shared_ptr<const std::vector<AnimationClip>> _clips)
+    : skeleton(std::move(_skeleton)), clips(std::move(_clips)) {
+  if (!clips)
+    clips = std::make_shared<const std::vector<AnimationClip>>();
+}
+Animator::~Animator() {
+  if (buffer)
+    glDeleteBuffers(1, &buffer);
+}
+size_t Animator::add(int32_t clip, float speed) {
+  if (clip >= (int32_t)clips->size())
+    clip = -1;
+  instances.push_back({clip, 0.0f, speed});
+  return instances.size() - 1;
+}
+void Animator::update(float dt) {
+  size_t bones = skeleton->bone_count();
+  palettes.resize(instances.size() * bones);
+  // 一个任务求值一组实例，单个骨架太小，逐个分发的开销比求值还大
+  constexpr size_t group = 16;
+  size_t groups = (instances.size() + group - 1) / group;
+  ThreadPool::getInstance().parallel_for(groups, [&](size_t g) {
+    thread_local std::vector<glm::mat4> world;
+    world.resize(skeleton->node_count());
+    size_t end = std::min(instances.size(), (g + 1) * group);
+    for (size_t i = g * group; i < end; i++) {
+      AnimationInstance &inst = instances[i];
+      const AnimationClip *clip =
+          inst.clip >= 0 ? &(*clips)[inst.clip] : nullptr;
+      if (clip && clip->duration > 0.0f) {
+        inst.time = std::fmod(inst.time + dt * inst.speed, clip->duration);
+        if (inst.time < 0.0f)
+          inst.time += clip->duration;
+      }
+      sample_pose(*skeleton, clip, inst.time, world.data(),
+                  palettes.data() + i * bones);
+    }
+  });
+}
+void Animator::upload() {
+  size_t bytes = sizeof(glm::mat4) * palettes.size();
+  if (bytes == 0)
+    return;
+  if (!buffer)
+    glGenBuffers(1, &buffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  // 每帧整个重写，先丢掉旧的存储，不用等上一帧的绘制读完
+  glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, palettes.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  buffer_bytes = bytes;
+}
+void Animator::bind(unsigned int binding) const {
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
+size_t Animator::cpu_bytes() const {
+  return palettes.capacity() * sizeof(glm::mat4) +
+         instances.capacity() * sizeof(AnimationInstance);
+}
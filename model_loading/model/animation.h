@@ -0,0 +1,97 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+#include "mesh_data.h"
+/**
+ * @brief 骨骼动画：导入、求值和蒙皮矩阵上传
+ * 节点层级展开成数组，父节点总在子节点前面，求世界矩阵只需要从前往后走一趟，
+ * 不需要递归。关键帧按SoA存放：一个clip所有轨道的时间连续放在times里，值放在
+ * values里，轨道只记录自己的范围。平移和缩放补成vec4，和四元数一样用SSE一次
+ * 插值四个分量。
+ *
+ * 不同实例之间没有依赖，Animator把实例分组交给线程池求值，所有实例的蒙皮矩阵
+ * 连续写进一个SSBO，第i个实例从i * bone_count()开始。
+ */
+struct Skeleton {
+  // 根节点为-1，否则总是小于自己的下标
+  std::vector<int32_t> parent;
+  // 没有动画轨道时使用的局部矩阵，即aiNode::mTransformation
+  std::vector<glm::mat4> local;
+  std::vector<std::string> names;
+  // 被顶点引用的节点，下标就是顶点里m_BoneIDs的值
+  std::vector<int32_t> bone_node;
+  // 模型空间到骨骼空间，即aiBone::mOffsetMatrix
+  std::vector<glm::mat4> bone_offset;
+  std::unordered_map<std::string, int32_t> bone_index;
+  glm::mat4 global_inverse = glm::mat4(1.0f);
+  size_t node_count() const { return parent.size(); }
+  size_t bone_count() const { return bone_node.size(); }
+  int32_t find(const std::string &name) const;
+};
+// 一个通道在times和values中的范围
+struct KeyRange {
+  uint32_t first = 0, count = 0;
+};
+struct Track {
+  int32_t node;
+  KeyRange translation, rotation, scale;
+};
+struct AnimationClip {
+  std::string name;
+  float duration = 0.0f; // 秒
+  std::vector<Track> tracks;
+  std::vector<float> times;      // 秒
+  std::vector<glm::vec4> values; // 四元数按(x, y, z, w)存放
+};
+// 展开节点层级并给所有mesh用到的骨骼分配id，没有骨骼时返回false
+bool build_skeleton(const aiScene *scene, Skeleton &out);
+std::vector<AnimationClip> load_animations(const aiScene *scene,
+                                           const Skeleton &skeleton);
+// 每个顶点保留权重最大的MAX_BONE_INFLUENCE个骨骼并归一化，out需要先清零
+void fill_bone_weights(const aiMesh *mesh, const Skeleton &skeleton,
+                       Vertex *out);
+// clip为空时是绑定姿势。world是node_count()个临时矩阵，palette输出bone_count()个
+void sample_pose(const Skeleton &skeleton, const AnimationClip *clip,
+                 float time, glm::mat4 *world, glm::mat4 *palette);
+// 一个角色的播放状态，clip为-1时保持绑定姿势
+struct AnimationInstance {
+  int32_t clip = -1;
+  float time = 0.0f;
+  float speed = 1.0f;
+};
+class Animator {
+  std::shared_ptr<const Skeleton> skeleton;
+  std::shared_ptr<const std::vector<AnimationClip>> clips;
+  std::vector<glm::mat4> palettes;
+  unsigned int buffer = 0;
+  size_t buffer_bytes = 0;
+
+public:
+  std::vector<AnimationInstance> instances;
+  Animator(std::shared_ptr<const Skeleton> _skeleton,
+           std::shared_ptr<const std::vector<AnimationClip>> _clips);
+  Animator(const Animator &) = delete;
+  void operator=(const Animator &) = delete;
+  ~Animator();
+  // 返回实例的下标
+  size_t add(int32_t clip = 0, float speed = 1.0f);
+  // 推进时间并在线程池上求值所有实例
+  void update(float dt);
+  // 只能在主线程调用
+  void upload();
+  void bind(unsigned int binding) const;
+  uint32_t bone_base(size_t instance) const {
+    return (uint32_t)(instance * skeleton->bone_count());
+  }
+  const std::vector<AnimationClip> &clip_list() const { return *clips; }
+  size_t cpu_bytes() const;
+  size_t gpu_bytes() const { return buffer_bytes; }
+};
+#endif
@@ -0,0 +1,71 @@
+#include "dynamic_batch.h"
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DYNAMIC_BATCH_SSE 1
+#endif
+#ifdef DYNAMIC_BATCH_SSE
+void transform_vertices(const glm::mat4 &m, const Vertex *src, size_t count,
+                        float *dst) {
+  glm::mat3 n = glm::transpose(glm::inverse(glm::mat3(m)));
+  __m128 c0 = _mm_loadu_ps(&m[0][0]), c1 = _mm_loadu_ps(&m[1][0]);
+  __m128 c2 = _mm_loadu_ps(&m[2][0]), c3 = _mm_loadu_ps(&m[3][0]);
+  __m128 n0 = _mm_setr_ps(n[0][0], n[0][1], n[0][2], 0.0f);
+  __m128 n1 = _mm_setr_ps(n[1][0], n[1][1], n[1][2], 0.0f);
+  __m128 n2 = _mm_setr_ps(n[2][0], n[2][1], n[2][2], 0.0f);
+  __m128 tiny = _mm_set1_ps(1e-30f);
+  for (size_t i = 0; i < count; i++, dst += 8) {
+    const Vertex &v = src[i];
+    __m128 p = _mm_add_ps(
+        _mm_add_ps(c3, _mm_mul_ps(c0, _mm_load1_ps(&v.Position.x))),
+        _mm_add_ps(_mm_mul_ps(c1, _mm_load1_ps(&v.Position.y)),
+                   _mm_mul_ps(c2, _mm_load1_ps(&v.Position.z))));
+    __m128 r = _mm_add_ps(
+        _mm_mul_ps(n0, _mm_load1_ps(&v.Normal.x)),
+        _mm_add_ps(_mm_mul_ps(n1, _mm_load1_ps(&v.Normal.y)),
+                   _mm_mul_ps(n2, _mm_load1_ps(&v.Normal.z))));
+    // 长度平方广播到四个分量，为0时结果还是0
+    __m128 sq = _mm_mul_ps(r, r);
+    sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+    sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 0, 3, 2)));
+    r = _mm_div_ps(r, _mm_sqrt_ps(_mm_max_ps(sq, tiny)));
+    __m128 uv =
+        _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)&v.TexCoords.x);
+    // (p.x, p.y, p.z, n.x)和(n.y, n.z, u, v)
+    __m128 t = _mm_shuffle_ps(p, r, _MM_SHUFFLE(0, 0, 2, 2));
+    _mm_storeu_ps(dst, _mm_shuffle_ps(p, t, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(dst + 4, _mm_shuffle_ps(r, uv, _MM_SHUFFLE(1, 0, 2, 1)));
+  }
+}
+void rebase_indices(const unsigned int *src, size_t count, uint32_t base,
+                    uint32_t *dst) {
+  size_t i = 0;
+  __m128i b = _mm_set1_epi32((int)base);
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi32(x, b));
+  }
+  for (; i < count; i++)
+    dst[i] = src[i] + base;
+}
+#else
+void transform_vertices(const glm::mat4 &m, const Vertex *src, size_t count,
+                        float *dst) {
+  glm::mat3 n = glm::transpose(glm::inverse(glm::mat3(m)));
+  for (size_t i = 0; i < count; i++, dst += 8) {
+    glm::vec3 p = glm::vec3(m * glm::vec4(src[i].Position, 1.0f));
+    glm::vec3 r = n * src[i].Normal;
+    float length = glm::length(r);
+    if (length > 0.0f)
+      r /= length;
+    float out[8] = {p.x, p.y, p.z, r.x, r.y, r.z, src[i].TexCoords.x,
+                    src[i].TexCoords.y};
+    memcpy(dst, out, sizeof(out));
+  }
+}
+void rebase_indices(const unsigned int *src, size_t count, uint32_t base,
+                    uint32_t *dst) {
+  for (size_t i = 0; i < count; i++)
+    dst[i] = src[i] + base;
+}
+#endif
@@ -0,0 +1,24 @@
+#ifndef DYNAMIC_BATCH_H
+#define DYNAMIC_BATCH_H
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "mesh_data.h"
+/**
+ * @brief 小mesh的动态合批用到的CPU变换
+ * 几十个顶点的mesh，一次glDrawElements加上设置uniform的开销比几何本身还大。
+ * 每帧在CPU上把它们变换到世界空间，写进StreamingBuffer，同一个材质只画一次。
+ * 输出是StaticVertexLayout（位置、法线、uv共32字节），shader的model为单位矩阵。
+ * 位置按矩阵的四列做SSE乘加，法线用逆转置矩阵并重新归一化，一个顶点正好两次
+ * 16字节的写入，适合写合并的持久映射内存。
+ */
+// 顶点数不超过这个值的mesh参与合批，更大的mesh变换的开销超过省下的draw
+constexpr size_t DYNAMIC_BATCH_MAX_VERTICES = 512;
+constexpr size_t DYNAMIC_BATCH_STRIDE = 8 * sizeof(float);
+// dst每个顶点8个float
+void transform_vertices(const glm::mat4 &m, const Vertex *src, size_t count,
+                        float *dst);
+// dst[i] = src[i] + base
+void rebase_indices(const unsigned int *src, size_t count, uint32_t base,
+                    uint32_t *dst);
+#endif
@@ -0,0 +1,104 @@
+#include "frustum_cull.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+bool frustum_outside(const Frustum &frustum, glm::vec3 c, glm::vec3 e,
+                     float r) {
+  for (auto &p : frustum.planes) {
+    float s = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+    float extent =
+        std::fabs(p.x) * e.x + std::fabs(p.y) * e.y + std::fabs(p.z) * e.z;
+    if (s + std::min(extent, r) < 0.0f)
+      return true;
+  }
+  return false;
+}
+void FrustumCuller::clear() {
+  for (auto *v : {&cx, &cy, &cz, &ex, &ey, &ez, &radius})
+    v->clear();
+}
+void FrustumCuller::add(glm::vec3 min, glm::vec3 max, float r,
+                        const glm::mat4 &world) {
+  glm::vec3 c = glm::vec3(world * glm::vec4((min + max) * 0.5f, 1.0f));
+  glm::vec3 half = (max - min) * 0.5f;
+  // 变换之后的包围盒半边长是|M| * e（Arvo）
+  glm::mat3 m(world);
+  glm::vec3 e = glm::abs(m[0]) * half.x + glm::abs(m[1]) * half.y +
+                glm::abs(m[2]) * half.z;
+  float scale =
+      std::max({glm::length(m[0]), glm::length(m[1]), glm::length(m[2])});
+  cx.push_back(c.x);
+  cy.push_back(c.y);
+  cz.push_back(c.z);
+  ex.push_back(e.x);
+  ey.push_back(e.y);
+  ez.push_back(e.z);
+  // 没有算过包围球时退回到包围盒的外接球
+  radius.push_back((r > 0.0f ? r : glm::length(half)) * scale);
+}
+void FrustumCuller::cull(const Frustum &frustum,
+                         std::vector<uint32_t> &visible) const {
+  visible.clear();
+  size_t n = size(), i = 0;
+#if defined(FRUSTUM_AVX)
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps(&cx[i]), y = _mm256_loadu_ps(&cy[i]);
+    __m256 z = _mm256_loadu_ps(&cz[i]);
+    __m256 hx = _mm256_loadu_ps(&ex[i]), hy = _mm256_loadu_ps(&ey[i]);
+    __m256 hz = _mm256_loadu_ps(&ez[i]), r = _mm256_loadu_ps(&radius[i]);
+    __m256 outside = _mm256_setzero_ps();
+    for (auto &p : frustum.planes) {
+      __m256 s = _mm256_add_ps(
+          _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.x), x),
+                                      _mm256_mul_ps(_mm256_set1_ps(p.y), y)),
+                        _mm256_mul_ps(_mm256_set1_ps(p.z), z)),
+          _mm256_set1_ps(p.w));
+      __m256 extent = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::fabs(p.x)), hx),
+                        _mm256_mul_ps(_mm256_set1_ps(std::fabs(p.y)), hy)),
+          _mm256_mul_ps(_mm256_set1_ps(std::fabs(p.z)), hz));
+      __m256 d = _mm256_add_ps(s, _mm256_min_ps(extent, r));
+      outside = _mm256_or_ps(
+          outside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+    for (int k = 0, mask = _mm256_movemask_ps(outside); k < 8; k++)
+      if (!(mask & (1 << k)))
+        visible.push_back(i + k);
+  }
+#elif defined(FRUSTUM_SSE)
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_loadu_ps(&cx[i]), y = _mm_loadu_ps(&cy[i]);
+    __m128 z = _mm_loadu_ps(&cz[i]);
+    __m128 hx = _mm_loadu_ps(&ex[i]), hy = _mm_loadu_ps(&ey[i]);
+    __m128 hz = _mm_loadu_ps(&ez[i]), r = _mm_loadu_ps(&radius[i]);
+    __m128 outside = _mm_setzero_ps();
+    for (auto &p : frustum.planes) {
+      __m128 s = _mm_add_ps(
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), x),
+                                _mm_mul_ps(_mm_set1_ps(p.y), y)),
+                     _mm_mul_ps(_mm_set1_ps(p.z), z)),
+          _mm_set1_ps(p.w));
+      __m128 extent = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(p.x)), hx),
+                     _mm_mul_ps(_mm_set1_ps(std::fabs(p.y)), hy)),
+          _mm_mul_ps(_mm_set1_ps(std::fabs(p.z)), hz));
+      __m128 d = _mm_add_ps(s, _mm_min_ps(extent, r));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+    }
+    for (int k = 0, mask = _mm_movemask_ps(outside); k < 4; k++)
+      if (!(mask & (1 << k)))
+        visible.push_back(i + k);
+  }
+#endif
+  for (; i < n; i++) {
+    if (!frustum_outside(frustum, glm::vec3(cx[i], cy[i], cz[i]),
+                         glm::vec3(ex[i], ey[i], ez[i]), radius[i]))
+      visible.push_back(i);
+  }
+}
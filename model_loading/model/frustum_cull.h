@@ -0,0 +1,31 @@
+#ifndef FRUSTUM_CULL_H
+#define FRUSTUM_CULL_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "meshlet.h"
+/**
+ * @brief 逐mesh的视锥剔除
+ * 每个mesh的包围盒和包围球变换到世界空间，中心、半边长、半径按分量分开存放（SoA），
+ * 一次测试8个（AVX）或者4个（SSE）。对每个平面 s = dot(n, c) + d，
+ * s < -min(dot(|n|, e), r)时整个物体在这个平面外面。包围盒在斜着的平面上偏保守，
+ * 包围球在细长的物体上偏保守，两个取更紧的那个。
+ * AVX需要编译时打开（-mavx或者-march=native），否则用SSE，两者结果和
+ * frustum_outside逐个测试一致。
+ */
+// 包围盒中心c、半边长e、包围球半径r都在视锥所在的空间
+bool frustum_outside(const Frustum &frustum, glm::vec3 c, glm::vec3 e, float r);
+class FrustumCuller {
+  std::vector<float> cx, cy, cz, ex, ey, ez, radius;
+
+public:
+  void clear();
+  // min、max和r在局部空间，包围球的中心是包围盒的中心，world变换到视锥的空间。
+  // r为0时使用包围盒的外接球
+  void add(glm::vec3 min, glm::vec3 max, float r, const glm::mat4 &world);
+  size_t size() const { return cx.size(); }
+  // visible清空之后写入没有被剔除的下标，按从小到大的顺序
+  void cull(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+};
+#endif
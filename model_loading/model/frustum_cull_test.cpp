@@ -0,0 +1,85 @@
+// FrustumCuller和逐个测试、暴力枚举角点的结果对比，meson test运行
+#include "frustum_cull.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+struct Object {
+  glm::vec3 min, max;
+  float radius;
+  glm::mat4 world;
+};
+int main() {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+  std::uniform_real_distribution<float> size(0.1f, 5.0f);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  glm::mat4 projection =
+      glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+  glm::mat4 view = glm::lookAt(glm::vec3(3.0f, 1.0f, 10.0f),
+                               glm::vec3(0.0f, 0.0f, -1.0f),
+                               glm::vec3(0.0f, 1.0f, 0.0f));
+  Frustum frustum = extract_frustum(projection * view);
+  // 不是8和4的倍数，尾部走标量路径
+  const size_t count = 100003;
+  std::vector<Object> objects(count);
+  FrustumCuller culler;
+  for (auto &o : objects) {
+    glm::vec3 center(position(rng), position(rng), position(rng));
+    glm::vec3 half(size(rng), size(rng), size(rng));
+    o.min = center - half;
+    o.max = center + half;
+    // 外接球，或者0（由add退回到外接球）
+    o.radius = unit(rng) < 0.5f ? glm::length(half) : 0.0f;
+    // 非均匀缩放加上切变和平移
+    o.world = glm::mat4(1.0f);
+    o.world[0] = glm::vec4(1.5f, 0.2f, 0.0f, 0.0f);
+    o.world[1] = glm::vec4(0.0f, 0.7f, 0.1f, 0.0f);
+    o.world[3] = glm::vec4(position(rng) * 0.1f, 0.0f, 0.0f, 1.0f);
+    culler.add(o.min, o.max, o.radius, o.world);
+  }
+  std::vector<uint32_t> visible;
+  culler.cull(frustum, visible);
+  if (!std::is_sorted(visible.begin(), visible.end())) {
+    printf("ERROR::TEST::Visible list is not sorted\n");
+    return 1;
+  }
+  size_t mismatches = 0, false_negatives = 0, expected = 0;
+  for (size_t i = 0; i < count; i++) {
+    auto &o = objects[i];
+    glm::mat3 m(o.world);
+    glm::vec3 half = (o.max - o.min) * 0.5f;
+    glm::vec3 c =
+        glm::vec3(o.world * glm::vec4((o.min + o.max) * 0.5f, 1.0f));
+    glm::vec3 e = glm::abs(m[0]) * half.x + glm::abs(m[1]) * half.y +
+                  glm::abs(m[2]) * half.z;
+    float scale =
+        std::max({glm::length(m[0]), glm::length(m[1]), glm::length(m[2])});
+    float r = (o.radius > 0.0f ? o.radius : glm::length(half)) * scale;
+    bool inside = !frustum_outside(frustum, c, e, r);
+    expected += inside;
+    if (inside != std::binary_search(visible.begin(), visible.end(), i))
+      mismatches++;
+    // 有角点在视锥里面的物体一定不能被剔除
+    for (int k = 0; k < 8; k++) {
+      glm::vec3 p(k & 1 ? o.max.x : o.min.x, k & 2 ? o.max.y : o.min.y,
+                  k & 4 ? o.max.z : o.min.z);
+      p = glm::vec3(o.world * glm::vec4(p, 1.0f));
+      bool corner = true;
+      for (auto &plane : frustum.planes)
+        corner &= glm::dot(glm::vec3(plane), p) + plane.w >= 0.0f;
+      if (corner && !inside) {
+        false_negatives++;
+        break;
+      }
+    }
+  }
+  printf("frustum_cull: %zu / %zu visible, %zu mismatches, %zu culled with a "
+         "corner inside\n",
+         visible.size(), count, mismatches, false_negatives);
+  if (expected == 0 || expected == count) {
+    printf("ERROR::TEST::Degenerate scene, nothing to compare\n");
+    return 1;
+  }
+  return mismatches || false_negatives || visible.size() != expected;
+}
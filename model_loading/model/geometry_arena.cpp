@@ -0,0 +1,149 @@
+#include "geometry_arena.h"
+#include <algorithm>
+#include <iostream>
+size_t RangeAllocator::allocate(size_t size) {
+  if (size == 0)
+    return 0;
+  for (auto it = free_ranges.begin(); it != free_ranges.end(); it++) {
+    if (it->second < size)
+      continue;
+    size_t offset = it->first;
+    size_t rest = it->second - size;
+    free_ranges.erase(it);
+    if (rest)
+      free_ranges[offset + size] = rest;
+    return offset;
+  }
+  return npos;
+}
+void RangeAllocator::release(size_t offset, size_t size) {
+  if (size == 0)
+    return;
+  auto next = free_ranges.lower_bound(offset);
+  if (next != free_ranges.end() && offset + size == next->first) {
+    size += next->second;
+    next = free_ranges.erase(next);
+  }
+  if (next != free_ranges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      prev->second += size;
+      return;
+    }
+  }
+  free_ranges[offset] = size;
+}
+void RangeAllocator::grow(size_t new_capacity) {
+  if (new_capacity <= capacity)
+    return;
+  size_t old = capacity;
+  capacity = new_capacity;
+  release(old, new_capacity - old);
+}
+GeometryArena::GeometryArena(size_t _stride,
+                             void (*_setup)(size_t, unsigned int),
+                             size_t _index_size, size_t vertex_capacity,
+                             size_t index_capacity)
+    : stride(_stride), index_size(_index_size), setup(_setup) {
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ebo);
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, stride * vertex_capacity, nullptr,
+               GL_STATIC_DRAW);
+  setup(0, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_size * index_capacity, nullptr,
+               GL_STATIC_DRAW);
+  glBindVertexArray(0);
+  vertex_space.grow(vertex_capacity);
+  index_space.grow(index_capacity);
+}
+GeometryArena::~GeometryArena() {
+  glDeleteVertexArrays(1, &vao);
+  glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &ebo);
+}
+void GeometryArena::resize(GLenum target, unsigned int &buffer,
+                           size_t old_bytes, size_t new_bytes) {
+  unsigned int bigger;
+  glGenBuffers(1, &bigger);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, bigger);
+  glBufferData(GL_COPY_WRITE_BUFFER, new_bytes, nullptr, GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                      old_bytes);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glDeleteBuffers(1, &buffer);
+  buffer = bigger;
+  // VAO记录的是旧buffer，需要重新绑定
+  glBindVertexArray(vao);
+  if (target == GL_ARRAY_BUFFER) {
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    setup(0, 0);
+  } else {
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  }
+  glBindVertexArray(0);
+}
+void GeometryArena::reserve(size_t vertex_count, size_t index_count) {
+  size_t vertices = vertex_space.size();
+  if (vertex_count) {
+    size_t grown = std::max(vertices * 2, vertices + vertex_count);
+    resize(GL_ARRAY_BUFFER, vbo, vertices * stride, grown * stride);
+    vertex_space.grow(grown);
+  }
+  size_t indices = index_space.size();
+  if (index_count) {
+    size_t grown = std::max(indices * 2, indices + index_count);
+    resize(GL_ELEMENT_ARRAY_BUFFER, ebo, indices * index_size,
+           grown * index_size);
+    index_space.grow(grown);
+  }
+}
+bool GeometryArena::allocate(const void *vertices, size_t vertex_count,
+                             const void *indices, size_t index_count,
+                             ArenaRange &range) {
+  size_t first_vertex = vertex_space.allocate(vertex_count);
+  size_t first_index = index_space.allocate(index_count);
+  if (first_vertex == RangeAllocator::npos ||
+      first_index == RangeAllocator::npos) {
+    // 扩容后新增的空间接在末尾，一定放得下
+    reserve(first_vertex == RangeAllocator::npos ? vertex_count : 0,
+            first_index == RangeAllocator::npos ? index_count : 0);
+    if (first_vertex == RangeAllocator::npos)
+      first_vertex = vertex_space.allocate(vertex_count);
+    if (first_index == RangeAllocator::npos)
+      first_index = index_space.allocate(index_count);
+  }
+  if (first_vertex == RangeAllocator::npos ||
+      first_index == RangeAllocator::npos ||
+      first_vertex + vertex_count > UINT32_MAX ||
+      first_index + index_count > UINT32_MAX) {
+    std::cout << "ERROR::ARENA::Failed to allocate " << vertex_count
+              << " vertices" << std::endl;
+    if (first_vertex != RangeAllocator::npos)
+      vertex_space.release(first_vertex, vertex_count);
+    if (first_index != RangeAllocator::npos)
+      index_space.release(first_index, index_count);
+    return false;
+  }
+  range.first_vertex = first_vertex;
+  range.vertex_count = vertex_count;
+  range.first_index = first_index;
+  range.index_count = index_count;
+  glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, first_vertex * stride,
+                  vertex_count * stride, vertices);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, first_index * index_size,
+                  index_count * index_size, indices);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  return true;
+}
+void GeometryArena::release(const ArenaRange &range) {
+  vertex_space.release(range.first_vertex, range.vertex_count);
+  index_space.release(range.first_index, range.index_count);
+}
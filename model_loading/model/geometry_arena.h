@@ -0,0 +1,76 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include "glad/gl.h"
+/**
+ * @brief 共享的几何缓冲
+ * 以前每个Mesh都有自己的VAO/VBO/EBO，画一个模型要绑定几百次VAO。这里每种顶点格式
+ * 只有一个大的vertex buffer和index buffer，mesh在里面按base vertex/first index
+ * 分配一段，同一个arena里的mesh可以用一次glMultiDrawElementsIndirect画完。
+ *
+ * index保存的是mesh内部的下标，绘制时由baseVertex加上偏移，所以上传时不需要改写。
+ * 同样因为这个原因，顶点数不超过65536的mesh可以放进16位index的arena。
+ * 空间不够时buffer按两倍扩容并用glCopyBufferSubData搬运旧数据，已经分配的范围不变。
+ */
+// 和GL规范中的结构一致，直接写进GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+  uint32_t count;
+  uint32_t instance_count;
+  uint32_t first_index;
+  int32_t base_vertex;
+  uint32_t base_instance;
+};
+struct ArenaRange {
+  uint32_t first_vertex = 0, vertex_count = 0;
+  uint32_t first_index = 0, index_count = 0;
+};
+// first-fit的区间分配，释放时和相邻的空闲区间合并
+class RangeAllocator {
+  std::map<size_t, size_t> free_ranges; // offset -> size
+  size_t capacity = 0;
+
+public:
+  static constexpr size_t npos = SIZE_MAX;
+  size_t allocate(size_t size);
+  void release(size_t offset, size_t size);
+  void grow(size_t new_capacity);
+  size_t size() const { return capacity; }
+};
+class GeometryArena {
+  unsigned int vao = 0, vbo = 0, ebo = 0;
+  size_t stride;
+  size_t index_size; // 2或者4字节
+  void (*setup)(size_t, unsigned int);
+  RangeAllocator vertex_space, index_space;
+  void resize(GLenum target, unsigned int &buffer, size_t old_bytes,
+              size_t new_bytes);
+  void reserve(size_t vertex_count, size_t index_count);
+
+public:
+  // setup是VertexLayout<...>::setup，在绑定vbo之后设置属性
+  GeometryArena(size_t _stride, void (*_setup)(size_t, unsigned int),
+                size_t _index_size = sizeof(unsigned int),
+                size_t vertex_capacity = 1 << 16,
+                size_t index_capacity = 1 << 18);
+  GeometryArena(const GeometryArena &) = delete;
+  void operator=(const GeometryArena &) = delete;
+  ~GeometryArena();
+  // vertices按stride紧密排列，indices的类型和index_type()一致
+  bool allocate(const void *vertices, size_t vertex_count, const void *indices,
+                size_t index_count, ArenaRange &range);
+  void release(const ArenaRange &range);
+  void bind() const { glBindVertexArray(vao); }
+  GLenum index_type() const {
+    return index_size == sizeof(uint16_t) ? GL_UNSIGNED_SHORT
+                                          : GL_UNSIGNED_INT;
+  }
+  size_t index_offset(uint32_t first_index) const {
+    return index_size * first_index;
+  }
+  size_t vertex_size() const { return stride; }
+  size_t vertex_bytes() const { return vertex_space.size() * stride; }
+  size_t index_bytes() const { return index_space.size() * index_size; }
+};
+#endif
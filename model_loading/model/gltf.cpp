@@ -0,0 +1,675 @@
+#include "gltf.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+namespace {
+// 只够读glTF的JSON：对象的键按出现顺序存放，数字一律是double
+struct Json {
+  enum Type { Null, Bool, Number, String, Array, Object } type = Null;
+  bool boolean = false;
+  double number = 0.0;
+  std::string string;
+  std::vector<Json> array;
+  std::vector<std::pair<std::string, Json>> object;
+  // 不存在时返回Null，可以一路下标下去
+  const Json &operator[](const char *key) const {
+    static const Json null;
+    for (auto &kv : object)
+      if (kv.first == key)
+        return kv.second;
+    return null;
+  }
+  const Json &operator[](size_t i) const {
+    static const Json null;
+    return i < array.size() ? array[i] : null;
+  }
+  const Json &operator[](int i) const { return (*this)[(size_t)i]; }
+  size_t size() const { return array.size(); }
+  bool is(Type t) const { return type == t; }
+  double num(double fallback) const {
+    return type == Number ? number : fallback;
+  }
+  int integer(int fallback = -1) const {
+    return type == Number ? (int)number : fallback;
+  }
+  const std::string &str() const { return string; }
+};
+class JsonParser {
+  const char *p, *end;
+  int depth = 0;
+  void skip() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+      p++;
+  }
+  bool match(char c) {
+    skip();
+    if (p < end && *p == c) {
+      p++;
+      return true;
+    }
+    return false;
+  }
+  bool literal(const char *word) {
+    size_t n = strlen(word);
+    if ((size_t)(end - p) < n || memcmp(p, word, n) != 0)
+      return false;
+    p += n;
+    return true;
+  }
+  static void utf8(std::string &out, unsigned int c) {
+    if (c < 0x80) {
+      out += (char)c;
+    } else if (c < 0x800) {
+      out += (char)(0xC0 | (c >> 6));
+      out += (char)(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+      out += (char)(0xE0 | (c >> 12));
+      out += (char)(0x80 | ((c >> 6) & 0x3F));
+      out += (char)(0x80 | (c & 0x3F));
+    } else {
+      out += (char)(0xF0 | (c >> 18));
+      out += (char)(0x80 | ((c >> 12) & 0x3F));
+      out += (char)(0x80 | ((c >> 6) & 0x3F));
+      out += (char)(0x80 | (c & 0x3F));
+    }
+  }
+  bool hex4(unsigned int &c) {
+    if (end - p < 4)
+      return false;
+    c = 0;
+    for (int i = 0; i < 4; i++, p++) {
+      char h = *p;
+      c <<= 4;
+      if (h >= '0' && h <= '9')
+        c |= h - '0';
+      else if (h >= 'a' && h <= 'f')
+        c |= h - 'a' + 10;
+      else if (h >= 'A' && h <= 'F')
+        c |= h - 'A' + 10;
+      else
+        return false;
+    }
+    return true;
+  }
+  bool string(std::string &out) {
+    if (!match('"'))
+      return false;
+    while (p < end && *p != '"') {
+      if (*p != '\\') {
+        out += *p++;
+        continue;
+      }
+      if (++p >= end)
+        return false;
+      char e = *p++;
+      switch (e) {
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'u': {
+        unsigned int c;
+        if (!hex4(c))
+          return false;
+        // 代理对
+        if (c >= 0xD800 && c < 0xDC00 && end - p >= 6 && p[0] == '\\' &&
+            p[1] == 'u') {
+          p += 2;
+          unsigned int low;
+          if (!hex4(low))
+            return false;
+          c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+        }
+        utf8(out, c);
+        break;
+      }
+      default:
+        out += e;
+        break;
+      }
+    }
+    return p++ < end;
+  }
+  bool value(Json &out) {
+    skip();
+    if (p >= end || ++depth > 64)
+      return false;
+    bool ok = true;
+    if (*p == '{') {
+      p++;
+      out.type = Json::Object;
+      if (!match('}')) {
+        do {
+          out.object.emplace_back();
+          ok = string(out.object.back().first) && match(':') &&
+               value(out.object.back().second);
+        } while (ok && match(','));
+        ok = ok && match('}');
+      }
+    } else if (*p == '[') {
+      p++;
+      out.type = Json::Array;
+      if (!match(']')) {
+        do {
+          out.array.emplace_back();
+          ok = value(out.array.back());
+        } while (ok && match(','));
+        ok = ok && match(']');
+      }
+    } else if (*p == '"') {
+      out.type = Json::String;
+      ok = string(out.string);
+    } else if (literal("true")) {
+      out.type = Json::Bool;
+      out.boolean = true;
+    } else if (literal("false")) {
+      out.type = Json::Bool;
+    } else if (literal("null")) {
+      out.type = Json::Null;
+    } else {
+      // 文本末尾总有'\0'，strtod不会越界
+      char *stop;
+      out.type = Json::Number;
+      out.number = strtod(p, &stop);
+      ok = stop != p;
+      p = stop;
+    }
+    depth--;
+    return ok;
+  }
+
+public:
+  // text必须以'\0'结尾
+  static bool parse(const std::string &text, Json &out) {
+    JsonParser parser;
+    parser.p = text.c_str();
+    parser.end = parser.p + text.size();
+    if (!parser.value(out))
+      return false;
+    parser.skip();
+    return parser.p == parser.end;
+  }
+};
+std::vector<unsigned char> decode_base64(const char *p, const char *end) {
+  std::vector<unsigned char> out;
+  out.reserve((end - p) / 4 * 3);
+  unsigned int bits = 0;
+  int count = 0;
+  for (; p < end && *p != '='; p++) {
+    char c = *p;
+    int v = c >= 'A' && c <= 'Z'   ? c - 'A'
+            : c >= 'a' && c <= 'z' ? c - 'a' + 26
+            : c >= '0' && c <= '9' ? c - '0' + 52
+            : c == '+'             ? 62
+            : c == '/'             ? 63
+                                   : -1;
+    if (v < 0)
+      continue;
+    bits = bits << 6 | v;
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out.push_back((unsigned char)(bits >> count));
+    }
+  }
+  return out;
+}
+// uri里的%20之类
+std::string decode_uri(const std::string &uri) {
+  std::string out;
+  for (size_t i = 0; i < uri.size(); i++) {
+    if (uri[i] == '%' && i + 2 < uri.size()) {
+      out += (char)strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      out += uri[i];
+    }
+  }
+  return out;
+}
+size_t component_size(int type) {
+  switch (type) {
+  case 5120: // BYTE
+  case 5121: // UNSIGNED_BYTE
+    return 1;
+  case 5122: // SHORT
+  case 5123: // UNSIGNED_SHORT
+    return 2;
+  case 5125: // UNSIGNED_INT
+  case 5126: // FLOAT
+    return 4;
+  }
+  return 0;
+}
+int component_count(const std::string &type) {
+  if (type == "SCALAR")
+    return 1;
+  if (type == "VEC2")
+    return 2;
+  if (type == "VEC3")
+    return 3;
+  if (type == "VEC4")
+    return 4;
+  if (type == "MAT4")
+    return 16;
+  return 0;
+}
+float component(const unsigned char *p, int type, bool normalized) {
+  switch (type) {
+  case 5120: {
+    int8_t v = (int8_t)p[0];
+    return normalized ? std::max(v / 127.0f, -1.0f) : v;
+  }
+  case 5121:
+    return normalized ? p[0] / 255.0f : p[0];
+  case 5122: {
+    int16_t v;
+    memcpy(&v, p, 2);
+    return normalized ? std::max(v / 32767.0f, -1.0f) : v;
+  }
+  case 5123: {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return normalized ? v / 65535.0f : v;
+  }
+  case 5125: {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (float)v;
+  }
+  default: {
+    float v;
+    memcpy(&v, p, 4);
+    return v;
+  }
+  }
+}
+// 不足n个分量的补0
+void read(const GltfAccessor &a, size_t i, float *out, int n) {
+  size_t size = component_size(a.component_type);
+  const unsigned char *p = a.data + a.stride * i;
+  for (int c = 0; c < n; c++)
+    out[c] = c < a.components ? component(p + size * c, a.component_type,
+                                          a.normalized)
+                              : 0.0f;
+}
+struct Range {
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+  size_t stride = 0; // 只有bufferView有
+};
+} // namespace
+bool is_gltf(const std::string &path) {
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos)
+    return false;
+  std::string ext = path.substr(dot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  return ext == "gltf" || ext == "glb";
+}
+GltfAsset::~GltfAsset() {
+  for (auto &m : mappings)
+    munmap(m.first, m.second);
+}
+const unsigned char *GltfAsset::map(const std::string &path, size_t &size) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return nullptr;
+  mappings.push_back({data, (size_t)st.st_size});
+  size = st.st_size;
+  return (const unsigned char *)data;
+}
+const GltfImage *GltfAsset::embedded_image(const std::string &name) const {
+  for (auto &image : images)
+    if (image.data && image.name == name)
+      return &image;
+  return nullptr;
+}
+std::unique_ptr<GltfAsset> GltfAsset::open(const std::string &path) {
+  std::unique_ptr<GltfAsset> asset(new GltfAsset());
+  size_t file_size;
+  const unsigned char *file = asset->map(path, file_size);
+  if (!file) {
+    std::cout << "ERROR::GLTF::Failed to open " << path << std::endl;
+    return nullptr;
+  }
+  std::string directory = path.substr(0, path.find_last_of('/'));
+  // GLB：12字节的文件头，然后是JSON chunk和可选的BIN chunk，chunk按4字节对齐
+  std::string text;
+  Range bin;
+  if (file_size >= 12 && memcmp(file, "glTF", 4) == 0) {
+    uint32_t header[3], chunk[2] = {0, 0};
+    memcpy(header, file, sizeof(header));
+    if (file_size >= 20)
+      memcpy(chunk, file + 12, sizeof(chunk));
+    if (header[1] != 2 || header[2] > file_size || file_size < 20 ||
+        chunk[1] != 0x4E4F534A || 20 + (size_t)chunk[0] > header[2]) {
+      std::cout << "ERROR::GLTF::Invalid GLB " << path << std::endl;
+      return nullptr;
+    }
+    text.assign((const char *)file + 20, chunk[0]);
+    size_t next = 20 + ((chunk[0] + 3) & ~3u);
+    if (next + 8 <= header[2]) {
+      memcpy(chunk, file + next, sizeof(chunk));
+      if (chunk[1] == 0x004E4942 && next + 8 + chunk[0] <= header[2])
+        bin = {file + next + 8, chunk[0]};
+    }
+  } else {
+    text.assign((const char *)file, file_size);
+  }
+  Json doc;
+  if (!JsonParser::parse(text, doc) || !doc.is(Json::Object)) {
+    std::cout << "ERROR::GLTF::Invalid JSON in " << path << std::endl;
+    return nullptr;
+  }
+  if (doc["asset"]["version"].str().substr(0, 2) != "2.") {
+    std::cout << "ERROR::GLTF::Only glTF 2.0 is supported: " << path
+              << std::endl;
+    return nullptr;
+  }
+  // 没有uri的buffer就是GLB的BIN chunk，data URI解码一次，其余的另外映射
+  std::vector<Range> buffers;
+  auto &json_buffers = doc["buffers"];
+  for (size_t i = 0; i < json_buffers.size(); i++) {
+    auto &b = json_buffers[i];
+    auto &uri = b["uri"].str();
+    Range r;
+    if (uri.empty()) {
+      r = i == 0 ? bin : Range();
+    } else if (uri.compare(0, 5, "data:") == 0) {
+      size_t comma = uri.find(',');
+      if (comma != std::string::npos) {
+        auto bytes = decode_base64(uri.c_str() + comma + 1,
+                                   uri.c_str() + uri.size());
+        asset->owned.emplace_back(new unsigned char[bytes.size()]);
+        memcpy(asset->owned.back().get(), bytes.data(), bytes.size());
+        r = {asset->owned.back().get(), bytes.size()};
+      }
+    } else {
+      r.data = asset->map(directory + "/" + decode_uri(uri), r.size);
+    }
+    size_t length = (size_t)b["byteLength"].num(0);
+    if (!r.data || r.size < length) {
+      std::cout << "ERROR::GLTF::Missing buffer " << i << " in " << path
+                << std::endl;
+      return nullptr;
+    }
+    buffers.push_back(r);
+  }
+  std::vector<Range> views;
+  auto &json_views = doc["bufferViews"];
+  for (size_t i = 0; i < json_views.size(); i++) {
+    auto &v = json_views[i];
+    int buffer = v["buffer"].integer();
+    size_t offset = (size_t)v["byteOffset"].num(0);
+    size_t length = (size_t)v["byteLength"].num(0);
+    if (buffer < 0 || (size_t)buffer >= buffers.size() ||
+        offset + length > buffers[buffer].size) {
+      std::cout << "ERROR::GLTF::Invalid bufferView " << i << " in " << path
+                << std::endl;
+      return nullptr;
+    }
+    views.push_back({buffers[buffer].data + offset, length,
+                     (size_t)v["byteStride"].num(0)});
+  }
+  // accessor只是bufferView里带stride的一段，检查最后一个元素不越界
+  auto &json_accessors = doc["accessors"];
+  auto accessor = [&](int index, GltfAccessor &out) {
+    auto &a = json_accessors[index < 0 ? SIZE_MAX : (size_t)index];
+    int view = a["bufferView"].integer();
+    if (!a.is(Json::Object) || view < 0 || (size_t)view >= views.size() ||
+        a["sparse"].is(Json::Object))
+      return false;
+    out.component_type = a["componentType"].integer(0);
+    out.components = component_count(a["type"].str());
+    out.normalized = a["normalized"].boolean;
+    out.count = (size_t)a["count"].num(0);
+    size_t element = component_size(out.component_type) * out.components;
+    size_t offset = (size_t)a["byteOffset"].num(0);
+    auto &r = views[view];
+    out.stride = r.stride ? r.stride : element;
+    out.data = r.data + offset;
+    return element && out.count &&
+           offset + out.stride * (out.count - 1) + element <= r.size;
+  };
+  // 图片和贴图
+  auto &json_images = doc["images"];
+  for (size_t i = 0; i < json_images.size(); i++) {
+    auto &img = json_images[i];
+    auto &uri = img["uri"].str();
+    GltfImage image;
+    int view = img["bufferView"].integer();
+    if (view >= 0 && (size_t)view < views.size()) {
+      image.data = views[view].data;
+      image.size = views[view].size;
+    } else if (uri.compare(0, 5, "data:") == 0) {
+      size_t comma = uri.find(',');
+      auto bytes = decode_base64(uri.c_str() + std::min(comma, uri.size()),
+                                 uri.c_str() + uri.size());
+      asset->owned.emplace_back(new unsigned char[bytes.size()]);
+      memcpy(asset->owned.back().get(), bytes.data(), bytes.size());
+      image.data = asset->owned.back().get();
+      image.size = bytes.size();
+    }
+    image.name = image.data ? path + "#" + std::to_string(i) : decode_uri(uri);
+    asset->images.push_back(std::move(image));
+  }
+  auto &textures = doc["textures"];
+  auto texture_image = [&](const Json &info) {
+    int t = info["index"].integer();
+    int source = t >= 0 ? textures[(size_t)t]["source"].integer() : -1;
+    return source >= 0 && (size_t)source < asset->images.size() ? source : -1;
+  };
+  auto &json_materials = doc["materials"];
+  for (size_t i = 0; i < json_materials.size(); i++) {
+    auto &m = json_materials[i];
+    GltfMaterial material;
+    material.base_color =
+        texture_image(m["pbrMetallicRoughness"]["baseColorTexture"]);
+    material.normal = texture_image(m["normalTexture"]);
+    asset->materials.push_back(material);
+  }
+  // 先序展开节点，每个节点引用的mesh的每个primitive对应一个GltfPrimitive
+  auto &nodes = doc["nodes"];
+  auto &meshes = doc["meshes"];
+  std::vector<bool> visited(nodes.size());
+  size_t skipped = 0;
+  auto visit = [&](auto &self, size_t n, int32_t parent) -> void {
+    if (n >= nodes.size() || visited[n])
+      return;
+    visited[n] = true;
+    auto &node = nodes[n];
+    glm::mat4 local(1.0f);
+    auto &matrix = node["matrix"];
+    if (matrix.size() == 16) {
+      for (int c = 0; c < 16; c++)
+        local[c / 4][c % 4] = (float)matrix[c].num(0);
+    } else {
+      auto &t = node["translation"], &r = node["rotation"], &s = node["scale"];
+      glm::vec3 translation(t[0].num(0), t[1].num(0), t[2].num(0));
+      glm::quat rotation((float)r[3].num(1), (float)r[0].num(0),
+                         (float)r[1].num(0), (float)r[2].num(0));
+      glm::vec3 scale(s[0].num(1), s[1].num(1), s[2].num(1));
+      local = glm::translate(glm::mat4(1.0f), translation) *
+              glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+    }
+    uint32_t index = asset->graph.add(parent, local, node["name"].str());
+    if (index == UINT32_MAX)
+      return;
+    int mesh = node["mesh"].integer();
+    auto &primitives = meshes[mesh < 0 ? SIZE_MAX : (size_t)mesh]["primitives"];
+    for (size_t k = 0; k < primitives.size(); k++) {
+      auto &prim = primitives[k];
+      auto &attributes = prim["attributes"];
+      GltfPrimitive p;
+      p.node = index;
+      p.material = prim["material"].integer();
+      bool ok = prim["mode"].integer(4) == 4 &&
+                accessor(attributes["POSITION"].integer(), p.position) &&
+                p.position.component_type == 5126 &&
+                p.position.components == 3;
+      if (ok && attributes["NORMAL"].is(Json::Number))
+        ok = accessor(attributes["NORMAL"].integer(), p.normal) &&
+             p.normal.count == p.position.count;
+      if (ok && attributes["TEXCOORD_0"].is(Json::Number))
+        ok = accessor(attributes["TEXCOORD_0"].integer(), p.texcoord) &&
+             p.texcoord.count == p.position.count;
+      // 规范只允许UNSIGNED_BYTE、UNSIGNED_SHORT、UNSIGNED_INT作为index
+      if (ok && prim["indices"].is(Json::Number))
+        ok = accessor(prim["indices"].integer(), p.indices) &&
+             p.indices.components == 1 &&
+             (p.indices.component_type == 5121 ||
+              p.indices.component_type == 5123 ||
+              p.indices.component_type == 5125);
+      // index会直接上传，越界的index要在这里挡住
+      if (ok && p.indices.data) {
+        std::vector<unsigned int> indices(p.indices.count);
+        gltf_read_indices(p, indices.data());
+        ok = *std::max_element(indices.begin(), indices.end()) <
+             p.position.count;
+      }
+      if (!ok) {
+        skipped++;
+        continue;
+      }
+      // 规范要求POSITION带min和max，没有时自己算
+      auto &a = json_accessors[(size_t)attributes["POSITION"].integer()];
+      if (a["min"].size() == 3 && a["max"].size() == 3) {
+        for (int c = 0; c < 3; c++) {
+          p.min[c] = (float)a["min"][c].num(0);
+          p.max[c] = (float)a["max"][c].num(0);
+        }
+      } else {
+        float v[3];
+        read(p.position, 0, v, 3);
+        p.min = p.max = glm::vec3(v[0], v[1], v[2]);
+        for (size_t i = 1; i < p.position.count; i++) {
+          read(p.position, i, v, 3);
+          p.min = glm::min(p.min, glm::vec3(v[0], v[1], v[2]));
+          p.max = glm::max(p.max, glm::vec3(v[0], v[1], v[2]));
+        }
+      }
+      asset->primitives.push_back(p);
+    }
+    auto &children = node["children"];
+    for (size_t c = 0; c < children.size(); c++)
+      self(self, (size_t)children[c].num(SIZE_MAX), index);
+  };
+  // 没有scene时所有不是别人子节点的节点都是根
+  auto &scenes = doc["scenes"];
+  std::vector<size_t> roots;
+  if (scenes.size()) {
+    auto &list = scenes[(size_t)doc["scene"].integer(0)]["nodes"];
+    for (size_t i = 0; i < list.size(); i++)
+      roots.push_back((size_t)list[i].num(SIZE_MAX));
+  } else {
+    std::vector<bool> child(nodes.size());
+    for (size_t n = 0; n < nodes.size(); n++)
+      for (size_t c = 0; c < nodes[n]["children"].size(); c++) {
+        size_t k = (size_t)nodes[n]["children"][c].num(SIZE_MAX);
+        if (k < child.size())
+          child[k] = true;
+      }
+    for (size_t n = 0; n < nodes.size(); n++)
+      if (!child[n])
+        roots.push_back(n);
+  }
+  for (auto n : roots)
+    visit(visit, n, -1);
+  if (skipped)
+    std::cout << "ERROR::GLTF::Skipped " << skipped
+              << " primitives (not triangles, sparse or invalid) in " << path
+              << std::endl;
+  return asset;
+}
+const void *gltf_static_vertices(const GltfPrimitive &p) {
+  auto &pos = p.position, &n = p.normal, &uv = p.texcoord;
+  bool interleaved = n.data == pos.data + 12 && uv.data == pos.data + 24 &&
+                     pos.stride == GLTF_STATIC_STRIDE &&
+                     n.stride == GLTF_STATIC_STRIDE &&
+                     uv.stride == GLTF_STATIC_STRIDE;
+  bool floats = n.component_type == 5126 && n.components == 3 &&
+                uv.component_type == 5126 && uv.components == 2;
+  return interleaved && floats ? pos.data : nullptr;
+}
+void gltf_pack_static(const GltfPrimitive &p, unsigned char *out) {
+  float v[8] = {};
+  for (size_t i = 0; i < p.vertex_count(); i++) {
+    read(p.position, i, v, 3);
+    if (p.normal.data)
+      read(p.normal, i, v + 3, 3);
+    if (p.texcoord.data)
+      read(p.texcoord, i, v + 6, 2);
+    memcpy(out + GLTF_STATIC_STRIDE * i, v, GLTF_STATIC_STRIDE);
+  }
+}
+void gltf_read_vertices(const GltfPrimitive &p, Vertex *out) {
+  for (size_t i = 0; i < p.vertex_count(); i++) {
+    Vertex &v = out[i];
+    v = Vertex{};
+    read(p.position, i, &v.Position.x, 3);
+    if (p.normal.data)
+      read(p.normal, i, &v.Normal.x, 3);
+    if (p.texcoord.data)
+      read(p.texcoord, i, &v.TexCoords.x, 2);
+  }
+}
+const void *gltf_direct_indices(const GltfPrimitive &p, bool index16) {
+  auto &a = p.indices;
+  if (!a.data)
+    return nullptr;
+  if (index16 && a.component_type == 5123 && a.stride == 2)
+    return a.data;
+  if (!index16 && a.component_type == 5125 && a.stride == 4)
+    return a.data;
+  return nullptr;
+}
+void gltf_read_indices(const GltfPrimitive &p, unsigned int *out) {
+  auto &a = p.indices;
+  if (!a.data) {
+    for (size_t i = 0; i < p.position.count; i++)
+      out[i] = (unsigned int)i;
+    return;
+  }
+  for (size_t i = 0; i < a.count; i++) {
+    const unsigned char *e = a.data + a.stride * i;
+    if (a.component_type == 5121) {
+      out[i] = e[0];
+    } else if (a.component_type == 5123) {
+      uint16_t v;
+      memcpy(&v, e, 2);
+      out[i] = v;
+    } else if (a.component_type == 5125) {
+      memcpy(&out[i], e, 4);
+    } else {
+      out[i] = 0;
+    }
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef GLTF_H
+#define GLTF_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "mesh_data.h"
+#include "scene_graph.h"
+/**
+ * @brief 直接读取glTF 2.0（.gltf和.glb），不经过Assimp
+ * 文件和外部的.bin都用mmap映射，accessor解析成指向映射内存的指针和stride，
+ * 不复制任何顶点数据。position、normal、texcoord正好按StaticVertexLayout交错
+ * 存放时顶点可以直接上传，16/32位index的宽度和arena一致时index也直接上传，
+ * 其他情况才打包一次。内嵌的图片只记录映射内存里的范围，由线程池解码。
+ *
+ * 只支持三角形（mode 4）和非sparse的accessor，一个mesh被多个node引用时每个
+ * node各上传一份。
+ */
+// 和StaticVertexLayout一致：vec3 position, vec3 normal, vec2 uv
+constexpr size_t GLTF_STATIC_STRIDE = 32;
+struct GltfAccessor {
+  const unsigned char *data = nullptr; // 第一个元素
+  size_t count = 0;
+  size_t stride = 0;
+  int component_type = 0; // GL_FLOAT之类，数值和GL一致
+  int components = 0;
+  bool normalized = false;
+};
+struct GltfPrimitive {
+  GltfAccessor position, normal, texcoord, indices;
+  int material = -1;
+  uint32_t node = 0;
+  glm::vec3 min = glm::vec3(0.0f), max = glm::vec3(0.0f);
+  size_t vertex_count() const { return position.count; }
+  // 没有index时按顶点顺序画
+  size_t index_count() const {
+    return indices.data ? indices.count : position.count;
+  }
+};
+struct GltfImage {
+  // 材质里引用的贴图名，外部文件是相对路径，内嵌的是"文件路径#下标"
+  std::string name;
+  const unsigned char *data = nullptr; // 内嵌时指向映射内存或者解码的data URI
+  size_t size = 0;
+};
+struct GltfMaterial {
+  int base_color = -1; // images中的下标
+  int normal = -1;
+};
+class GltfAsset {
+  std::vector<std::pair<void *, size_t>> mappings;
+  // data URI解码出来的buffer
+  std::vector<std::unique_ptr<unsigned char[]>> owned;
+  GltfAsset() = default;
+  const unsigned char *map(const std::string &path, size_t &size);
+
+public:
+  std::vector<GltfPrimitive> primitives;
+  std::vector<GltfImage> images;
+  std::vector<GltfMaterial> materials;
+  SceneGraph graph;
+  GltfAsset(const GltfAsset &) = delete;
+  void operator=(const GltfAsset &) = delete;
+  ~GltfAsset();
+  // 解析失败时输出错误并返回空
+  static std::unique_ptr<GltfAsset> open(const std::string &path);
+  // 内嵌图片，外部文件或者找不到时返回空
+  const GltfImage *embedded_image(const std::string &name) const;
+};
+bool is_gltf(const std::string &path);
+// 三个属性正好按StaticVertexLayout交错存放时返回映射内存里的顶点，否则返回空
+const void *gltf_static_vertices(const GltfPrimitive &p);
+// 打包成StaticVertexLayout，out有GLTF_STATIC_STRIDE * vertex_count()字节
+void gltf_pack_static(const GltfPrimitive &p, unsigned char *out);
+// 转换成完整的Vertex，没有的属性为0，out需要vertex_count()个
+void gltf_read_vertices(const GltfPrimitive &p, Vertex *out);
+// index宽度和arena一致（index16时为16位）时返回映射内存里的index，否则返回空
+const void *gltf_direct_indices(const GltfPrimitive &p, bool index16);
+// out需要index_count()个
+void gltf_read_indices(const GltfPrimitive &p, unsigned int *out);
+#endif
@@ -0,0 +1,138 @@
+#include "import_arena.h"
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMPORT_ARENA_SSE 1
+#endif
+// aiVector3D和glm::vec3都是三个紧密排列的float，可以按字节复制
+static_assert(sizeof(aiVector3D) == sizeof(glm::vec3));
+static size_t face_indices(const aiMesh *mesh) {
+  // Triangulate之后只有三角形的mesh不需要遍历面
+  if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+    return (size_t)mesh->mNumFaces * 3;
+  size_t count = 0;
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    count += mesh->mFaces[i].mNumIndices;
+  return count;
+}
+// mesh没有的属性为空，对应的分量写0
+struct VertexStreams {
+  const aiVector3D *position, *normal, *uv, *tangent, *bitangent;
+};
+static glm::vec3 stream_vec3(const aiVector3D *in, size_t i) {
+  return in ? glm::vec3(in[i].x, in[i].y, in[i].z) : glm::vec3(0.0f);
+}
+static void convert_vertex(Vertex &out, const VertexStreams &s, size_t i) {
+  Vertex v;
+  memset((void *)&v, 0, sizeof(Vertex));
+  v.Position = stream_vec3(s.position, i);
+  v.Normal = stream_vec3(s.normal, i);
+  if (s.uv)
+    v.TexCoords = glm::vec2(s.uv[i].x, s.uv[i].y);
+  v.Tangent = stream_vec3(s.tangent, i);
+  v.Bitangent = stream_vec3(s.bitangent, i);
+  out = v;
+}
+#ifdef IMPORT_ARENA_SSE
+static_assert(sizeof(Vertex) == 88 && offsetof(Vertex, Normal) == 12 &&
+              offsetof(Vertex, TexCoords) == 24 &&
+              offsetof(Vertex, Tangent) == 32 &&
+              offsetof(Vertex, Bitangent) == 44 &&
+              offsetof(Vertex, m_BoneIDs) == 56);
+// 4个连续的vec3正好是3个__m128，拆开后每个的xyz在低3个分量
+static void load4(const aiVector3D *in, size_t i, __m128 v[4]) {
+  if (!in) {
+    v[0] = v[1] = v[2] = v[3] = _mm_setzero_ps();
+    return;
+  }
+  const float *f = &in[i].x;
+  __m128 a0 = _mm_loadu_ps(f), a1 = _mm_loadu_ps(f + 4),
+         a2 = _mm_loadu_ps(f + 8);
+  v[0] = a0;
+  v[1] = _mm_shuffle_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(0, 0, 3, 3)), a1,
+                        _MM_SHUFFLE(1, 1, 2, 0));
+  v[2] = _mm_shuffle_ps(a1, a2, _MM_SHUFFLE(0, 0, 3, 2));
+  v[3] = _mm_shuffle_ps(a2, a2, _MM_SHUFFLE(3, 3, 2, 1));
+}
+// (a.xyz, b.x)
+static __m128 join3(__m128 a, __m128 b) {
+  __m128 t = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 2, 2));
+  return _mm_shuffle_ps(a, t, _MM_SHUFFLE(2, 0, 1, 0));
+}
+#endif
+/*
+  每个Vertex按顺序只写一次，不先清零再按属性各扫一遍88字节的数组。
+  SSE下一次处理4个顶点：每个属性读3个__m128，重排成完整的Vertex，
+  每个顶点5次16字节和1次8字节的写，骨骼部分写0，之后由fill_bone_weights填。
+  这段内存马上会被骨骼权重和合并顶点读到，所以不用绕过缓存的写。
+*/
+static void convert_vertices(Vertex *out, const VertexStreams &s, size_t n) {
+  size_t i = 0;
+#ifdef IMPORT_ARENA_SSE
+  __m128 zero = _mm_setzero_ps();
+  for (; i + 4 <= n; i += 4) {
+    __m128 p[4], nm[4], uv[4], t[4], b[4];
+    load4(s.position, i, p);
+    load4(s.normal, i, nm);
+    load4(s.uv, i, uv);
+    load4(s.tangent, i, t);
+    load4(s.bitangent, i, b);
+    for (int k = 0; k < 4; k++) {
+      float *dst = (float *)(out + i + k);
+      _mm_storeu_ps(dst, join3(p[k], nm[k]));
+      _mm_storeu_ps(dst + 4,
+                    _mm_shuffle_ps(nm[k], uv[k], _MM_SHUFFLE(1, 0, 2, 1)));
+      _mm_storeu_ps(dst + 8, join3(t[k], b[k]));
+      _mm_storeu_ps(dst + 12,
+                    _mm_shuffle_ps(b[k], zero, _MM_SHUFFLE(0, 0, 2, 1)));
+      _mm_storeu_ps(dst + 16, zero);
+      _mm_storel_pi((__m64 *)(dst + 20), zero);
+    }
+  }
+#endif
+  for (; i < n; i++)
+    convert_vertex(out[i], s, i);
+}
+ImportArena::ImportArena(const std::vector<aiMesh *> &meshes) {
+  first_vertex.resize(meshes.size() + 1);
+  first_index.resize(meshes.size() + 1);
+  first_vertex[0] = first_index[0] = 0;
+  for (size_t i = 0; i < meshes.size(); i++) {
+    first_vertex[i + 1] = first_vertex[i] + meshes[i]->mNumVertices;
+    first_index[i + 1] = first_index[i] + face_indices(meshes[i]);
+  }
+  // 不做初始化，convert会在各自的线程里写满每一段
+  vertices.reset(new Vertex[first_vertex.back()]);
+  indices.reset(new unsigned int[first_index.back()]);
+}
+void ImportArena::convert(size_t i, const aiMesh *mesh,
+                          const Skeleton *skeleton) {
+  Vertex *out = vertices.get() + first_vertex[i];
+  size_t n = vertex_count(i);
+  // 没有的属性和骨骼都为0
+  bool tangents = mesh->HasTangentsAndBitangents();
+  VertexStreams streams = {
+      mesh->mVertices, mesh->HasNormals() ? mesh->mNormals : nullptr,
+      // only use the first texcoords, though there's 8
+      mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0] : nullptr,
+      tangents ? mesh->mTangents : nullptr,
+      tangents ? mesh->mBitangents : nullptr};
+  convert_vertices(out, streams, n);
+  if (skeleton && mesh->HasBones())
+    fill_bone_weights(mesh, *skeleton, out);
+  unsigned int *dst = indices.get() + first_index[i];
+  if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) {
+    for (unsigned int f = 0; f < mesh->mNumFaces; f++, dst += 3) {
+      const unsigned int *src = mesh->mFaces[f].mIndices;
+      dst[0] = src[0];
+      dst[1] = src[1];
+      dst[2] = src[2];
+    }
+    return;
+  }
+  for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+    const aiFace &face = mesh->mFaces[f];
+    memcpy(dst, face.mIndices, sizeof(unsigned int) * face.mNumIndices);
+    dst += face.mNumIndices;
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef IMPORT_ARENA_H
+#define IMPORT_ARENA_H
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <assimp/scene.h>
+#include "animation.h"
+#include "mesh_data.h"
+// aiMatrix4x4按行存放，glm按列
+inline glm::mat4 to_glm(const aiMatrix4x4 &m) {
+  glm::mat4 out;
+  for (int r = 0; r < 4; r++)
+    for (int c = 0; c < 4; c++)
+      out[c][r] = m[r][c];
+  return out;
+}
+/**
+ * @brief 导入时整个场景共用的转换缓冲
+ * 先按aiScene里所有mesh的顶点数和index数算好总量，一次分配两块连续内存，
+ * 每个mesh转换进自己的那一段，转换过程中没有任何堆分配，不同mesh可以并行写。
+ * 顶点按顺序一趟写完所有属性，SSE下4个一组重排，
+ * 之后再填骨骼权重，三角形面直接展开成index。合并重复顶点时从这里读，写进MeshData，
+ * 所以MeshData只在最终大小确定之后分配一次。
+ */
+class ImportArena {
+  std::unique_ptr<Vertex[]> vertices;
+  std::unique_ptr<unsigned int[]> indices;
+  // 每个mesh的起点，多存一个总数
+  std::vector<size_t> first_vertex, first_index;
+
+public:
+  explicit ImportArena(const std::vector<aiMesh *> &meshes);
+  ImportArena(const ImportArena &) = delete;
+  void operator=(const ImportArena &) = delete;
+  // 把第i个mesh转换进自己的那一段，不同的i可以在不同线程同时调用。
+  // skeleton不为空时按它分配的bone id写入骨骼权重
+  void convert(size_t i, const aiMesh *mesh,
+               const Skeleton *skeleton = nullptr);
+  const Vertex *mesh_vertices(size_t i) const {
+    return vertices.get() + first_vertex[i];
+  }
+  size_t vertex_count(size_t i) const {
+    return first_vertex[i + 1] - first_vertex[i];
+  }
+  const unsigned int *mesh_indices(size_t i) const {
+    return indices.get() + first_index[i];
+  }
+  size_t index_count(size_t i) const {
+    return first_index[i + 1] - first_index[i];
+  }
+  size_t bytes() const {
+    return first_vertex.back() * sizeof(Vertex) +
+           first_index.back() * sizeof(unsigned int);
+  }
+};
+#endif
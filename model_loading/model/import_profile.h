@@ -0,0 +1,57 @@
+#ifndef IMPORT_PROFILE_H
+#define IMPORT_PROFILE_H
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <assimp/postprocess.h>
+/**
+ * @brief 按名字选择的导入参数，用导入时间换运行时开销
+ *   default           Triangulate | FlipUVs，之后走mesh_optimize、meshlet和LOD
+ *   fast-preview      同样的Assimp参数，跳过自己的优化，只求尽快看到模型
+ *   optimized-runtime 再加上Assimp的合并顶点、缓存优化、合并mesh和节点、切线
+ * flags只有Triangulate | FlipUVs时OBJ走自己的并行解析器，否则交给Assimp。
+ * 参数不同缓存的key也不同，切换profile不会读到别的profile的缓存。
+ */
+constexpr unsigned int IMPORT_BASE_FLAGS =
+    aiProcess_Triangulate | aiProcess_FlipUVs;
+struct ImportProfile {
+  const char *name;
+  unsigned int flags; // Assimp的后处理步骤
+  bool optimize;      // 是否运行mesh_optimize、meshlet和LOD
+  uint64_t salt() const { return flags | (uint64_t)optimize << 32; }
+};
+inline const ImportProfile &import_profile(const std::string &name) {
+  static const ImportProfile profiles[] = {
+      {"default", IMPORT_BASE_FLAGS, true},
+      {"fast-preview", IMPORT_BASE_FLAGS, false},
+      {"optimized-runtime",
+       IMPORT_BASE_FLAGS | aiProcess_JoinIdenticalVertices |
+           aiProcess_ImproveCacheLocality | aiProcess_OptimizeMeshes |
+           aiProcess_OptimizeGraph | aiProcess_CalcTangentSpace |
+           aiProcess_SortByPType,
+       true},
+  };
+  for (auto &p : profiles)
+    if (name == p.name)
+      return p;
+  std::cout << "ERROR::IMPORT::Unknown profile " << name << std::endl;
+  return profiles[0];
+}
+// 导入前后的规模，before是导入器给出的结果，after是最终上传的
+struct ImportReport {
+  double import_ms = 0.0, total_ms = 0.0;
+  size_t vertices_before = 0, vertices_after = 0;
+  size_t triangles_before = 0, triangles_after = 0;
+  size_t draws_before = 0, draws_after = 0;
+  bool cached = false;
+  void print(const std::string &path, const ImportProfile &profile) const {
+    printf("%s [%s%s]: import %.1f ms, total %.1f ms, vertices %zu -> %zu, "
+           "triangles %zu -> %zu, draws %zu -> %zu\n",
+           path.c_str(), profile.name, cached ? ", cached" : "", import_ms,
+           total_ms, vertices_before, vertices_after, triangles_before,
+           triangles_after, draws_before, draws_after);
+  }
+};
+#endif
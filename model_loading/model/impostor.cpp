@@ -0,0 +1,67 @@
+#include "impostor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+static glm::vec2 sign_not_zero(glm::vec2 v) {
+  return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+glm::vec3 octahedron_decode(glm::vec2 uv) {
+  glm::vec2 f = uv * 2.0f - 1.0f;
+  glm::vec3 n(f.x, 1.0f - std::fabs(f.x) - std::fabs(f.y), f.y);
+  if (n.y < 0.0f) {
+    glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.z, n.x))) *
+                       sign_not_zero(glm::vec2(n.x, n.z));
+    n.x = folded.x;
+    n.z = folded.y;
+  }
+  return glm::normalize(n);
+}
+glm::vec2 octahedron_encode(glm::vec3 dir) {
+  dir /= std::fabs(dir.x) + std::fabs(dir.y) + std::fabs(dir.z);
+  glm::vec2 f(dir.x, dir.z);
+  if (dir.y < 0.0f)
+    f = (1.0f - glm::abs(glm::vec2(dir.z, dir.x))) * sign_not_zero(f);
+  return f * 0.5f + 0.5f;
+}
+glm::uvec2 impostor_cell(glm::vec3 dir, uint32_t grid) {
+  glm::vec2 uv = octahedron_encode(dir) * (float)grid;
+  return glm::uvec2(std::min<uint32_t>(std::max(uv.x, 0.0f), grid - 1),
+                    std::min<uint32_t>(std::max(uv.y, 0.0f), grid - 1));
+}
+bool write_impostor(const std::string &path, const ImpostorAtlas &atlas) {
+  std::ofstream stream(path, std::ios::binary);
+  if (!stream) {
+    std::cout << "ERROR::IMPOSTOR::Failed to write " << path << std::endl;
+    return false;
+  }
+  stream.write((const char *)&atlas.header, sizeof(atlas.header));
+  stream.write((const char *)atlas.color.data(), atlas.color.size());
+  stream.write((const char *)atlas.normal.data(), atlas.normal.size());
+  stream.write((const char *)atlas.depth.data(),
+               atlas.depth.size() * sizeof(uint16_t));
+  return (bool)stream;
+}
+bool read_impostor(const std::string &path, ImpostorAtlas &atlas) {
+  std::ifstream stream(path, std::ios::binary);
+  auto &h = atlas.header;
+  if (!stream.read((char *)&h, sizeof(h)) || memcmp(h.magic, "IMPO", 4) != 0 ||
+      h.version != IMPOSTOR_VERSION || h.grid == 0 || h.size() == 0 ||
+      h.size() > 16384) {
+    std::cout << "ERROR::IMPOSTOR::Bad header " << path << std::endl;
+    return false;
+  }
+  size_t pixels = (size_t)h.size() * h.size();
+  atlas.color.resize(pixels * 4);
+  atlas.normal.resize(pixels * 4);
+  atlas.depth.resize(pixels);
+  stream.read((char *)atlas.color.data(), atlas.color.size());
+  stream.read((char *)atlas.normal.data(), atlas.normal.size());
+  stream.read((char *)atlas.depth.data(), pixels * sizeof(uint16_t));
+  if (!stream) {
+    std::cout << "ERROR::IMPOSTOR::Truncated " << path << std::endl;
+    return false;
+  }
+  return true;
+}
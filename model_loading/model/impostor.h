@@ -0,0 +1,46 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+/**
+ * @brief 远处模型的billboard impostor
+ * 烘焙时用正交投影从grid x grid个方向各画一次模型，每个方向占图集里的一格，
+ * 输出颜色、模型空间法线和深度三张图集。方向按八面体映射排列：单位球面先投影
+ * 到八面体上，下半球折到外侧的四个三角形，整张正方形均匀覆盖所有方向。
+ * 运行时按相机在模型空间的方向选最近的一格，画一个朝向相机的四边形。
+ *
+ * 每格的相机在包围球中心外2r处，近平面r、远平面3r，深度0.5就是包围球中心所在
+ * 的平面，fragment shader用它把四边形的深度还原到模型表面。
+ *
+ * .impostor 文件格式：
+ *   ImpostorHeader
+ *   颜色 RGBA8，法线 RGBA8（n * 0.5 + 0.5），深度 R16，都是size x size，
+ *   从下往上逐行，和glReadPixels一致
+ */
+struct ImpostorHeader {
+  char magic[4]; // "IMPO"
+  uint32_t version;
+  uint32_t grid;      // 每边的方向数
+  uint32_t cell_size; // 每格的像素
+  float center[3];    // 模型空间的包围球
+  float radius;
+  uint32_t size() const { return grid * cell_size; }
+};
+constexpr uint32_t IMPOSTOR_VERSION = 1;
+// uv在[0, 1]，y轴朝上
+glm::vec3 octahedron_decode(glm::vec2 uv);
+glm::vec2 octahedron_encode(glm::vec3 dir);
+// dir是从包围球中心指向相机的方向，返回图集中的格子
+glm::uvec2 impostor_cell(glm::vec3 dir, uint32_t grid);
+// 烘焙出的三张图集
+struct ImpostorAtlas {
+  ImpostorHeader header = {};
+  std::vector<unsigned char> color, normal;
+  std::vector<uint16_t> depth;
+};
+bool write_impostor(const std::string &path, const ImpostorAtlas &atlas);
+// 失败时输出错误并返回false
+bool read_impostor(const std::string &path, ImpostorAtlas &atlas);
+#endif
@@ -0,0 +1,308 @@
+#include "mesh_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mesh_codec.h"
+#include "thread_pool.h"
+static uint64_t align16(uint64_t v) { return (v + 15) & ~uint64_t(15); }
+// [offset, offset + count * stride)在[0, total)里面，写成减法避免被篡改的值溢出
+static bool fits(uint64_t offset, uint64_t count, uint64_t total,
+                 uint64_t stride = 1) {
+  return offset <= total && count <= (total - offset) / stride;
+}
+uint64_t hash_source(const std::string &path, uint64_t salt) {
+  uint64_t hash = 14695981039346656037ull;
+  auto mix = [&hash](const unsigned char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      hash ^= p[i];
+      hash *= 1099511628211ull;
+    }
+  };
+  uint64_t version = MESH_CACHE_VERSION;
+  mix((const unsigned char *)&version, sizeof(version));
+  mix((const unsigned char *)&salt, sizeof(salt));
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream.is_open())
+    return 0;
+  // 顺便收集obj里的mtllib行，材质文件改了缓存里的贴图名也要跟着变
+  std::vector<std::string> libraries;
+  std::string line;
+  auto end_line = [&libraries, &line]() {
+    size_t begin = line.find_first_not_of(" \t");
+    if (begin != std::string::npos && line.compare(begin, 7, "mtllib ") == 0) {
+      begin = line.find_first_not_of(" \t", begin + 7);
+      size_t end = line.find_last_not_of(" \t");
+      if (begin != std::string::npos)
+        libraries.push_back(line.substr(begin, end - begin + 1));
+    }
+    line.clear();
+  };
+  std::vector<unsigned char> buffer(1 << 16);
+  while (stream) {
+    stream.read((char *)buffer.data(), buffer.size());
+    mix(buffer.data(), stream.gcount());
+    for (std::streamsize i = 0; i < stream.gcount(); i++) {
+      char c = buffer[i];
+      if (c == '\n' || c == '\r')
+        end_line();
+      else if (line.size() < 4096)
+        line.push_back(c);
+    }
+  }
+  end_line();
+  // 和Assimp一样相对obj所在的目录
+  std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+  for (auto &name : libraries) {
+    mix((const unsigned char *)name.data(), name.size());
+    std::ifstream library(directory + name, std::ios::binary);
+    while (library) {
+      library.read((char *)buffer.data(), buffer.size());
+      mix(buffer.data(), library.gcount());
+    }
+  }
+  return hash;
+}
+bool write_mesh_cache(const std::string &path, uint64_t hash,
+                      const std::vector<const MeshData *> &meshes,
+                      const SceneGraph &graph) {
+  MeshCacheHeader header = {};
+  memcpy(header.magic, "MSHC", 4);
+  header.version = MESH_CACHE_VERSION;
+  header.source_hash = hash;
+  header.vertex_size = sizeof(Vertex);
+  header.mesh_count = meshes.size();
+  std::vector<MeshCacheRecord> records;
+  std::vector<MeshCacheTexture> textures;
+  std::string strings;
+  glm::vec3 min(0.0f), max(0.0f);
+  // 每个mesh独立压缩，可以并行
+  std::vector<std::vector<unsigned char>> vertex_data(meshes.size()),
+      index_data(meshes.size());
+  ThreadPool::getInstance().parallel_for(meshes.size(), [&](size_t i) {
+    auto &m = *meshes[i];
+    encode_vertices(m.vertices.data(), m.vertices.size(), sizeof(Vertex),
+                    vertex_data[i]);
+    encode_indices(m.indices.data(), m.indices.size(), index_data[i]);
+  });
+  for (size_t i = 0; i < meshes.size(); i++) {
+    auto &m = *meshes[i];
+    MeshCacheRecord r = {};
+    r.vertex_count = m.vertices.size();
+    r.index_count = m.indices.size();
+    r.vertex_data = header.vertex_bytes;
+    r.vertex_bytes = vertex_data[i].size();
+    r.index_data = header.index_bytes;
+    r.index_bytes = index_data[i].size();
+    header.vertex_bytes += r.vertex_bytes;
+    header.index_bytes += r.index_bytes;
+    r.first_texture = textures.size();
+    const std::vector<std::string> *lists[] = {&m.diffuse, &m.specular,
+                                               &m.normal, &m.ambient};
+    for (uint32_t type = 0; type < 4; type++) {
+      for (auto &name : *lists[type]) {
+        textures.push_back({type, (uint32_t)strings.size()});
+        strings += name;
+        strings.push_back('\0');
+      }
+    }
+    r.texture_count = textures.size() - r.first_texture;
+    memcpy(r.min, &m.min.x, sizeof(r.min));
+    memcpy(r.max, &m.max.x, sizeof(r.max));
+    r.radius = m.radius;
+    r.lod_count = std::min(m.lods.size(), (size_t)MAX_LODS);
+    std::copy(m.lods.begin(), m.lods.begin() + r.lod_count, r.lods);
+    r.first_meshlet = header.meshlet_count;
+    r.meshlet_count = m.meshlets.size();
+    header.meshlet_count += m.meshlets.size();
+    r.node = m.node;
+    min = i ? glm::min(min, m.min) : m.min;
+    max = i ? glm::max(max, m.max) : m.max;
+    header.vertex_count += m.vertices.size();
+    header.index_count += m.indices.size();
+    records.push_back(r);
+  }
+  std::vector<MeshCacheNode> nodes(graph.size());
+  for (uint32_t n = 0; n < graph.size(); n++) {
+    nodes[n].parent = graph.parent(n);
+    memcpy(nodes[n].local, &graph.local(n)[0].x, sizeof(nodes[n].local));
+  }
+  header.node_count = nodes.size();
+  memcpy(header.min, &min.x, sizeof(header.min));
+  memcpy(header.max, &max.x, sizeof(header.max));
+  header.texture_count = textures.size();
+  header.string_bytes = strings.size();
+  header.record_offset = align16(sizeof(header));
+  header.texture_offset =
+      align16(header.record_offset + sizeof(MeshCacheRecord) * records.size());
+  header.string_offset = align16(header.texture_offset +
+                                 sizeof(MeshCacheTexture) * textures.size());
+  header.vertex_offset = align16(header.string_offset + strings.size());
+  header.index_offset = align16(header.vertex_offset + header.vertex_bytes);
+  header.meshlet_offset = align16(header.index_offset + header.index_bytes);
+  header.node_offset = align16(header.meshlet_offset +
+                               sizeof(Meshlet) * header.meshlet_count);
+  // 先写临时文件再rename，避免写到一半的缓存被下次启动读到
+  std::string tmp = path + ".tmp";
+  std::ofstream stream(tmp, std::ios::binary);
+  if (!stream.is_open()) {
+    std::cout << "ERROR::MESHCACHE::Failed to open " << tmp << std::endl;
+    return false;
+  }
+  auto pad = [&stream](uint64_t offset) {
+    static const char zero[16] = {};
+    stream.write(zero, offset - stream.tellp());
+  };
+  stream.write((const char *)&header, sizeof(header));
+  pad(header.record_offset);
+  stream.write((const char *)records.data(),
+               sizeof(MeshCacheRecord) * records.size());
+  pad(header.texture_offset);
+  stream.write((const char *)textures.data(),
+               sizeof(MeshCacheTexture) * textures.size());
+  pad(header.string_offset);
+  stream.write(strings.data(), strings.size());
+  pad(header.vertex_offset);
+  for (auto &d : vertex_data)
+    stream.write((const char *)d.data(), d.size());
+  pad(header.index_offset);
+  for (auto &d : index_data)
+    stream.write((const char *)d.data(), d.size());
+  pad(header.meshlet_offset);
+  for (auto m : meshes)
+    stream.write((const char *)m->meshlets.data(),
+                 sizeof(Meshlet) * m->meshlets.size());
+  pad(header.node_offset);
+  stream.write((const char *)nodes.data(),
+               sizeof(MeshCacheNode) * nodes.size());
+  stream.close();
+  if (!stream.good() || rename(tmp.c_str(), path.c_str()) != 0) {
+    std::cout << "ERROR::MESHCACHE::Failed to write " << path << std::endl;
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+MeshCache::~MeshCache() {
+  if (data)
+    munmap(data, size);
+}
+std::unique_ptr<MeshCache> MeshCache::open(const std::string &path,
+                                           uint64_t hash) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MeshCacheHeader)) {
+    close(fd);
+    return nullptr;
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return nullptr;
+  std::unique_ptr<MeshCache> cache(new MeshCache());
+  cache->data = data;
+  cache->size = st.st_size;
+  auto *h = (const MeshCacheHeader *)data;
+  // 每一段都要落在文件里面
+  uint64_t size = cache->size;
+  if (memcmp(h->magic, "MSHC", 4) != 0 || h->version != MESH_CACHE_VERSION ||
+      h->source_hash != hash || h->vertex_size != sizeof(Vertex) ||
+      !fits(h->record_offset, h->mesh_count, size, sizeof(MeshCacheRecord)) ||
+      !fits(h->texture_offset, h->texture_count, size,
+            sizeof(MeshCacheTexture)) ||
+      !fits(h->string_offset, h->string_bytes, size) ||
+      !fits(h->vertex_offset, h->vertex_bytes, size) ||
+      !fits(h->index_offset, h->index_bytes, size) ||
+      !fits(h->meshlet_offset, h->meshlet_count, size, sizeof(Meshlet)) ||
+      !fits(h->node_offset, h->node_count, size, sizeof(MeshCacheNode)))
+    return nullptr;
+  auto *base = (const char *)data;
+  // 最后一个名字也要有'\0'，否则texture_names会读出字符串段
+  if (h->string_bytes > 0 &&
+      base[h->string_offset + h->string_bytes - 1] != '\0')
+    return nullptr;
+  cache->header = h;
+  cache->records = (const MeshCacheRecord *)(base + h->record_offset);
+  cache->textures = (const MeshCacheTexture *)(base + h->texture_offset);
+  cache->strings = base + h->string_offset;
+  cache->vertices = (const unsigned char *)(base + h->vertex_offset);
+  cache->indices = (const unsigned char *)(base + h->index_offset);
+  cache->meshlets = (const Meshlet *)(base + h->meshlet_offset);
+  cache->nodes = (const MeshCacheNode *)(base + h->node_offset);
+  return cache;
+}
+std::vector<std::string> MeshCache::texture_names(uint32_t mesh,
+                                                  uint32_t type) const {
+  std::vector<std::string> names;
+  auto &r = records[mesh];
+  if (!fits(r.first_texture, r.texture_count, header->texture_count))
+    return names;
+  for (uint32_t i = 0; i < r.texture_count; i++) {
+    auto &t = textures[r.first_texture + i];
+    if (t.type == type && t.name < header->string_bytes)
+      names.push_back(strings + t.name);
+  }
+  return names;
+}
+bool MeshCache::load(uint32_t mesh, MeshData &out) const {
+  if (mesh >= header->mesh_count)
+    return false;
+  auto &r = records[mesh];
+  if (r.vertex_count > header->vertex_count ||
+      r.index_count > header->index_count ||
+      !fits(r.vertex_data, r.vertex_bytes, header->vertex_bytes) ||
+      !fits(r.index_data, r.index_bytes, header->index_bytes) ||
+      !fits(r.first_texture, r.texture_count, header->texture_count) ||
+      !fits(r.first_meshlet, r.meshlet_count, header->meshlet_count) ||
+      r.lod_count > MAX_LODS)
+    return false;
+  // LOD和meshlet引用的index范围也要检查，否则坏的缓存会变成GPU上越界的draw，
+  // 而不是退回重新导入
+  for (uint32_t k = 0; k < r.lod_count; k++)
+    if (!fits(r.lods[k].first_index, r.lods[k].index_count, r.index_count))
+      return false;
+  uint64_t lod0 = r.lod_count ? r.lods[0].index_count : r.index_count;
+  for (uint32_t k = 0; k < r.meshlet_count; k++) {
+    auto &m = meshlets[r.first_meshlet + k];
+    if (!fits(m.first_index, m.index_count, lod0))
+      return false;
+  }
+  out.vertices.resize(r.vertex_count);
+  out.indices.resize(r.index_count);
+  if (!decode_vertices(out.vertices.data(), r.vertex_count, sizeof(Vertex),
+                       vertices + r.vertex_data, r.vertex_bytes) ||
+      !decode_indices(out.indices.data(), r.index_count,
+                      indices + r.index_data, r.index_bytes))
+    return false;
+  for (unsigned int i : out.indices)
+    if (i >= r.vertex_count)
+      return false;
+  out.diffuse = texture_names(mesh, CACHE_DIFFUSE);
+  out.specular = texture_names(mesh, CACHE_SPECULAR);
+  out.normal = texture_names(mesh, CACHE_NORMAL);
+  out.ambient = texture_names(mesh, CACHE_AMBIENT);
+  out.min = glm::vec3(r.min[0], r.min[1], r.min[2]);
+  out.max = glm::vec3(r.max[0], r.max[1], r.max[2]);
+  out.radius = r.radius;
+  out.node = r.node < header->node_count ? r.node : 0;
+  out.lods.assign(r.lods, r.lods + r.lod_count);
+  out.meshlets.assign(meshlets + r.first_meshlet,
+                      meshlets + r.first_meshlet + r.meshlet_count);
+  return true;
+}
+SceneGraph MeshCache::scene_graph() const {
+  SceneGraph graph;
+  for (uint64_t n = 0; n < header->node_count; n++) {
+    glm::mat4 local;
+    memcpy(&local[0].x, nodes[n].local, sizeof(nodes[n].local));
+    if (graph.add(nodes[n].parent, local) == UINT32_MAX)
+      return SceneGraph();
+  }
+  return graph;
+}
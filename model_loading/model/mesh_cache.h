@@ -0,0 +1,116 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mesh_data.h"
+#include "scene_graph.h"
+/**
+ * @brief 二进制mesh缓存
+ * Assimp解析obj需要好几秒，这里把processMesh的最终结果（Vertex、index、材质绑定、
+ * 包围盒）写进一个文件，下次启动直接mmap，解压之后上传，不经过Assimp。
+ * 源文件内容、导入参数或者格式版本变化时hash对不上，缓存自动失效重建。
+ *
+ * 顶点和index用mesh_codec压缩，MeshCache::load在线程池上解压。
+ *
+ * 文件布局，所有段都按16字节对齐：
+ *   MeshCacheHeader
+ *   MeshCacheRecord[mesh_count]
+ *   MeshCacheTexture[texture_count]
+ *   字符串（材质贴图名，'\0'结尾）
+ *   压缩的顶点，每个mesh一段，共vertex_bytes字节
+ *   压缩的index，每个mesh一段，共index_bytes字节
+ *   Meshlet[meshlet_count]
+ *   MeshCacheNode[node_count]
+ */
+// 2: 索引和顶点经过mesh_optimize重排
+// 3: 合并重复顶点、去掉退化三角形，大mesh切成16位index的小块
+// 4: 每个mesh带LOD链，更粗的LOD接在LOD0的index后面
+// 5: LOD0切成meshlet，保存包围球和法线锥
+// 6: 导入时填写骨骼权重，之前的缓存里权重都是0
+// 7: 保存节点层级，每个mesh记录自己所在的节点
+// 8: 顶点和index压缩存放
+// 9: 每个mesh保存包围球半径
+// 10: index按三角形编码
+constexpr uint32_t MESH_CACHE_VERSION = 10;
+struct MeshCacheHeader {
+  char magic[4]; // "MSHC"
+  uint32_t version;
+  uint64_t source_hash;
+  uint32_t vertex_size; // sizeof(Vertex)，结构变了缓存也要失效
+  uint32_t mesh_count;
+  uint32_t texture_count;
+  uint32_t string_bytes;
+  uint64_t vertex_count;
+  uint64_t index_count;
+  uint64_t record_offset, texture_offset, string_offset;
+  uint64_t vertex_offset, index_offset;
+  float min[3], max[3];
+  uint64_t meshlet_count, meshlet_offset;
+  uint64_t node_count, node_offset;
+  uint64_t vertex_bytes, index_bytes; // 压缩之后的大小
+};
+struct MeshCacheRecord {
+  uint64_t vertex_count, index_count;
+  // 压缩数据在顶点段和index段中的范围
+  uint64_t vertex_data, vertex_bytes;
+  uint64_t index_data, index_bytes;
+  uint32_t first_texture, texture_count;
+  float min[3], max[3];
+  float radius; // 包围球以包围盒中心为球心
+  uint32_t lod_count;
+  MeshLod lods[MAX_LODS];
+  uint32_t first_meshlet, meshlet_count;
+  uint32_t node; // 在节点段中的下标
+};
+// 按先序存放，parent总是小于自己的下标
+struct MeshCacheNode {
+  int32_t parent;
+  float local[16]; // 按列存放，和glm::mat4一致
+};
+enum MeshCacheTextureType : uint32_t {
+  CACHE_DIFFUSE,
+  CACHE_SPECULAR,
+  CACHE_NORMAL,
+  CACHE_AMBIENT
+};
+struct MeshCacheTexture {
+  uint32_t type;
+  uint32_t name; // 在字符串段中的偏移
+};
+// 对源文件内容做FNV-1a，同时混入导入参数和版本。obj用mtllib引用的材质文件
+// 内容也算在内
+uint64_t hash_source(const std::string &path, uint64_t salt);
+bool write_mesh_cache(const std::string &path, uint64_t hash,
+                      const std::vector<const MeshData *> &meshes,
+                      const SceneGraph &graph);
+class MeshCache {
+  void *data = nullptr;
+  size_t size = 0;
+  MeshCache() = default;
+
+public:
+  const MeshCacheHeader *header = nullptr;
+  const MeshCacheRecord *records = nullptr;
+  const MeshCacheTexture *textures = nullptr;
+  const char *strings = nullptr;
+  const unsigned char *vertices = nullptr; // 压缩的数据
+  const unsigned char *indices = nullptr;
+  const Meshlet *meshlets = nullptr;
+  const MeshCacheNode *nodes = nullptr;
+  MeshCache(const MeshCache &) = delete;
+  void operator=(const MeshCache &) = delete;
+  ~MeshCache();
+  // hash不匹配或者文件损坏时返回空
+  static std::unique_ptr<MeshCache> open(const std::string &path,
+                                         uint64_t hash);
+  // 某个mesh的贴图名，type为MeshCacheTextureType
+  std::vector<std::string> texture_names(uint32_t mesh, uint32_t type) const;
+  // 解压第mesh个mesh并填上贴图、LOD和meshlet，数据损坏时返回false。
+  // 不同的mesh可以同时在多个线程解压
+  bool load(uint32_t mesh, MeshData &out) const;
+  // 节点段还原成SceneGraph，节点名不保存
+  SceneGraph scene_graph() const;
+};
+#endif
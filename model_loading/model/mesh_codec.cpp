@@ -0,0 +1,372 @@
+#include "mesh_codec.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESH_CODEC_SSE 1
+#endif
+// 每组16个字节的四种存放方式
+static const size_t group_bytes[4] = {0, 4, 8, 16};
+static inline unsigned char zigzag8(unsigned char d) {
+  return (unsigned char)((d << 1) ^ ((signed char)d >> 7));
+}
+void encode_vertices(const void *vertices, size_t count, size_t stride,
+                     std::vector<unsigned char> &out) {
+  auto *src = (const unsigned char *)vertices;
+  std::vector<unsigned char> prev(stride, 0);
+  unsigned char deltas[MESH_CODEC_BLOCK];
+  for (size_t first = 0; first < count; first += MESH_CODEC_BLOCK) {
+    size_t n = std::min(MESH_CODEC_BLOCK, count - first);
+    // 不满16个的部分重复最后一个顶点，差为0
+    size_t padded = (n + 15) & ~(size_t)15, groups = padded / 16;
+    for (size_t k = 0; k < stride; k++) {
+      unsigned char last = prev[k];
+      for (size_t v = 0; v < padded; v++) {
+        unsigned char b = v < n ? src[(first + v) * stride + k] : last;
+        deltas[v] = zigzag8((unsigned char)(b - last));
+        last = b;
+      }
+      prev[k] = last;
+      size_t header = out.size();
+      out.resize(out.size() + (groups + 3) / 4, 0);
+      for (size_t g = 0; g < groups; g++) {
+        const unsigned char *d = deltas + g * 16;
+        unsigned char max = *std::max_element(d, d + 16);
+        unsigned char mode = max == 0 ? 0 : max < 4 ? 1 : max < 16 ? 2 : 3;
+        out[header + g / 4] |= mode << (g % 4 * 2);
+        if (mode == 1) {
+          for (int b = 0; b < 4; b++)
+            out.push_back(d[4 * b] | d[4 * b + 1] << 2 | d[4 * b + 2] << 4 |
+                          d[4 * b + 3] << 6);
+        } else if (mode == 2) {
+          for (int b = 0; b < 8; b++)
+            out.push_back(d[2 * b] | d[2 * b + 1] << 4);
+        } else if (mode == 3) {
+          out.insert(out.end(), d, d + 16);
+        }
+      }
+    }
+  }
+}
+#ifdef MESH_CODEC_SSE
+// 展开一组，反zigzag之后求前缀和，返回最后一个字节
+static inline unsigned char decode_group(const unsigned char *p, int mode,
+                                         unsigned char last,
+                                         unsigned char *out) {
+  __m128i v;
+  if (mode == 0) {
+    v = _mm_setzero_si128();
+  } else if (mode == 1) {
+    int32_t x;
+    memcpy(&x, p, 4);
+    __m128i b = _mm_cvtsi32_si128(x), m = _mm_set1_epi8(3);
+    __m128i p0 = _mm_and_si128(b, m);
+    __m128i p1 = _mm_and_si128(_mm_srli_epi16(b, 2), m);
+    __m128i p2 = _mm_and_si128(_mm_srli_epi16(b, 4), m);
+    __m128i p3 = _mm_and_si128(_mm_srli_epi16(b, 6), m);
+    v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(p0, p1),
+                           _mm_unpacklo_epi8(p2, p3));
+  } else if (mode == 2) {
+    __m128i b = _mm_loadl_epi64((const __m128i *)p), m = _mm_set1_epi8(15);
+    v = _mm_unpacklo_epi8(_mm_and_si128(b, m),
+                          _mm_and_si128(_mm_srli_epi16(b, 4), m));
+  } else {
+    v = _mm_loadu_si128((const __m128i *)p);
+  }
+  // (v >> 1) ^ -(v & 1)
+  __m128i half = _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(0x7f));
+  __m128i sign = _mm_sub_epi8(_mm_setzero_si128(),
+                              _mm_and_si128(v, _mm_set1_epi8(1)));
+  v = _mm_xor_si128(half, sign);
+  v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+  v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+  v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+  v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+  v = _mm_add_epi8(v, _mm_set1_epi8((char)last));
+  _mm_storeu_si128((__m128i *)out, v);
+  return out[15];
+}
+#else
+static inline unsigned char decode_group(const unsigned char *p, int mode,
+                                         unsigned char last,
+                                         unsigned char *out) {
+  for (int i = 0; i < 16; i++) {
+    unsigned char z = mode == 0   ? 0
+                      : mode == 1 ? (p[i / 4] >> (i % 4 * 2)) & 3
+                      : mode == 2 ? (p[i / 2] >> (i % 2 * 4)) & 15
+                                  : p[i];
+    last += (unsigned char)((z >> 1) ^ -(z & 1));
+    out[i] = last;
+  }
+  return last;
+}
+#endif
+// lanes里第k条通道从k * MESH_CODEC_BLOCK开始，写回n个顶点
+static void transpose(const unsigned char *lanes, unsigned char *dst,
+                      size_t n, size_t stride) {
+  size_t v = 0;
+#ifdef MESH_CODEC_SSE
+  // 4条通道的16个字节交错成16个4字节
+  if (stride % 4 == 0) {
+    for (; v + 16 <= n; v += 16) {
+      for (size_t k = 0; k < stride; k += 4) {
+        const unsigned char *l = lanes + k * MESH_CODEC_BLOCK + v;
+        __m128i r0 = _mm_loadu_si128((const __m128i *)l);
+        __m128i r1 = _mm_loadu_si128((const __m128i *)(l + MESH_CODEC_BLOCK));
+        __m128i r2 =
+            _mm_loadu_si128((const __m128i *)(l + 2 * MESH_CODEC_BLOCK));
+        __m128i r3 =
+            _mm_loadu_si128((const __m128i *)(l + 3 * MESH_CODEC_BLOCK));
+        __m128i t0 = _mm_unpacklo_epi8(r0, r1), t1 = _mm_unpackhi_epi8(r0, r1);
+        __m128i t2 = _mm_unpacklo_epi8(r2, r3), t3 = _mm_unpackhi_epi8(r2, r3);
+        alignas(16) uint32_t words[16];
+        _mm_store_si128((__m128i *)words, _mm_unpacklo_epi16(t0, t2));
+        _mm_store_si128((__m128i *)(words + 4), _mm_unpackhi_epi16(t0, t2));
+        _mm_store_si128((__m128i *)(words + 8), _mm_unpacklo_epi16(t1, t3));
+        _mm_store_si128((__m128i *)(words + 12), _mm_unpackhi_epi16(t1, t3));
+        unsigned char *d = dst + v * stride + k;
+        for (int j = 0; j < 16; j++)
+          memcpy(d + j * stride, &words[j], 4);
+      }
+    }
+  }
+#endif
+  for (; v < n; v++)
+    for (size_t k = 0; k < stride; k++)
+      dst[v * stride + k] = lanes[k * MESH_CODEC_BLOCK + v];
+}
+bool decode_vertices(void *out, size_t count, size_t stride,
+                     const unsigned char *data, size_t size) {
+  auto *dst = (unsigned char *)out;
+  const unsigned char *p = data, *end = data + size;
+  std::vector<unsigned char> prev(stride, 0);
+  std::vector<unsigned char> lanes(stride * MESH_CODEC_BLOCK);
+  for (size_t first = 0; first < count; first += MESH_CODEC_BLOCK) {
+    size_t n = std::min(MESH_CODEC_BLOCK, count - first);
+    size_t groups = ((n + 15) & ~(size_t)15) / 16;
+    for (size_t k = 0; k < stride; k++) {
+      const unsigned char *header = p;
+      p += (groups + 3) / 4;
+      if (p > end)
+        return false;
+      unsigned char last = prev[k];
+      unsigned char *lane = lanes.data() + k * MESH_CODEC_BLOCK;
+      for (size_t g = 0; g < groups; g++) {
+        int mode = (header[g / 4] >> (g % 4 * 2)) & 3;
+        // SSE一次读16个字节，剩下不足16字节时退回到安全的拷贝
+        if ((size_t)(end - p) < 16) {
+          if ((size_t)(end - p) < group_bytes[mode])
+            return false;
+          unsigned char tail[16] = {};
+          memcpy(tail, p, group_bytes[mode]);
+          last = decode_group(tail, mode, last, lane + g * 16);
+        } else {
+          last = decode_group(p, mode, last, lane + g * 16);
+        }
+        p += group_bytes[mode];
+      }
+      prev[k] = lane[n - 1];
+    }
+    transpose(lanes.data(), dst + first * stride, n, stride);
+  }
+  return p == end;
+}
+static void put_varint(std::vector<unsigned char> &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back((unsigned char)(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((unsigned char)v);
+}
+static inline bool get_varint(const unsigned char *&p,
+                              const unsigned char *end, uint64_t &v) {
+  v = 0;
+  for (int shift = 0;; shift += 7) {
+    if (p >= end || shift > 35)
+      return false;
+    unsigned char b = *p++;
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+}
+static inline uint32_t zigzag32(uint32_t d) {
+  return (d << 1) ^ (uint32_t)((int32_t)d >> 31);
+}
+static inline uint32_t unzigzag32(uint32_t z) { return (z >> 1) ^ -(z & 1); }
+namespace {
+// 编码和解码共用的状态，两边按同样的顺序更新
+struct IndexState {
+  uint32_t edges[16][2] = {}, vertices[16] = {};
+  uint32_t edge_head = 0, vertex_head = 0, next = 0, last = 0;
+  // 0是最近放进去的
+  const uint32_t *edge(uint32_t i) const {
+    return edges[(edge_head - 1 - i) & 15];
+  }
+  uint32_t vertex(uint32_t i) const {
+    return vertices[(vertex_head - 1 - i) & 15];
+  }
+  void push_edge(uint32_t a, uint32_t b) {
+    edges[edge_head & 15][0] = a;
+    edges[edge_head & 15][1] = b;
+    edge_head++;
+  }
+  void push_vertex(uint32_t v) { vertices[vertex_head++ & 15] = v; }
+  void seen(uint32_t v) { next = std::max(next, v + 1); }
+};
+} // namespace
+// 额外数据里的顶点：0..15是顶点FIFO，否则是和上一个显式index之差的zigzag加16
+static void encode_vertex(IndexState &s, uint32_t v,
+                          std::vector<unsigned char> &data) {
+  for (uint32_t i = 0; i < 16; i++) {
+    if (s.vertex(i) == v) {
+      put_varint(data, i);
+      return;
+    }
+  }
+  put_varint(data, (uint64_t)zigzag32(v - s.last) + 16);
+  s.last = v;
+  s.push_vertex(v);
+}
+void encode_indices(const unsigned int *indices, size_t count,
+                    std::vector<unsigned char> &out) {
+  IndexState s;
+  size_t triangles = count / 3;
+  std::vector<unsigned char> data;
+  size_t codes = out.size();
+  out.resize(codes + triangles);
+  for (size_t t = 0; t < triangles; t++) {
+    const unsigned int *tri = indices + t * 3;
+    // 找一条和前面三角形共享的边，三个顶点轮换之后让共享边在前面
+    uint32_t fe = 16, a = 0, b = 0, c = 0;
+    for (uint32_t i = 0; i < 16 && fe == 16; i++) {
+      const uint32_t *e = s.edge(i);
+      for (int r = 0; r < 3; r++) {
+        if (tri[r] == e[0] && tri[(r + 1) % 3] == e[1]) {
+          fe = i;
+          a = tri[r], b = tri[(r + 1) % 3], c = tri[(r + 2) % 3];
+          break;
+        }
+      }
+    }
+    unsigned char code;
+    if (fe < 15) {
+      // 高4位是边，低4位是第三个顶点：0是下一个新顶点，1..14是顶点FIFO，
+      // 15是显式的差
+      uint32_t fv = 16;
+      for (uint32_t i = 0; i < 14 && fv == 16; i++)
+        if (s.vertex(i) == c)
+          fv = i;
+      if (c == s.next) {
+        code = (unsigned char)(fe << 4);
+        s.push_vertex(c);
+      } else if (fv < 14) {
+        code = (unsigned char)(fe << 4 | (fv + 1));
+      } else {
+        code = (unsigned char)(fe << 4 | 15);
+        put_varint(data, zigzag32(c - s.last));
+        s.last = c;
+        s.push_vertex(c);
+      }
+      s.seen(c);
+      s.push_edge(c, b);
+      s.push_edge(a, c);
+    } else {
+      // 0xF0 | 掩码：第k位为1表示第k个顶点是下一个新顶点，否则在data里
+      a = tri[0], b = tri[1], c = tri[2];
+      code = 0xf0;
+      uint32_t v[3] = {a, b, c};
+      for (int k = 0; k < 3; k++) {
+        if (v[k] == s.next) {
+          code |= 1 << k;
+          s.push_vertex(v[k]);
+        } else {
+          encode_vertex(s, v[k], data);
+        }
+        s.seen(v[k]);
+      }
+      s.push_edge(b, a);
+      s.push_edge(c, b);
+      s.push_edge(a, c);
+    }
+    out[codes + t] = code;
+  }
+  // 不成三角形的尾部
+  for (size_t i = triangles * 3; i < count; i++) {
+    encode_vertex(s, indices[i], data);
+    s.seen(indices[i]);
+  }
+  out.insert(out.end(), data.begin(), data.end());
+}
+static inline bool decode_vertex(IndexState &s, const unsigned char *&p,
+                                 const unsigned char *end, uint32_t &v) {
+  uint64_t z;
+  if (!get_varint(p, end, z))
+    return false;
+  if (z < 16) {
+    v = s.vertex((uint32_t)z);
+  } else {
+    v = s.last + unzigzag32((uint32_t)(z - 16));
+    s.last = v;
+    s.push_vertex(v);
+  }
+  return true;
+}
+bool decode_indices(unsigned int *out, size_t count, const unsigned char *data,
+                    size_t size) {
+  IndexState s;
+  size_t triangles = count / 3;
+  if (size < triangles)
+    return false;
+  const unsigned char *p = data + triangles, *end = data + size;
+  for (size_t t = 0; t < triangles; t++) {
+    unsigned char code = data[t];
+    uint32_t fe = code >> 4, fv = code & 15, a, b, c;
+    if (fe < 15) {
+      const uint32_t *e = s.edge(fe);
+      a = e[0], b = e[1];
+      if (fv == 0) {
+        c = s.next;
+        s.push_vertex(c);
+      } else if (fv < 15) {
+        c = s.vertex(fv - 1);
+      } else {
+        uint64_t z;
+        if (!get_varint(p, end, z))
+          return false;
+        c = s.last + unzigzag32((uint32_t)z);
+        s.last = c;
+        s.push_vertex(c);
+      }
+      s.seen(c);
+      s.push_edge(c, b);
+      s.push_edge(a, c);
+    } else {
+      uint32_t v[3];
+      for (int k = 0; k < 3; k++) {
+        if (fv & (1 << k)) {
+          v[k] = s.next;
+          s.push_vertex(v[k]);
+        } else if (!decode_vertex(s, p, end, v[k])) {
+          return false;
+        }
+        s.seen(v[k]);
+      }
+      a = v[0], b = v[1], c = v[2];
+      s.push_edge(b, a);
+      s.push_edge(c, b);
+      s.push_edge(a, c);
+    }
+    out[t * 3] = a;
+    out[t * 3 + 1] = b;
+    out[t * 3 + 2] = c;
+  }
+  for (size_t i = triangles * 3; i < count; i++) {
+    uint32_t v;
+    if (!decode_vertex(s, p, end, v))
+      return false;
+    s.seen(v);
+    out[i] = v;
+  }
+  return p == end;
+}
@@ -0,0 +1,34 @@
+#ifndef MESH_CODEC_H
+#define MESH_CODEC_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+/**
+ * @brief mesh缓存使用的无损压缩
+ * 顶点：每MESH_CODEC_BLOCK个顶点一块，块内按字节拆成stride条通道，每条通道是
+ * 相邻顶点同一个字节的差，zigzag之后每16个一组，按组内最大值选0/2/4/8位存放，
+ * 每组2位的模式放在通道开头。经过mesh_optimize的顶点按引用顺序排列，相邻顶点
+ * 的高位字节（符号、指数）基本相同，静态mesh的切线和骨骼字段全是0，整组只占
+ * 2位。解码时一组16个字节用SSE2展开、前缀和，再4条通道一起转置回顶点。
+ *
+ * index：按三角形编码，每个三角形一个字节的code放在前面，少数需要额外数据的
+ * 顶点用变长整数接在所有code后面。编码和解码都维护最近16条边和16个顶点的FIFO：
+ *   高4位0..14：和FIFO里的一条边共享一条边，低4位是第三个顶点，0是下一个新
+ *     顶点，1..14是顶点FIFO，15是和上一个显式index之差
+ *   高4位15：没有共享边，低3位标出哪些顶点是下一个新顶点，其余的在额外数据里
+ * 经过mesh_optimize的三角形大部分和前一两个三角形共享边、再带一个新顶点，
+ * 平均每个index半个字节左右。共享边放在前面，三角形内的顶点可能被轮换，
+ * 绕序不变。不成三角形的尾部逐个按额外数据存放。
+ */
+constexpr size_t MESH_CODEC_BLOCK = 256;
+// 把count个stride字节的顶点追加到out
+void encode_vertices(const void *vertices, size_t count, size_t stride,
+                     std::vector<unsigned char> &out);
+// 数据不完整时返回false
+bool decode_vertices(void *out, size_t count, size_t stride,
+                     const unsigned char *data, size_t size);
+void encode_indices(const unsigned int *indices, size_t count,
+                    std::vector<unsigned char> &out);
+bool decode_indices(unsigned int *out, size_t count, const unsigned char *data,
+                    size_t size);
+#endif
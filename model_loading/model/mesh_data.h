@@ -0,0 +1,73 @@
+#ifndef MESH_DATA_H
+#define MESH_DATA_H
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#define MAX_BONE_INFLUENCE 4
+#define MAX_LODS 5
+struct Vertex {
+  glm::vec3 Position;
+  glm::vec3 Normal;
+  glm::vec2 TexCoords;
+  glm::vec3 Tangent;
+  // bitangent
+  glm::vec3 Bitangent;
+  // bone indexes which will influence this vertex
+  int m_BoneIDs[MAX_BONE_INFLUENCE];
+  // weights from each bone
+  float m_Weights[MAX_BONE_INFLUENCE];
+};
+// 一级LOD在index中的范围，所有LOD共用同一份顶点
+struct MeshLod {
+  uint32_t first_index;
+  uint32_t index_count;
+  float error; // 物体空间的几何误差
+};
+// LOD0中连续的一段index，带包围球和法线锥，见meshlet.h
+struct Meshlet {
+  uint32_t first_index;
+  uint32_t index_count;
+  glm::vec3 center;
+  float radius;
+  glm::vec3 cone_axis;
+  float cone_cutoff;
+};
+/*
+  CPU端的mesh，导入和缓存都产出这个，之后再交给Mesh上传到显存
+  indices里依次是LOD0和更粗的各级，lods为空时只有LOD0
+*/
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  std::vector<MeshLod> lods;
+  std::vector<Meshlet> meshlets;
+  std::vector<std::string> diffuse;
+  std::vector<std::string> specular;
+  std::vector<std::string> normal;
+  std::vector<std::string> ambient;
+  glm::vec3 min = glm::vec3(0.0f);
+  glm::vec3 max = glm::vec3(0.0f);
+  // 以包围盒中心为球心的包围球，比包围盒的半对角线紧
+  float radius = 0.0f;
+  uint32_t node = 0; // 所在的节点，顶点在这个节点的局部空间
+  void bounds() {
+    if (vertices.empty())
+      return;
+    min = max = vertices[0].Position;
+    for (auto &v : vertices) {
+      min = glm::min(min, v.Position);
+      max = glm::max(max, v.Position);
+    }
+    glm::vec3 center = (min + max) * 0.5f;
+    float r2 = 0.0f;
+    for (auto &v : vertices) {
+      glm::vec3 d = v.Position - center;
+      r2 = std::max(r2, glm::dot(d, d));
+    }
+    radius = std::sqrt(r2);
+  }
+};
+#endif
@@ -0,0 +1,372 @@
+#include "mesh_optimize.h"
+#include <algorithm>
+#include <cstring>
+VertexCacheStats analyze_vertex_cache(const unsigned int *indices,
+                                      size_t index_count, size_t vertex_count,
+                                      unsigned int cache_size) {
+  VertexCacheStats stats;
+  stats.triangles = index_count / 3;
+  // 记录进入缓存的时间，FIFO里只要时间差不超过缓存大小就还在
+  std::vector<uint32_t> cache_time(vertex_count, 0);
+  std::vector<char> used(vertex_count, 0);
+  uint32_t time = cache_size + 1;
+  for (size_t i = 0; i < index_count; i++) {
+    unsigned int v = indices[i];
+    if (time - cache_time[v] > cache_size) {
+      cache_time[v] = time++;
+      stats.misses++;
+    }
+    if (!used[v]) {
+      used[v] = 1;
+      stats.vertices++;
+    }
+  }
+  return stats;
+}
+void optimize_vertex_cache(unsigned int *indices, size_t index_count,
+                           size_t vertex_count, unsigned int cache_size,
+                           std::vector<uint32_t> *clusters) {
+  size_t triangle_count = index_count / 3;
+  if (triangle_count == 0)
+    return;
+  // 每个顶点相邻的三角形，live是还没有输出的相邻三角形数
+  std::vector<uint32_t> live(vertex_count, 0), offsets(vertex_count + 1, 0);
+  for (size_t i = 0; i < index_count; i++)
+    live[indices[i]]++;
+  for (size_t v = 0; v < vertex_count; v++)
+    offsets[v + 1] = offsets[v] + live[v];
+  std::vector<uint32_t> adjacency(index_count), fill(offsets.begin(),
+                                                     offsets.end() - 1);
+  for (size_t i = 0; i < index_count; i++)
+    adjacency[fill[indices[i]]++] = i / 3;
+  std::vector<uint32_t> cache_time(vertex_count, 0);
+  std::vector<char> emitted(triangle_count, 0);
+  std::vector<uint32_t> dead_end, candidates, order;
+  dead_end.reserve(index_count);
+  order.reserve(triangle_count);
+  uint32_t time = cache_size + 1;
+  size_t cursor = 0;
+  // 先从最近输出过的顶点里找，找不到再按输入顺序往后找
+  auto skip_dead_end = [&]() -> int64_t {
+    while (!dead_end.empty()) {
+      uint32_t d = dead_end.back();
+      dead_end.pop_back();
+      if (live[d] > 0)
+        return d;
+    }
+    for (; cursor < vertex_count; cursor++) {
+      if (live[cursor] > 0)
+        return cursor;
+    }
+    return -1;
+  };
+  if (clusters)
+    clusters->assign(1, 0);
+  int64_t fan = skip_dead_end();
+  while (fan >= 0) {
+    candidates.clear();
+    for (uint32_t k = offsets[fan]; k < offsets[fan + 1]; k++) {
+      uint32_t t = adjacency[k];
+      if (emitted[t])
+        continue;
+      for (int j = 0; j < 3; j++) {
+        uint32_t v = indices[t * 3 + j];
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cache_time[v] > cache_size)
+          cache_time[v] = time++;
+      }
+      emitted[t] = 1;
+      order.push_back(t);
+    }
+    // 下一个扇心选仍在缓存中、并且把剩下的三角形输出完也不会被挤出去的顶点
+    int64_t next = -1;
+    int64_t best = -1;
+    for (uint32_t v : candidates) {
+      if (live[v] == 0)
+        continue;
+      int64_t priority = 0;
+      if (time - cache_time[v] + 2 * live[v] <= cache_size)
+        priority = time - cache_time[v];
+      if (priority > best) {
+        best = priority;
+        next = v;
+      }
+    }
+    if (next == -1) {
+      next = skip_dead_end();
+      if (clusters && next >= 0 && order.size() < triangle_count)
+        clusters->push_back(order.size());
+    }
+    fan = next;
+  }
+  std::vector<unsigned int> out(triangle_count * 3);
+  for (size_t i = 0; i < order.size(); i++)
+    std::copy_n(indices + order[i] * 3, 3, out.data() + i * 3);
+  std::copy(out.begin(), out.end(), indices);
+}
+void optimize_overdraw(unsigned int *indices, size_t index_count,
+                       const Vertex *vertices, size_t vertex_count,
+                       const std::vector<uint32_t> &clusters, float threshold,
+                       unsigned int cache_size) {
+  size_t triangle_count = index_count / 3;
+  if (triangle_count == 0)
+    return;
+  std::vector<uint32_t> cache_time(vertex_count, 0);
+  uint32_t time = cache_size + 1;
+  auto misses = [&](size_t t) {
+    int count = 0;
+    for (int j = 0; j < 3; j++) {
+      unsigned int v = indices[t * 3 + j];
+      if (time - cache_time[v] > cache_size) {
+        cache_time[v] = time++;
+        count++;
+      }
+    }
+    return count;
+  };
+  // 时间整体推进一个缓存大小，相当于清空缓存
+  auto flush = [&]() { time += cache_size + 1; };
+  // 硬边界之间切出软边界：局部ACMR已经接近整个簇的ACMR时，在这里断开代价很小
+  std::vector<uint32_t> soft;
+  for (size_t c = 0; c < clusters.size(); c++) {
+    size_t start = clusters[c];
+    size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+    flush();
+    size_t total = 0;
+    for (size_t t = start; t < end; t++)
+      total += misses(t);
+    double target = (double)total / (end - start) * threshold;
+    flush();
+    soft.push_back(start);
+    size_t sub_start = start, sub_misses = 0;
+    for (size_t t = start; t < end; t++) {
+      sub_misses += misses(t);
+      if (t + 1 < end && sub_misses <= (t - sub_start + 1) * target) {
+        soft.push_back(t + 1);
+        sub_start = t + 1;
+        sub_misses = 0;
+        flush();
+      }
+    }
+  }
+  // 簇的面积加权中心离模型中心越远、法线越朝外，越可能挡住别的簇，先画
+  struct Cluster {
+    size_t start, end;
+    float sort;
+  };
+  std::vector<Cluster> list;
+  glm::vec3 center(0.0f);
+  float area = 0.0f;
+  std::vector<glm::vec3> centroid(soft.size(), glm::vec3(0.0f));
+  std::vector<glm::vec3> normal(soft.size(), glm::vec3(0.0f));
+  std::vector<float> areas(soft.size(), 0.0f);
+  for (size_t c = 0; c < soft.size(); c++) {
+    size_t end = c + 1 < soft.size() ? soft[c + 1] : triangle_count;
+    for (size_t t = soft[c]; t < end; t++) {
+      glm::vec3 a = vertices[indices[t * 3 + 0]].Position;
+      glm::vec3 b = vertices[indices[t * 3 + 1]].Position;
+      glm::vec3 d = vertices[indices[t * 3 + 2]].Position;
+      glm::vec3 n = glm::cross(b - a, d - a);
+      float w = glm::length(n);
+      centroid[c] += (a + b + d) * (w / 3.0f);
+      normal[c] += n;
+      areas[c] += w;
+    }
+    center += centroid[c];
+    area += areas[c];
+    list.push_back({soft[c], end, 0.0f});
+  }
+  if (area > 0.0f)
+    center /= area;
+  for (size_t c = 0; c < list.size(); c++) {
+    float len = glm::length(normal[c]);
+    if (areas[c] > 0.0f && len > 0.0f)
+      list[c].sort =
+          glm::dot(centroid[c] / areas[c] - center, normal[c] / len);
+  }
+  std::stable_sort(list.begin(), list.end(),
+                   [](const Cluster &a, const Cluster &b) {
+                     return a.sort > b.sort;
+                   });
+  std::vector<unsigned int> out;
+  out.reserve(triangle_count * 3);
+  for (auto &c : list)
+    out.insert(out.end(), indices + c.start * 3, indices + c.end * 3);
+  std::copy(out.begin(), out.end(), indices);
+}
+void optimize_vertex_fetch(std::vector<Vertex> &vertices,
+                           std::vector<unsigned int> &indices) {
+  std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+  uint32_t next = 0;
+  for (auto &i : indices) {
+    if (remap[i] == UINT32_MAX)
+      remap[i] = next++;
+    i = remap[i];
+  }
+  std::vector<Vertex> out(next);
+  for (size_t v = 0; v < vertices.size(); v++) {
+    if (remap[v] != UINT32_MAX)
+      out[remap[v]] = vertices[v];
+  }
+  vertices.swap(out);
+}
+static uint64_t hash_vertex(const Vertex &v) {
+  uint32_t words[sizeof(Vertex) / sizeof(uint32_t)];
+  memcpy(words, &v, sizeof(words));
+  uint64_t hash = 0x9e3779b97f4a7c15ull;
+  for (uint32_t w : words) {
+    hash = (hash ^ w) * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+size_t weld_vertices(const Vertex *vertices, size_t vertex_count,
+                     const unsigned int *indices, size_t index_count,
+                     MeshData &out) {
+  static_assert(sizeof(Vertex) % sizeof(uint32_t) == 0);
+  // 临时表每个工作线程一份，导入很多mesh时不用反复分配
+  thread_local std::vector<uint32_t> table, remap, first;
+  // 开放寻址，表里存的是保留下来的顶点在新数组中的下标
+  size_t capacity = 1;
+  while (capacity < vertex_count * 2)
+    capacity <<= 1;
+  table.assign(capacity, UINT32_MAX);
+  remap.resize(vertex_count);
+  first.clear();
+  for (size_t i = 0; i < vertex_count; i++) {
+    size_t slot = hash_vertex(vertices[i]) & (capacity - 1);
+    while (table[slot] != UINT32_MAX &&
+           memcmp(&vertices[first[table[slot]]], &vertices[i],
+                  sizeof(Vertex)) != 0)
+      slot = (slot + 1) & (capacity - 1);
+    if (table[slot] == UINT32_MAX) {
+      table[slot] = first.size();
+      first.push_back(i);
+    }
+    remap[i] = table[slot];
+  }
+  // 数量确定之后再分配，结果只分配一次
+  std::vector<Vertex> unique(first.size());
+  for (size_t i = 0; i < first.size(); i++)
+    unique[i] = vertices[first[i]];
+  std::vector<unsigned int> remapped(index_count);
+  for (size_t i = 0; i < index_count; i++)
+    remapped[i] = remap[indices[i]];
+  out.vertices.swap(unique);
+  out.indices.swap(remapped);
+  return vertex_count - first.size();
+}
+size_t weld_vertices(MeshData &data) {
+  std::vector<Vertex> vertices = std::move(data.vertices);
+  std::vector<unsigned int> indices = std::move(data.indices);
+  return weld_vertices(vertices.data(), vertices.size(), indices.data(),
+                       indices.size(), data);
+}
+size_t remove_degenerate_triangles(MeshData &data) {
+  auto &indices = data.indices;
+  auto &vertices = data.vertices;
+  size_t kept = 0;
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    unsigned int a = indices[t], b = indices[t + 1], c = indices[t + 2];
+    glm::vec3 pa = vertices[a].Position, pb = vertices[b].Position,
+              pc = vertices[c].Position;
+    if (a == b || b == c || a == c || pa == pb || pb == pc || pa == pc)
+      continue;
+    indices[kept++] = a;
+    indices[kept++] = b;
+    indices[kept++] = c;
+  }
+  size_t removed = (indices.size() - kept) / 3;
+  indices.resize(kept);
+  return removed;
+}
+std::vector<MeshData> split_for_16bit_indices(const MeshData &data) {
+  const size_t limit = 65536;
+  std::vector<MeshData> parts;
+  if (data.vertices.size() <= limit || data.indices.size() % 3 != 0)
+    return parts;
+  // 按当前的三角形顺序（已经优化过局部性）贪心装满每一块
+  std::vector<uint32_t> local(data.vertices.size(), UINT32_MAX);
+  std::vector<uint32_t> owner(data.vertices.size(), UINT32_MAX);
+  auto begin = [&]() {
+    parts.emplace_back();
+    parts.back().diffuse = data.diffuse;
+    parts.back().specular = data.specular;
+    parts.back().normal = data.normal;
+    parts.back().ambient = data.ambient;
+    parts.back().node = data.node;
+  };
+  begin();
+  for (size_t t = 0; t < data.indices.size(); t += 3) {
+    uint32_t part = parts.size() - 1;
+    size_t fresh = 0;
+    for (int j = 0; j < 3; j++)
+      fresh += owner[data.indices[t + j]] != part;
+    if (parts.back().vertices.size() + fresh > limit) {
+      begin();
+      part++;
+    }
+    MeshData &p = parts.back();
+    for (int j = 0; j < 3; j++) {
+      unsigned int v = data.indices[t + j];
+      if (owner[v] != part) {
+        owner[v] = part;
+        local[v] = p.vertices.size();
+        p.vertices.push_back(data.vertices[v]);
+      }
+      p.indices.push_back(local[v]);
+    }
+  }
+  size_t total = 0;
+  for (auto &p : parts)
+    total += p.vertices.size();
+  size_t saved = data.indices.size() * (sizeof(unsigned int) - sizeof(uint16_t));
+  size_t cost = (total - data.vertices.size()) * sizeof(Vertex);
+  if (cost >= saved) {
+    parts.clear();
+    return parts;
+  }
+  for (auto &p : parts)
+    p.bounds();
+  return parts;
+}
+// 合并重复顶点之后的部分
+static void optimize_welded(MeshData &data, MeshOptimizeReport &report) {
+  auto &v = data.vertices;
+  auto &i = data.indices;
+  // 线和点图元只做合并
+  if (i.size() % 3 != 0 || i.empty()) {
+    report.after = analyze_vertex_cache(i.data(), i.size(), v.size());
+    data.bounds();
+    return;
+  }
+  report.degenerate = remove_degenerate_triangles(data);
+  std::vector<uint32_t> clusters;
+  optimize_vertex_cache(i.data(), i.size(), v.size(), VERTEX_CACHE_SIZE,
+                        &clusters);
+  optimize_overdraw(i.data(), i.size(), v.data(), v.size(), clusters);
+  optimize_vertex_fetch(v, i);
+  data.bounds();
+  report.after = analyze_vertex_cache(i.data(), i.size(), v.size());
+}
+MeshOptimizeReport optimize_mesh(MeshData &data) {
+  MeshOptimizeReport report;
+  auto &v = data.vertices;
+  auto &i = data.indices;
+  report.before = analyze_vertex_cache(i.data(), i.size(), v.size());
+  report.welded = weld_vertices(data);
+  optimize_welded(data, report);
+  return report;
+}
+MeshOptimizeReport optimize_mesh(const Vertex *vertices, size_t vertex_count,
+                                 const unsigned int *indices,
+                                 size_t index_count, MeshData &data) {
+  MeshOptimizeReport report;
+  report.before = analyze_vertex_cache(indices, index_count, vertex_count);
+  report.welded =
+      weld_vertices(vertices, vertex_count, indices, index_count, data);
+  optimize_welded(data, report);
+  return report;
+}
@@ -0,0 +1,71 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "mesh_data.h"
+/**
+ * @brief 导入后的索引和顶点顺序优化，只在建立mesh缓存时运行一次
+ *   0. 按顶点内容hash合并重复顶点，去掉退化三角形
+ *   1. Tipsify（Sander 2007）重排三角形，提高post-transform顶点缓存命中
+ *   2. 在Tipsify的簇边界上再按ACMR切出软边界，簇按朝外程度排序，先画外层减少overdraw
+ *   3. 按index第一次引用的顺序重排顶点，顶点读取变成基本顺序访问
+ * ACMR是每个三角形的缓存未命中数，ATVR是未命中数除以顶点数（理想值为1）。
+ */
+constexpr unsigned int VERTEX_CACHE_SIZE = 16;
+struct VertexCacheStats {
+  size_t triangles = 0, vertices = 0, misses = 0;
+  double acmr() const { return triangles ? (double)misses / triangles : 0.0; }
+  double atvr() const { return vertices ? (double)misses / vertices : 0.0; }
+  void operator+=(const VertexCacheStats &o) {
+    triangles += o.triangles;
+    vertices += o.vertices;
+    misses += o.misses;
+  }
+};
+struct MeshOptimizeReport {
+  VertexCacheStats before, after;
+  size_t welded = 0, degenerate = 0;
+  void operator+=(const MeshOptimizeReport &o) {
+    before += o.before;
+    after += o.after;
+    welded += o.welded;
+    degenerate += o.degenerate;
+  }
+};
+// 内容完全相同的顶点合并成一个，返回去掉的顶点数
+size_t weld_vertices(MeshData &data);
+// 从外部的缓冲读取，结果写进out的vertices和indices
+size_t weld_vertices(const Vertex *vertices, size_t vertex_count,
+                     const unsigned int *indices, size_t index_count,
+                     MeshData &out);
+// 去掉index重复或者有两个顶点位置重合的三角形，返回去掉的三角形数
+size_t remove_degenerate_triangles(MeshData &data);
+// 超过65536个顶点的mesh按三角形顺序切成几块，每块都能用16位index。
+// 只有省下的index字节多于块之间重复的顶点字节时才切，不切时返回空
+std::vector<MeshData> split_for_16bit_indices(const MeshData &data);
+// 模拟FIFO的post-transform缓存
+VertexCacheStats analyze_vertex_cache(const unsigned int *indices,
+                                      size_t index_count, size_t vertex_count,
+                                      unsigned int cache_size = VERTEX_CACHE_SIZE);
+// clusters不为空时输出硬边界（以三角形为单位的起点）
+void optimize_vertex_cache(unsigned int *indices, size_t index_count,
+                           size_t vertex_count,
+                           unsigned int cache_size = VERTEX_CACHE_SIZE,
+                           std::vector<uint32_t> *clusters = nullptr);
+// threshold是允许ACMR变差的比例
+void optimize_overdraw(unsigned int *indices, size_t index_count,
+                       const Vertex *vertices, size_t vertex_count,
+                       const std::vector<uint32_t> &clusters,
+                       float threshold = 1.05f,
+                       unsigned int cache_size = VERTEX_CACHE_SIZE);
+// 没有被引用的顶点会被去掉
+void optimize_vertex_fetch(std::vector<Vertex> &vertices,
+                           std::vector<unsigned int> &indices);
+// 依次执行上面三步
+MeshOptimizeReport optimize_mesh(MeshData &data);
+// 同上，顶点和index从ImportArena之类的外部缓冲读取，合并之后写进data
+MeshOptimizeReport optimize_mesh(const Vertex *vertices, size_t vertex_count,
+                                 const unsigned int *indices,
+                                 size_t index_count, MeshData &data);
+#endif
@@ -0,0 +1,257 @@
+#include "mesh_simplify.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "mesh_optimize.h"
+// 对称4x4矩阵，只存上三角
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0 = 0, b1 = 0, b2 = 0, c = 0;
+  // 平面 n·p + d = 0
+  void add_plane(glm::vec3 n, double d) {
+    a00 += n.x * n.x;
+    a01 += n.x * n.y;
+    a02 += n.x * n.z;
+    a11 += n.y * n.y;
+    a12 += n.y * n.z;
+    a22 += n.z * n.z;
+    b0 += n.x * d;
+    b1 += n.y * d;
+    b2 += n.z * d;
+    c += d * d;
+  }
+  void operator+=(const Quadric &o) {
+    a00 += o.a00;
+    a01 += o.a01;
+    a02 += o.a02;
+    a11 += o.a11;
+    a12 += o.a12;
+    a22 += o.a22;
+    b0 += o.b0;
+    b1 += o.b1;
+    b2 += o.b2;
+    c += o.c;
+  }
+  double error(glm::vec3 p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e = a00 * x * x + a11 * y * y + a22 * z * z +
+               2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+               2 * (b0 * x + b1 * y + b2 * z) + c;
+    return std::max(e, 0.0);
+  }
+};
+// 位置相同的顶点分到一组，返回每个顶点所在组的代表（组内最小的下标）
+static std::vector<uint32_t> position_groups(const Vertex *vertices,
+                                             size_t vertex_count) {
+  std::vector<uint32_t> order(vertex_count), group(vertex_count);
+  std::iota(order.begin(), order.end(), 0);
+  auto less = [&](uint32_t a, uint32_t b) {
+    const glm::vec3 &p = vertices[a].Position, &q = vertices[b].Position;
+    if (p.x != q.x)
+      return p.x < q.x;
+    if (p.y != q.y)
+      return p.y < q.y;
+    if (p.z != q.z)
+      return p.z < q.z;
+    return a < b;
+  };
+  std::sort(order.begin(), order.end(), less);
+  for (size_t i = 0; i < vertex_count;) {
+    size_t j = i;
+    while (j < vertex_count &&
+           vertices[order[j]].Position == vertices[order[i]].Position)
+      j++;
+    for (size_t k = i; k < j; k++)
+      group[order[k]] = order[i];
+    i = j;
+  }
+  return group;
+}
+std::vector<unsigned int> simplify_mesh(const Vertex *vertices,
+                                        size_t vertex_count,
+                                        const unsigned int *indices,
+                                        size_t index_count,
+                                        size_t target_index_count,
+                                        float &error) {
+  error = 0.0f;
+  std::vector<unsigned int> result(indices, indices + index_count);
+  if (index_count % 3 != 0 || vertex_count == 0)
+    return result;
+  std::vector<uint32_t> group = position_groups(vertices, vertex_count);
+  // 接缝：一个位置上有多个顶点
+  std::vector<char> locked(vertex_count, 0);
+  for (size_t v = 0; v < vertex_count; v++) {
+    if (group[v] != v) {
+      locked[v] = 1;
+      locked[group[v]] = 1;
+    }
+  }
+  // 边界和非流形：按位置统计每条边被几个三角形用到，不是2的边两端锁定
+  std::vector<uint64_t> edges;
+  edges.reserve(index_count);
+  for (size_t t = 0; t < index_count; t += 3) {
+    for (int j = 0; j < 3; j++) {
+      uint64_t a = group[indices[t + j]], b = group[indices[t + (j + 1) % 3]];
+      edges.push_back(a < b ? a << 32 | b : b << 32 | a);
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  std::vector<char> open_group(vertex_count, 0);
+  for (size_t i = 0; i < edges.size();) {
+    size_t j = i;
+    while (j < edges.size() && edges[j] == edges[i])
+      j++;
+    if (j - i != 2)
+      open_group[edges[i] >> 32] = open_group[edges[i] & 0xffffffffu] = 1;
+    i = j;
+  }
+  for (size_t v = 0; v < vertex_count; v++) {
+    if (open_group[group[v]])
+      locked[v] = 1;
+  }
+  std::vector<Quadric> quadrics(vertex_count);
+  for (size_t t = 0; t < index_count; t += 3) {
+    glm::vec3 p0 = vertices[indices[t]].Position;
+    glm::vec3 p1 = vertices[indices[t + 1]].Position;
+    glm::vec3 p2 = vertices[indices[t + 2]].Position;
+    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+    float len = glm::length(n);
+    if (len == 0.0f)
+      continue;
+    n = n / len;
+    for (int j = 0; j < 3; j++)
+      quadrics[group[indices[t + j]]].add_plane(n, -glm::dot(n, p0));
+  }
+  double max_error = 0.0;
+  std::vector<uint32_t> offsets(vertex_count + 1), adjacency;
+  std::vector<uint32_t> remap(vertex_count);
+  std::vector<char> dirty(vertex_count);
+  std::vector<uint32_t> best_target(vertex_count);
+  std::vector<double> best_cost(vertex_count);
+  std::vector<uint32_t> candidates;
+  while (result.size() > target_index_count) {
+    // 顶点到三角形的邻接
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (auto i : result)
+      offsets[i + 1]++;
+    for (size_t v = 0; v < vertex_count; v++)
+      offsets[v + 1] += offsets[v];
+    adjacency.resize(result.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < result.size(); i++)
+      adjacency[fill[result[i]]++] = i / 3;
+    // 每个可以移动的顶点找代价最小的相邻顶点
+    std::fill(best_target.begin(), best_target.end(), UINT32_MAX);
+    for (size_t t = 0; t < result.size(); t += 3) {
+      for (int j = 0; j < 3; j++) {
+        for (int k = 1; k < 3; k++) {
+          uint32_t v = result[t + j], u = result[t + (j + k) % 3];
+          if (locked[v])
+            continue;
+          glm::vec3 nv = vertices[v].Normal, nu = vertices[u].Normal;
+          if (glm::dot(nv, nv) > 0.0f && glm::dot(nu, nu) > 0.0f &&
+              glm::dot(glm::normalize(nv), glm::normalize(nu)) < 0.5f)
+            continue;
+          double cost = quadrics[v].error(vertices[u].Position);
+          if (best_target[v] == UINT32_MAX || cost < best_cost[v]) {
+            best_target[v] = u;
+            best_cost[v] = cost;
+          }
+        }
+      }
+    }
+    candidates.clear();
+    for (size_t v = 0; v < vertex_count; v++) {
+      if (best_target[v] != UINT32_MAX)
+        candidates.push_back(v);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [&](uint32_t a, uint32_t b) {
+                return best_cost[a] < best_cost[b];
+              });
+    // 每个collapse大约去掉两个三角形
+    size_t needed = (result.size() - target_index_count) / 6 + 1;
+    size_t collapsed = 0;
+    std::iota(remap.begin(), remap.end(), 0);
+    std::fill(dirty.begin(), dirty.end(), 0);
+    for (uint32_t v : candidates) {
+      uint32_t u = best_target[v];
+      if (dirty[v] || dirty[u])
+        continue;
+      // 不能让剩下的三角形翻面或者退化
+      bool flip = false;
+      glm::vec3 pu = vertices[u].Position;
+      for (uint32_t k = offsets[v]; k < offsets[v + 1] && !flip; k++) {
+        uint32_t t = adjacency[k] * 3;
+        uint32_t a = result[t], b = result[t + 1], c = result[t + 2];
+        if (a == u || b == u || c == u)
+          continue;
+        glm::vec3 p[3] = {vertices[a].Position, vertices[b].Position,
+                          vertices[c].Position};
+        glm::vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+        int slot = a == v ? 0 : b == v ? 1 : 2;
+        p[slot] = pu;
+        glm::vec3 n1 = glm::cross(p[1] - p[0], p[2] - p[0]);
+        float l0 = glm::length(n0), l1 = glm::length(n1);
+        flip = l1 <= 1e-12f * std::max(l0, 1.0f) ||
+               glm::dot(n0, n1) < 0.25f * l0 * l1;
+      }
+      if (flip)
+        continue;
+      remap[v] = u;
+      quadrics[u] += quadrics[v];
+      max_error = std::max(max_error, best_cost[v]);
+      for (uint32_t w : {v, u}) {
+        for (uint32_t k = offsets[w]; k < offsets[w + 1]; k++) {
+          uint32_t t = adjacency[k] * 3;
+          dirty[result[t]] = dirty[result[t + 1]] = dirty[result[t + 2]] = 1;
+        }
+      }
+      if (++collapsed >= needed)
+        break;
+    }
+    if (collapsed == 0)
+      break;
+    size_t kept = 0;
+    for (size_t t = 0; t < result.size(); t += 3) {
+      uint32_t a = remap[result[t]], b = remap[result[t + 1]],
+               c = remap[result[t + 2]];
+      if (a == b || b == c || a == c)
+        continue;
+      result[kept++] = a;
+      result[kept++] = b;
+      result[kept++] = c;
+    }
+    result.resize(kept);
+  }
+  error = std::sqrt(max_error);
+  return result;
+}
+void build_lod_chain(MeshData &data, size_t max_levels) {
+  data.lods.clear();
+  size_t lod0 = data.indices.size();
+  data.lods.push_back({0, (uint32_t)lod0, 0.0f});
+  if (lod0 % 3 != 0)
+    return;
+  size_t previous = lod0;
+  float previous_error = 0.0f;
+  for (size_t level = 1; level < max_levels; level++) {
+    size_t target = (lod0 >> level) / 3 * 3;
+    // 太小的mesh没有必要再分级
+    if (target < 3 * 32)
+      break;
+    float error;
+    auto lod = simplify_mesh(data.vertices.data(), data.vertices.size(),
+                             data.indices.data(), lod0, target, error);
+    // 简化不动了就停止，不保存几乎一样的LOD
+    if (lod.empty() || lod.size() > previous * 9 / 10)
+      break;
+    optimize_vertex_cache(lod.data(), lod.size(), data.vertices.size());
+    error = std::max(error, previous_error);
+    data.lods.push_back(
+        {(uint32_t)data.indices.size(), (uint32_t)lod.size(), error});
+    data.indices.insert(data.indices.end(), lod.begin(), lod.end());
+    previous = lod.size();
+    previous_error = error;
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+#include <cstddef>
+#include <vector>
+#include "mesh_data.h"
+/**
+ * @brief 二次误差(QEM, Garland-Heckbert)网格简化和LOD链
+ * 做的是half-edge collapse：顶点v合并到相邻顶点u上，u的位置、法线、UV都不变，
+ * 所以所有LOD共用LOD0的顶点，只有index不同。
+ *   - 同一个位置上有多个顶点（UV接缝、法线硬边）的顶点和开放边界上的顶点锁定不动
+ *   - 两端法线夹角超过60度，或者会让三角形翻面的collapse不做
+ * 误差是被接受的collapse中最大二次误差的平方根，单位和模型坐标一致。
+ */
+// target_index_count是目标，做不到时尽量接近；error输出这一级的误差
+std::vector<unsigned int> simplify_mesh(const Vertex *vertices,
+                                        size_t vertex_count,
+                                        const unsigned int *indices,
+                                        size_t index_count,
+                                        size_t target_index_count,
+                                        float &error);
+// 在data.indices后面追加更粗的LOD并填写data.lods，每一级三角形数约为上一级一半
+void build_lod_chain(MeshData &data, size_t max_levels = MAX_LODS);
+#endif
@@ -0,0 +1,122 @@
+#include "meshlet.h"
+#include <algorithm>
+#include <cmath>
+// 法线锥覆盖超过这个范围就不再往里面加三角形，否则锥太宽起不到剔除作用
+static const float MESHLET_CONE_LIMIT = 0.5f;
+static Meshlet meshlet_bounds(const Vertex *vertices,
+                              const unsigned int *indices, uint32_t first,
+                              uint32_t count) {
+  Meshlet m = {};
+  m.first_index = first;
+  m.index_count = count;
+  glm::vec3 lo = vertices[indices[first]].Position, hi = lo;
+  glm::vec3 axis(0.0f);
+  std::vector<glm::vec3> normals;
+  normals.reserve(count / 3);
+  for (uint32_t i = first; i < first + count; i += 3) {
+    glm::vec3 p0 = vertices[indices[i]].Position;
+    glm::vec3 p1 = vertices[indices[i + 1]].Position;
+    glm::vec3 p2 = vertices[indices[i + 2]].Position;
+    for (auto &p : {p0, p1, p2}) {
+      lo = glm::min(lo, p);
+      hi = glm::max(hi, p);
+    }
+    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+    float len = glm::length(n);
+    if (len > 0.0f) {
+      normals.push_back(n / len);
+      axis += n / len;
+    }
+  }
+  m.center = (lo + hi) * 0.5f;
+  for (uint32_t i = first; i < first + count; i++)
+    m.radius = std::max(
+        m.radius, glm::length(vertices[indices[i]].Position - m.center));
+  // 没有可用的法线或者法线分布太散时锥退化，cone_cutoff为1表示永远不做背面剔除
+  float len = glm::length(axis);
+  m.cone_axis = len > 0.0f ? axis / len : glm::vec3(0.0f, 0.0f, 1.0f);
+  m.cone_cutoff = 1.0f;
+  if (len == 0.0f)
+    return m;
+  float min_dot = 1.0f;
+  for (auto &n : normals)
+    min_dot = std::min(min_dot, glm::dot(n, m.cone_axis));
+  // 所有法线和轴的夹角都不超过acos(min_dot)，视线和轴的夹角小于90度减去它时
+  // 每个三角形都背对相机，这里存的是这个角的余弦，也就是sin(acos(min_dot))
+  if (min_dot > 0.1f)
+    m.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+  return m;
+}
+std::vector<Meshlet> build_meshlets(const Vertex *vertices,
+                                    size_t vertex_count,
+                                    const unsigned int *indices,
+                                    size_t index_count) {
+  std::vector<Meshlet> meshlets;
+  if (index_count < 3 || index_count % 3 != 0)
+    return meshlets;
+  // 顶点最后一次被哪个meshlet用到，避免每个簇清空一次集合
+  std::vector<uint32_t> owner(vertex_count, UINT32_MAX);
+  uint32_t id = 0, first = 0, triangles = 0, unique = 0;
+  glm::vec3 normal_sum(0.0f);
+  for (uint32_t t = 0; t < index_count; t += 3) {
+    uint32_t fresh = 0;
+    for (int j = 0; j < 3; j++)
+      fresh += owner[indices[t + j]] != id;
+    glm::vec3 p0 = vertices[indices[t]].Position;
+    glm::vec3 n = glm::cross(vertices[indices[t + 1]].Position - p0,
+                             vertices[indices[t + 2]].Position - p0);
+    float len = glm::length(n), sum = glm::length(normal_sum);
+    n = len > 0.0f ? n / len : n;
+    // 簇已经有四分之一满时，如果新三角形和平均法线差得太远就提前结束
+    bool diverge = triangles >= MESHLET_MAX_TRIANGLES / 4 && sum > 0.0f &&
+                   glm::dot(n, normal_sum / sum) < MESHLET_CONE_LIMIT;
+    if (triangles && (unique + fresh > MESHLET_MAX_VERTICES ||
+                      triangles == MESHLET_MAX_TRIANGLES || diverge)) {
+      meshlets.push_back(meshlet_bounds(vertices, indices, first, t - first));
+      id++;
+      first = t;
+      triangles = unique = 0;
+      normal_sum = glm::vec3(0.0f);
+    }
+    for (int j = 0; j < 3; j++) {
+      if (owner[indices[t + j]] != id) {
+        owner[indices[t + j]] = id;
+        unique++;
+      }
+    }
+    normal_sum += n;
+    triangles++;
+  }
+  meshlets.push_back(
+      meshlet_bounds(vertices, indices, first, index_count - first));
+  return meshlets;
+}
+Frustum extract_frustum(const glm::mat4 &m) {
+  // Gribb-Hartmann，glm是列主序，m[c][r]
+  glm::vec4 row[4];
+  for (int r = 0; r < 4; r++)
+    row[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+  Frustum f;
+  f.planes[0] = row[3] + row[0];
+  f.planes[1] = row[3] - row[0];
+  f.planes[2] = row[3] + row[1];
+  f.planes[3] = row[3] - row[1];
+  f.planes[4] = row[3] + row[2];
+  f.planes[5] = row[3] - row[2];
+  for (auto &p : f.planes) {
+    float len = glm::length(glm::vec3(p));
+    if (len > 0.0f)
+      p = p / len;
+  }
+  return f;
+}
+bool cull_meshlet(const Meshlet &meshlet, const Frustum &frustum,
+                  glm::vec3 camera_pos) {
+  for (auto &p : frustum.planes) {
+    if (glm::dot(glm::vec3(p), meshlet.center) + p.w < -meshlet.radius)
+      return true;
+  }
+  glm::vec3 view = meshlet.center - camera_pos;
+  return glm::dot(view, meshlet.cone_axis) >=
+         meshlet.cone_cutoff * glm::length(view) + meshlet.radius;
+}
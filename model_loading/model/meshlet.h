@@ -0,0 +1,29 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "mesh_data.h"
+/**
+ * @brief meshlet划分和逐簇剔除
+ * 按优化后的三角形顺序贪心地切成不超过64个顶点、124个三角形的小簇，三角形不重排，
+ * 所以每个meshlet就是LOD0里连续的一段index，可以直接作为一条indirect命令。
+ * 每个簇有包围球和法线锥，CPU每帧做视锥和背面剔除，只把剩下的簇交给GPU。
+ * 剔除在物体空间进行，视锥平面从projection * view * model中提取，相机位置用
+ * model的逆矩阵变回去，所以模型变换有缩放时结果也是对的。
+ */
+constexpr size_t MESHLET_MAX_VERTICES = 64;
+constexpr size_t MESHLET_MAX_TRIANGLES = 124;
+// index_count只取LOD0，后面的LOD不切
+std::vector<Meshlet> build_meshlets(const Vertex *vertices,
+                                    size_t vertex_count,
+                                    const unsigned int *indices,
+                                    size_t index_count);
+struct Frustum {
+  glm::vec4 planes[6]; // ax + by + cz + d >= 0在里面，已经归一化
+};
+Frustum extract_frustum(const glm::mat4 &m);
+// 返回true时整个簇不可见，camera_pos和frustum都要和meshlet在同一空间
+bool cull_meshlet(const Meshlet &meshlet, const Frustum &frustum,
+                  glm::vec3 camera_pos);
+#endif
@@ -5,72 +5,498 @@ void checkError(std::string function) {
     std::cerr << function << ": " << err << std::endl;
   }
 }
-void Model::loadModel(std::string path) {
-  Assimp::Importer import;
-  const aiScene *scene =
-      import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+void Model::loadModel(std::string _path, const std::string &profile) {
+  path = _path;
+  directory = path.substr(0, path.find_last_of('/'));
+  stream = std::make_shared<Stream>();
+  stream->profile = import_profile(profile);
+  stream->worker = std::thread(is_gltf(path) ? importGltf : importModel,
+                               stream, path);
+}
+void Model::importModel(std::shared_ptr<Stream> s, std::string path) {
+  // 做完一个就通知主线程，meshes_done为true之后不再有新的mesh
+  auto publish = [&s](size_t i) {
+    std::lock_guard<std::mutex> guard(s->lock);
+    s->ready_meshes.push_back(i);
+    s->signal.notify_all();
+  };
+  auto done = [&s] {
+    std::lock_guard<std::mutex> guard(s->lock);
+    s->meshes_done = true;
+    s->signal.notify_all();
+  };
+  using clock = std::chrono::steady_clock;
+  auto start = clock::now();
+  auto ms = [](clock::time_point from) {
+    return std::chrono::duration<double, std::milli>(clock::now() - from)
+        .count();
+  };
+  // 最终上传的规模，before由各个导入器填写
+  ImportReport report;
+  auto count_after = [&] {
+    for (auto &parts : s->imported) {
+      for (auto &d : parts) {
+        report.vertices_after += d.vertices.size();
+        report.triangles_after +=
+            (d.lods.empty() ? d.indices.size() : d.lods[0].index_count) / 3;
+        report.draws_after++;
+      }
+    }
+  };
+  auto finish_report = [&] {
+    report.total_ms = ms(start);
+    report.print(path, s->profile);
+  };
+  const ImportProfile &profile = s->profile;
+  // 缓存以源文件内容和导入参数作为key，任何一个变了都会重新导入
+  std::string cache_path = path + ".meshcache";
+  uint64_t hash = hash_source(path, profile.salt());
+  if (hash) {
+    auto cache = MeshCache::open(cache_path, hash);
+    // 在线程池上解压并检查，全部有效之后才和导入的结果一样发布上传，
+    // 有一个mesh损坏就放弃缓存重新导入
+    std::vector<MeshData> loaded(cache ? cache->header->mesh_count : 0);
+    SceneGraph cached_graph = cache ? cache->scene_graph() : SceneGraph();
+    std::atomic<bool> corrupt =
+        cache && cached_graph.size() != cache->header->node_count;
+    if (cache && !corrupt)
+      ThreadPool::getInstance().parallel_for(loaded.size(), [&](size_t i) {
+        if (!s->cancel && !corrupt && !cache->load(i, loaded[i]))
+          corrupt = true;
+      });
+    if (cache && corrupt)
+      std::cout << "ERROR::MESHCACHE::Corrupt cache " << cache_path
+                << ", importing again" << std::endl;
+    if (cache && !corrupt) {
+      s->total = loaded.size();
+      {
+        std::lock_guard<std::mutex> guard(s->lock);
+        s->graph = std::move(cached_graph);
+      }
+      s->imported.resize(s->total);
+      for (size_t i = 0; i < loaded.size() && !s->cancel; i++) {
+        s->imported[i].push_back(std::move(loaded[i]));
+        publish(i);
+      }
+      report.cached = true;
+      report.import_ms = ms(start);
+      // 缓存里已经是最终结果，before和after相同
+      count_after();
+      report.vertices_before = report.vertices_after;
+      report.triangles_before = report.triangles_after;
+      report.draws_before = report.draws_after;
+      finish_report();
+      done();
+      return;
+    }
+  }
+  SceneGraph graph;
+  std::vector<MeshOptimizeReport> reports;
+  bool skinned = false;
+  if (is_obj(path) && profile.flags == IMPORT_BASE_FLAGS) {
+    // OBJ由自己的并行解析器读取，之后和Assimp的结果走同样的处理
+    std::vector<MeshData> parsed;
+    if (!load_obj(path, parsed, graph)) {
+      done();
+      return;
+    }
+    report.import_ms = ms(start);
+    for (auto &d : parsed) {
+      report.vertices_before += d.vertices.size();
+      report.triangles_before += d.indices.size() / 3;
+    }
+    report.draws_before = parsed.size();
+    {
+      std::lock_guard<std::mutex> guard(s->lock);
+      s->graph = graph;
+    }
+    s->imported.resize(parsed.size());
+    s->total = parsed.size();
+    reports.resize(parsed.size());
+    ThreadPool::getInstance().parallel_for(parsed.size(), [&](size_t i) {
+      if (s->cancel)
+        return;
+      if (profile.optimize)
+        reports[i] = optimize_mesh(parsed[i]);
+      buildMesh(*s, i, parsed[i], profile.optimize);
+    });
+  } else {
+    Assimp::Importer import;
+    const aiScene *scene = import.ReadFile(path, profile.flags);
+    report.import_ms = ms(start);
 
-  if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
-      !scene->mRootNode) {
-    std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+        !scene->mRootNode) {
+      std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
+      done();
+      return;
+    }
+    std::vector<aiMesh *> list;
+    std::vector<uint32_t> list_node;
+    processNode(scene->mRootNode, scene, list, list_node, graph, -1);
+    for (auto *m : list) {
+      report.vertices_before += m->mNumVertices;
+      report.triangles_before += m->mNumFaces;
+    }
+    report.draws_before = list.size();
+    {
+      std::lock_guard<std::mutex> guard(s->lock);
+      s->graph = graph;
+    }
+    // bone id在转换顶点之前分配好，所有mesh共用一套骨架
+    auto skeleton = std::make_shared<Skeleton>();
+    skinned = build_skeleton(scene, *skeleton);
+    if (skinned) {
+      auto clips = std::make_shared<std::vector<AnimationClip>>(
+          load_animations(scene, *skeleton));
+      printf("%s: %zu nodes, %zu bones, %zu animations\n", path.c_str(),
+             skeleton->node_count(), skeleton->bone_count(), clips->size());
+      std::lock_guard<std::mutex> guard(s->lock);
+      s->skeleton = skeleton;
+      s->clips = std::move(clips);
+    }
+    // imported的大小不再改变，主线程读取已经发布的元素时工作线程只写别的元素
+    s->imported.resize(list.size());
+    s->total = list.size();
+    // 整个场景的顶点和index一次分配，转换时不再为每个mesh分配
+    ImportArena arena(list);
+    reports.resize(list.size());
+    ThreadPool::getInstance().parallel_for(list.size(), [&](size_t i) {
+      if (s->cancel)
+        return;
+      arena.convert(i, list[i], skinned ? skeleton.get() : nullptr);
+      MeshData data;
+      if (profile.optimize) {
+        reports[i] =
+            optimize_mesh(arena.mesh_vertices(i), arena.vertex_count(i),
+                          arena.mesh_indices(i), arena.index_count(i), data);
+      } else {
+        data.vertices.assign(arena.mesh_vertices(i),
+                             arena.mesh_vertices(i) + arena.vertex_count(i));
+        data.indices.assign(arena.mesh_indices(i),
+                            arena.mesh_indices(i) + arena.index_count(i));
+        data.bounds();
+      }
+      processMaterial(list[i], scene, data);
+      data.node = list_node[i];
+      buildMesh(*s, i, data, profile.optimize);
+    });
+  }
+  if (s->cancel) {
+    done();
     return;
   }
-  directory = path.substr(0, path.find_last_of('/'));
-  processNode(scene->mRootNode, scene);
-}
-/*
-  create mesh from aiMesh
-*/
-std::shared_ptr<Mesh> Model::processMesh(aiMesh *mesh, const aiScene *scene) {
-  std::vector<Vertex> vertices;
-  std::vector<unsigned int> indices;
-
-  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-    Vertex vertex;
-    // process vertex positions, normals and texture coordinates
-    vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y,
-                                mesh->mVertices[i].z);
-    vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y,
-                              mesh->mNormals[i].z);
-    // only use the first texcoords, though there's 8
-    vertex.TexCoords = (mesh->HasTextureCoords(0))
-                           ? glm::vec2(mesh->mTextureCoords[0][i].x,
-                                       mesh->mTextureCoords[0][i].y)
-                           : glm::vec2(0.0f);
-    vertices.push_back(vertex);
-  }
-  // process indices
-  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-    aiFace face = mesh->mFaces[i];
-    for (unsigned int j = 0; j < face.mNumIndices; j++)
-      indices.push_back(face.mIndices[j]);
+  MeshOptimizeReport total;
+  for (auto &r : reports)
+    total += r;
+  std::vector<const MeshData *> data;
+  size_t levels = 0, lod0 = 0, coarsest = 0;
+  for (auto &parts : s->imported) {
+    for (auto &d : parts) {
+      data.push_back(&d);
+      levels += d.lods.size();
+      lod0 += d.lods.empty() ? 0 : d.lods.front().index_count / 3;
+      coarsest += d.lods.empty() ? 0 : d.lods.back().index_count / 3;
+    }
+  }
+  if (profile.optimize) {
+    printf("%s: %zu LOD levels, %zu -> %zu triangles at the coarsest level\n",
+           path.c_str(), levels, lod0, coarsest);
+    printf("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, welded %zu vertices, "
+           "removed %zu degenerate triangles, %zu -> %zu meshes\n",
+           path.c_str(), total.before.acmr(), total.after.acmr(),
+           total.before.atvr(), total.after.atvr(), total.welded,
+           total.degenerate, reports.size(), data.size());
+  }
+  count_after();
+  finish_report();
+  // 主线程同时也在读imported，两边都只读。
+  // 缓存还不保存骨架和动画，有骨骼的模型每次都重新导入
+  if (hash && !skinned)
+    write_mesh_cache(cache_path, hash, data, graph);
+  done();
+}
+// 切完再分meshlet和简化，每一块的LOD都能用16位index。meshlet只覆盖LOD0
+void Model::buildMesh(Stream &s, size_t i, MeshData &data, bool optimize) {
+  std::vector<MeshData> parts;
+  if (optimize)
+    parts = split_for_16bit_indices(data);
+  if (parts.empty())
+    parts.push_back(std::move(data));
+  for (auto &d : parts) {
+    if (!optimize)
+      break; // 只有一块，不建meshlet和LOD
+    d.meshlets = build_meshlets(d.vertices.data(), d.vertices.size(),
+                                d.indices.data(), d.indices.size());
+    build_lod_chain(d);
+  }
+  s.imported[i] = std::move(parts);
+  std::lock_guard<std::mutex> guard(s.lock);
+  s.ready_meshes.push_back(i);
+  s.signal.notify_all();
+}
+void Model::importGltf(std::shared_ptr<Stream> s, std::string path) {
+  using clock = std::chrono::steady_clock;
+  auto start = clock::now();
+  std::shared_ptr<const GltfAsset> asset = GltfAsset::open(path);
+  // glTF不经过mesh_optimize，上传的规模和文件里的一样
+  if (asset) {
+    ImportReport report;
+    report.import_ms =
+        std::chrono::duration<double, std::milli>(clock::now() - start)
+            .count();
+    for (auto &p : asset->primitives) {
+      report.vertices_before += p.vertex_count();
+      report.triangles_before += p.index_count() / 3;
+    }
+    report.draws_before = asset->primitives.size();
+    report.vertices_after = report.vertices_before;
+    report.triangles_after = report.triangles_before;
+    report.draws_after = report.draws_before;
+    report.total_ms = report.import_ms;
+    report.print(path, s->profile);
+  }
+  std::lock_guard<std::mutex> guard(s->lock);
+  if (asset) {
+    s->total = asset->primitives.size();
+    s->graph = asset->graph;
+    for (size_t i = 0; i < asset->primitives.size(); i++)
+      s->ready_meshes.push_back(i);
+    s->gltf = std::move(asset);
+  }
+  s->meshes_done = true;
+  s->signal.notify_all();
+}
+// 布局一致时顶点和index从映射的文件直接上传，否则打包一次
+void Model::loadGltfPrimitive(const GltfAsset &asset, size_t i) {
+  auto &p = asset.primitives[i];
+  std::vector<std::string> d, s, n, a;
+  if (p.material >= 0 && (size_t)p.material < asset.materials.size()) {
+    auto &m = asset.materials[p.material];
+    if (m.base_color >= 0)
+      d.push_back(asset.images[m.base_color].name);
+    if (m.normal >= 0)
+      n.push_back(asset.images[m.normal].name);
+  }
+  for (auto &name : d)
+    loadTexture(name, aiTextureType_DIFFUSE);
+  for (auto &name : n)
+    loadTexture(name, aiTextureType_HEIGHT);
+  size_t vertex_count = p.vertex_count(), index_count = p.index_count();
+  std::shared_ptr<Mesh> mesh;
+  if (format == VertexFormat::Full && residency == Residency::Release) {
+    bool index16 = vertex_count <= 65536;
+    std::vector<unsigned char> packed;
+    const void *vertices = gltf_static_vertices(p);
+    if (vertices) {
+      stream->direct_vertices++;
+    } else {
+      packed.resize(GLTF_STATIC_STRIDE * vertex_count);
+      gltf_pack_static(p, packed.data());
+      vertices = packed.data();
+    }
+    std::vector<unsigned int> wide;
+    std::vector<uint16_t> narrow;
+    const void *indices = gltf_direct_indices(p, index16);
+    if (indices) {
+      stream->direct_indices++;
+    } else {
+      wide.resize(index_count);
+      gltf_read_indices(p, wide.data());
+      if (index16)
+        narrow.assign(wide.begin(), wide.end());
+      indices = index16 ? (const void *)narrow.data() : wide.data();
+    }
+    mesh = std::make_shared<Mesh>(ArenaFormat::Static, vertices, vertex_count,
+                                  indices, index_count, index16, d, s, n, a);
+  } else {
+    // 压缩格式和保留CPU数据都需要完整的Vertex
+    std::vector<Vertex> vertices(vertex_count);
+    std::vector<unsigned int> indices(index_count);
+    gltf_read_vertices(p, vertices.data());
+    gltf_read_indices(p, indices.data());
+    mesh = std::make_shared<Mesh>(vertices.data(), vertex_count,
+                                  indices.data(), index_count, d, s, n, a,
+                                  format, residency);
+  }
+  mesh->min = p.min;
+  mesh->max = p.max;
+  mesh->radius = glm::length(p.max - p.min) * 0.5f;
+  mesh->node = p.node;
+  meshes.push_back(mesh);
+}
+// 数据还要写进缓存，这里不能移走，和缓存一样从原地上传
+void Model::loadMeshData(const MeshData &data) {
+  for (auto &name : data.diffuse)
+    loadTexture(name, aiTextureType_DIFFUSE);
+  for (auto &name : data.specular)
+    loadTexture(name, aiTextureType_SPECULAR);
+  for (auto &name : data.normal)
+    loadTexture(name, aiTextureType_HEIGHT);
+  for (auto &name : data.ambient)
+    loadTexture(name, aiTextureType_AMBIENT);
+  auto mesh = std::make_shared<Mesh>(
+      data.vertices.data(), data.vertices.size(), data.indices.data(),
+      data.indices.size(), data.diffuse, data.specular, data.normal,
+      data.ambient, format, residency);
+  mesh->min = data.min;
+  mesh->max = data.max;
+  mesh->radius = data.radius;
+  mesh->node = data.node;
+  mesh->lods = data.lods;
+  mesh->meshlets = data.meshlets;
+  meshes.push_back(mesh);
+}
+void Model::update(size_t budget) {
+  if (!stream)
+    return;
+  std::vector<size_t> ready;
+  std::vector<DecodedTexture> textures;
+  std::shared_ptr<const Skeleton> skeleton;
+  std::shared_ptr<const std::vector<AnimationClip>> clips;
+  bool meshes_done;
+  {
+    std::lock_guard<std::mutex> guard(stream->lock);
+    size_t n = std::min(budget, stream->ready_meshes.size());
+    ready.assign(stream->ready_meshes.begin(),
+                 stream->ready_meshes.begin() + n);
+    stream->ready_meshes.erase(stream->ready_meshes.begin(),
+                               stream->ready_meshes.begin() + n);
+    textures = std::move(stream->ready_textures);
+    stream->ready_textures.clear();
+    meshes_done = stream->meshes_done && stream->ready_meshes.empty();
+    skeleton = stream->skeleton;
+    clips = stream->clips;
+    if (graph.empty() && !stream->graph.empty()) {
+      graph = std::move(stream->graph);
+      objects_dirty = true;
+    }
+  }
+  if (!animator && skeleton) {
+    animator = std::make_shared<Animator>(skeleton, clips);
+    animator->add(0);
+  }
+  for (auto i : ready) {
+    if (stream->gltf)
+      loadGltfPrimitive(*stream->gltf, i);
+    else
+      for (auto &d : stream->imported[i])
+        loadMeshData(d);
+  }
+  stream->uploaded += ready.size();
+  if (!ready.empty())
+    batches_dirty = true;
+  TextureMgr &mgr = TextureMgr::getInstance();
+  stream->textures_pending -= textures.size();
+  for (auto &t : textures) {
+    if (t.vtex) {
+      // 别的模型可能已经载入了同一张
+      if (mgr.has_virtual(t.name))
+        continue;
+      auto vt = mgr.vt_system ? mgr.vt_system->load(t.vtex, t.vtex_top)
+                              : nullptr;
+      if (vt)
+        mgr.set_virtual(t.name, vt);
+      else
+        // 虚拟纹理已满或者page尺寸不一致，退回普通贴图
+        queueTexture(t.name, t.type, false);
+      continue;
+    }
+    auto texture = std::make_shared<Texture>(t.image, t.type);
+    mgr.set(t.name, texture);
+  }
+  // 导入的数据已经全部上传，缓存也已经写完，可以释放了
+  if (meshes_done && stream->worker.joinable()) {
+    stream->worker.join();
+    if (stream->gltf)
+      printf("%s: %zu primitives, %zu vertex and %zu index buffers uploaded "
+             "straight from the file\n",
+             path.c_str(), stream->gltf->primitives.size(),
+             stream->direct_vertices, stream->direct_indices);
+    // 还在解码的内嵌图片自己持有asset
+    stream->gltf.reset();
+    stream->imported.clear();
+    stream->imported.shrink_to_fit();
+  }
+  if (loaded() && !stream->reported) {
+    stream->reported = true;
+    MemoryUsage usage = memory();
+    printf("%s: %zu meshes, GPU %.1f MiB, CPU %.1f MiB\n", path.c_str(),
+           meshes.size(), usage.gpu / 1048576.0, usage.cpu / 1048576.0);
+  }
+}
+void Model::finish() {
+  while (!loaded()) {
+    {
+      std::unique_lock<std::mutex> guard(stream->lock);
+      stream->signal.wait(guard, [&] {
+        return !stream->ready_meshes.empty() ||
+               !stream->ready_textures.empty() ||
+               (stream->meshes_done && stream->textures_pending == 0);
+      });
+    }
+    update(SIZE_MAX);
+  }
+}
+bool Model::loaded() const {
+  return !stream || (!stream->worker.joinable() &&
+                     stream->textures_pending == 0);
+}
+MemoryUsage Model::memory() const {
+  MemoryUsage usage;
+  std::set<std::string> textures;
+  for (auto &m : meshes) {
+    usage += m->memory();
+    m->for_each_texture(
+        [&](const std::string &name) { textures.insert(name); });
+  }
+  TextureMgr &mgr = TextureMgr::getInstance();
+  for (auto &name : textures)
+    usage += mgr.memory(name);
+  usage.gpu += indirect_bytes;
+  if (animator) {
+    usage.gpu += animator->gpu_bytes();
+    usage.cpu += animator->cpu_bytes();
   }
+  usage.cpu += batch_order.capacity() * sizeof(uint32_t) + graph.bytes();
+  for (auto &v : views)
+    usage.cpu += v.lod.capacity() + v.mesh_visible.capacity() +
+                 v.commands.capacity() * sizeof(DrawElementsIndirectCommand);
+  return usage;
+}
+float Model::progress() const {
+  if (loaded())
+    return 1.0f;
+  size_t total = stream->total;
+  return total ? (float)stream->uploaded / total : 0.0f;
+}
+void Model::processMaterial(aiMesh *mesh, const aiScene *scene,
+                            MeshData &data) {
   // process material
   aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
   // name设计没有作用，用这个方法，将会得到同样的名字的一堆texture，只能区分漫反射
   // 我想的是设计不同材质的名称对应的比如glass.diffuse, glass.specular
   // 但是按照这个处理的他的材质是保存在
   // TODO 在此处将texture放入mesh
-  std::vector<std::string> diffuseMaps =
-      loadMaterialTextures(material, aiTextureType_DIFFUSE);
-  std::vector<std::string> specularMaps =
-      loadMaterialTextures(material, aiTextureType_SPECULAR);
-  std::vector<std::string> normalMaps =
-      loadMaterialTextures(material, aiTextureType_HEIGHT);
-  std::vector<std::string> heightMaps =
-      loadMaterialTextures(material, aiTextureType_AMBIENT);
-  return std::make_shared<Mesh>(vertices, indices, diffuseMaps, specularMaps,
-                                normalMaps, heightMaps);
-}
-void Model::processNode(aiNode *node, const aiScene *scene) {
+  data.diffuse = loadMaterialTextures(material, aiTextureType_DIFFUSE);
+  data.specular = loadMaterialTextures(material, aiTextureType_SPECULAR);
+  data.normal = loadMaterialTextures(material, aiTextureType_HEIGHT);
+  data.ambient = loadMaterialTextures(material, aiTextureType_AMBIENT);
+}
+void Model::processNode(aiNode *node, const aiScene *scene,
+                        std::vector<aiMesh *> &list,
+                        std::vector<uint32_t> &list_node, SceneGraph &graph,
+                        int32_t parent) {
+  uint32_t index =
+      graph.add(parent, to_glm(node->mTransformation), node->mName.C_Str());
   // process all the node's meshes (if any)
   for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-    aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-    meshes.push_back(processMesh(mesh, scene));
+    list.push_back(scene->mMeshes[node->mMeshes[i]]);
+    list_node.push_back(index);
   }
   // then do the same for each of its children
   for (unsigned int i = 0; i < node->mNumChildren; i++) {
-    processNode(node->mChildren[i], scene);
+    processNode(node->mChildren[i], scene, list, list_node, graph, index);
   }
 }
 std::vector<std::string> Model::loadMaterialTextures(aiMaterial *mat,
@@ -78,28 +504,627 @@ std::vector<std::string> Model::loadMaterialTextures(aiMaterial *mat,
   std::vector<std::string> textures;
   for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
     aiString str;
-    TextureMgr &mgr = TextureMgr::getInstance();
     mat->GetTexture(type, i, &str); // FIXME str这个路径可能是相对路径
-    if (!mgr.has(str.C_Str())) {
-      std::string filename = directory + "/" + str.C_Str();
-      auto texture = std::make_shared<Texture>(filename.c_str(), type);
-      mgr.set(str.C_Str(), texture);
-    }
     textures.push_back(str.C_Str());
   }
   return textures;
 }
+void Model::loadTexture(const std::string &name, int type) {
+  TextureMgr &mgr = TextureMgr::getInstance();
+  if (mgr.has_virtual(name) || mgr.has(name) ||
+      stream->requested.contains(name))
+    return;
+  // 解码完成之前Mesh::activate使用占位纹理
+  stream->requested.insert(name);
+  // glTF的图片不翻转，也不烘焙虚拟纹理
+  queueTexture(name, type,
+               mgr.vt_system && !stream->gltf &&
+                   type == aiTextureType_DIFFUSE);
+}
+void Model::queueTexture(const std::string &name, int type,
+                         bool virtual_texture) {
+  std::string filename = directory + "/" + name;
+  // 内嵌的图片从映射的内存解码
+  auto gltf = stream->gltf;
+  const GltfImage *embedded = gltf ? gltf->embedded_image(name) : nullptr;
+  stream->textures_pending++;
+  auto s = stream;
+  ThreadPool::getInstance().push([s, name, filename, type, gltf, embedded,
+                                  virtual_texture] {
+    // 第一次使用时烘焙.vtex（整张图解码、生成mip、写文件），和打开文件一起
+    // 放在这里，主线程只创建gl对象
+    std::shared_ptr<VirtualTextureFile> file;
+    std::vector<unsigned char> top;
+    if (virtual_texture) {
+      std::string vtex = filename + ".vtex";
+      if (std::filesystem::exists(vtex) ||
+          bake_virtual_texture(filename, vtex)) {
+        file = std::make_shared<VirtualTextureFile>(vtex);
+        if (!file->valid() || !file->read_top(top))
+          file.reset();
+      }
+    }
+    TextureImage image =
+        file       ? TextureImage()
+        : embedded ? TextureImage(embedded->data, embedded->size, false)
+                   : TextureImage(filename, !gltf);
+    std::lock_guard<std::mutex> guard(s->lock);
+    s->ready_textures.push_back(
+        {name, type, std::move(image), file, std::move(top)});
+    s->signal.notify_all();
+  });
+}
+// vertex_indirect.glsl中的Object，std430布局
+struct ObjectData {
+  glm::mat4 model;
+  glm::vec4 decode_offset;
+  glm::vec4 decode_scale;
+};
+void Model::build_batches() {
+  batches.clear();
+  batch_order.clear();
+  std::vector<std::vector<uint32_t>> groups;
+  for (uint32_t i = 0; i < meshes.size(); i++) {
+    auto &m = meshes[i];
+    size_t b = 0;
+    while (b < batches.size() &&
+           (batches[b].arena != m->get_arena() ||
+            !batches[b].material->same_material(*m)))
+      b++;
+    if (b == batches.size()) {
+      batches.push_back({m->get_arena(), m, 0, 0});
+      groups.emplace_back();
+    }
+    groups[b].push_back(i);
+  }
+  // 每个mesh最多一条命令，开了meshlet剔除时最多每个meshlet一条
+  view_capacity = 0;
+  for (size_t b = 0; b < batches.size(); b++) {
+    batches[b].first_mesh = batch_order.size();
+    batch_order.insert(batch_order.end(), groups[b].begin(), groups[b].end());
+    batches[b].mesh_count = batch_order.size() - batches[b].first_mesh;
+    for (auto i : groups[b])
+      view_capacity += std::max<size_t>(meshes[i]->meshlets.size(), 1);
+  }
+  if (!object_buffer)
+    glGenBuffers(1, &object_buffer);
+  allocate_commands();
+  objects_dirty = true;
+  batches_dirty = false;
+}
+// 每次摆放在indirect buffer里占view_capacity条命令，摆放次数变多时重新分配
+void Model::allocate_commands() {
+  if (!indirect_buffer)
+    glGenBuffers(1, &indirect_buffer);
+  buffer_views = views.size();
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER,
+               sizeof(DrawElementsIndirectCommand) * view_capacity *
+                   buffer_views,
+               nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  indirect_bytes =
+      sizeof(DrawElementsIndirectCommand) * view_capacity * buffer_views +
+      sizeof(ObjectData) * meshes.size();
+  // 新分配的buffer里没有任何命令
+  for (auto &v : views)
+    v.commands.clear();
+  mark_commands_dirty();
+}
+void Model::upload_objects() {
+  // base_instance就是mesh的下标，shader用gl_BaseInstance取自己的数据
+  std::vector<ObjectData> objects(meshes.size());
+  for (size_t i = 0; i < meshes.size(); i++) {
+    objects[i].model = node_world(*meshes[i]);
+    objects[i].decode_offset = glm::vec4(meshes[i]->get_decode_offset(), 0.0f);
+    objects[i].decode_scale = glm::vec4(meshes[i]->get_decode_scale(), 0.0f);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, object_buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ObjectData) * objects.size(),
+               objects.data(), GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  objects_dirty = false;
+}
+// LOD或者剔除结果变化时只改命令，batch和SSBO不变
+void Model::upload_commands() {
+  View &v = view();
+  std::vector<DrawElementsIndirectCommand> commands;
+  v.ranges.resize(batches.size());
+  visible_meshlets = total_meshlets = 0;
+  for (size_t n = 0; n < batches.size(); n++) {
+    auto &b = batches[n];
+    size_t begin = commands.size();
+    for (size_t k = b.first_mesh; k < b.first_mesh + b.mesh_count; k++) {
+      uint32_t i = batch_order[k];
+      auto &m = meshes[i];
+      if (!visible(i))
+        continue;
+      DrawElementsIndirectCommand cmd;
+      if (!m->command(i, cmd, lod_of(i)))
+        continue;
+      // 蒙皮之后meshlet的包围球和法线锥都不再准确
+      if (!meshlet_culling || lod_of(i) != 0 || m->meshlets.empty() ||
+          m->skinned()) {
+        commands.push_back(cmd);
+        continue;
+      }
+      total_meshlets += m->meshlets.size();
+      // 每个节点的局部空间不同，视锥和相机位置要分别换算
+      glm::mat4 object = node_world(*m);
+      Frustum frustum = extract_frustum(v.culling_transform * object);
+      glm::vec3 camera =
+          glm::vec3(glm::inverse(object) * glm::vec4(v.culling_camera, 1.0f));
+      size_t merged = commands.size();
+      for (auto &ml : m->meshlets) {
+        if (cull_meshlet(ml, frustum, camera))
+          continue;
+        visible_meshlets++;
+        uint32_t first = cmd.first_index + ml.first_index;
+        // 相邻的可见meshlet在index中也是连续的，合并成一条命令
+        if (commands.size() > merged &&
+            commands.back().first_index + commands.back().count == first) {
+          commands.back().count += ml.index_count;
+          continue;
+        }
+        commands.push_back({ml.index_count, 1, first, cmd.base_vertex, i});
+      }
+    }
+    v.ranges[n] = {current_view * view_capacity + begin,
+                   commands.size() - begin};
+  }
+  v.commands_dirty = false;
+  // 相机没动时结果和上次一样，不再写buffer
+  if (commands.size() == v.commands.size() &&
+      memcmp(commands.data(), v.commands.data(),
+                  sizeof(DrawElementsIndirectCommand) * commands.size()) == 0)
+    return;
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+  glBufferSubData(GL_DRAW_INDIRECT_BUFFER,
+                  sizeof(DrawElementsIndirectCommand) * current_view *
+                      view_capacity,
+                  sizeof(DrawElementsIndirectCommand) * commands.size(),
+                  commands.data());
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  v.commands.swap(commands);
+}
+void Model::draw_indirect() {
+  if (batches_dirty)
+    build_batches();
+  else if (views.size() > buffer_views)
+    allocate_commands();
+  if (view().commands_dirty)
+    upload_commands();
+  if (objects_dirty)
+    upload_objects();
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_buffer);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+  auto &ranges = view().ranges;
+  for (size_t n = 0; n < batches.size(); n++) {
+    auto &b = batches[n];
+    auto [first, count] = ranges[n];
+    if (!count || !b.arena)
+      continue;
+    b.material->activate(program);
+    b.arena->bind();
+    glMultiDrawElementsIndirect(
+        GL_TRIANGLES, b.arena->index_type(),
+        (void *)(sizeof(DrawElementsIndirectCommand) * first), count, 0);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+void Model::select_lod(const glm::mat4 &transform, glm::vec3 camera_pos,
+                       float fov, float screen_height) {
+  // 距离为1处一个单位长度在屏幕上占的像素
+  float pixels_per_unit =
+      screen_height / (2.0f * std::tan(glm::radians(fov) * 0.5f));
+  update_nodes();
+  View &v = view();
+  v.lod.resize(meshes.size(), 0);
+  for (size_t i = 0; i < meshes.size(); i++) {
+    auto &m = meshes[i];
+    glm::mat4 object = transform * node_world(*m);
+    // 误差在物体空间，按最大的轴向缩放换算到世界空间
+    float scale = std::max({glm::length(glm::vec3(object[0])),
+                            glm::length(glm::vec3(object[1])),
+                            glm::length(glm::vec3(object[2]))});
+    glm::vec3 center =
+        glm::vec3(object * glm::vec4((m->min + m->max) * 0.5f, 1.0f));
+    float radius = glm::length(m->max - m->min) * 0.5f * scale;
+    float distance = glm::length(center - camera_pos) - radius;
+    // 相机在包围球里面时总是用LOD0
+    uint8_t l = 0;
+    if (distance > 0.0f)
+      l = m->select_lod(distance, pixels_per_unit * scale, lod_threshold);
+    if (l != v.lod[i]) {
+      v.lod[i] = l;
+      v.commands_dirty = true;
+    }
+  }
+}
+void Model::cull(const Frustum &frustum, const glm::mat4 &view_projection,
+                 const glm::mat4 &transform, glm::vec3 camera_pos) {
+  update_nodes();
+  View &v = view();
+  if (frustum_culling) {
+    culler.clear();
+    for (auto &m : meshes)
+      culler.add(m->min, m->max, m->radius, transform * node_world(*m));
+    culler.cull(frustum, visible_list);
+    // 蒙皮之后的位置不在绑定姿势的包围盒里，总是画
+    std::vector<uint8_t> next(meshes.size(), 0);
+    for (size_t i = 0; i < meshes.size(); i++)
+      next[i] = meshes[i]->skinned();
+    for (auto i : visible_list)
+      next[i] = 1;
+    visible_meshes = std::count(next.begin(), next.end(), 1);
+    if (next != v.mesh_visible) {
+      v.mesh_visible.swap(next);
+      v.commands_dirty = true;
+    }
+  } else if (!v.mesh_visible.empty()) {
+    v.mesh_visible.clear();
+    v.commands_dirty = true;
+  }
+  if (!meshlet_culling)
+    return;
+  glm::mat4 culling_transform = view_projection * transform;
+  glm::vec3 culling_camera =
+      glm::vec3(glm::inverse(transform) * glm::vec4(camera_pos, 1.0f));
+  // 相机和摆放都没动时meshlet的剔除结果不变
+  if (culling_transform != v.culling_transform ||
+      culling_camera != v.culling_camera) {
+    v.culling_transform = culling_transform;
+    v.culling_camera = culling_camera;
+    v.commands_dirty = true;
+  }
+}
+bool Model::batch_dynamic(DynamicBatcher &batcher,
+                          const glm::mat4 &transform) {
+  if (!loaded() || indirect || format != VertexFormat::Full || animator)
+    return false;
+  for (auto &m : meshes)
+    if (!batcher.eligible(*m))
+      return false;
+  update_nodes();
+  for (auto &m : meshes)
+    batcher.add(program, m, transform * node_world(*m));
+  return true;
+}
+void DynamicBatcher::add(std::shared_ptr<ShaderProgram> program,
+                         std::shared_ptr<Mesh> mesh,
+                         const glm::mat4 &transform) {
+  for (auto &g : groups) {
+    if (g.program == program && g.material->same_material(*mesh)) {
+      g.items.push_back({std::move(mesh), transform});
+      return;
+    }
+  }
+  groups.push_back({std::move(program), mesh, {{mesh, transform}}});
+}
+void DynamicBatcher::flush() {
+  batched_meshes = draws = 0;
+  if (groups.empty())
+    return;
+  buffer.begin();
+  glm::mat4 identity(1.0f);
+  for (auto &g : groups) {
+    size_t vertex_count = 0, index_count = 0;
+    for (auto &it : g.items) {
+      vertex_count += it.mesh->cpu_vertices().size();
+      index_count += it.mesh->level(0).index_count;
+    }
+    size_t vertex_offset = 0, index_offset = 0;
+    auto *vertices = (float *)buffer.allocate(
+        vertex_count * DYNAMIC_BATCH_STRIDE, DYNAMIC_BATCH_STRIDE,
+        vertex_offset);
+    auto *indices = vertices ? (uint32_t *)buffer.allocate(
+                                   index_count * sizeof(uint32_t),
+                                   sizeof(uint32_t), index_offset)
+                             : nullptr;
+    g.program->use();
+    if (!indices) {
+      // 这一帧的空间用完了，剩下的逐个画
+      for (auto &it : g.items) {
+        it.mesh->activate(g.program);
+        g.program->set("model", it.transform);
+        it.mesh->draw();
+        draws++;
+      }
+      continue;
+    }
+    uint32_t base = 0;
+    for (auto &it : g.items) {
+      auto &v = it.mesh->cpu_vertices();
+      MeshLod l = it.mesh->level(0);
+      transform_vertices(it.transform, v.data(), v.size(),
+                         vertices + 8 * (size_t)base);
+      rebase_indices(it.mesh->cpu_indices().data() + l.first_index,
+                     l.index_count, base, indices);
+      indices += l.index_count;
+      base += v.size();
+    }
+    g.material->activate(g.program);
+    g.program->set("model", identity);
+    glBindVertexArray(vao);
+    glDrawElementsBaseVertex(GL_TRIANGLES, index_count, GL_UNSIGNED_INT,
+                             (void *)index_offset,
+                             vertex_offset / DYNAMIC_BATCH_STRIDE);
+    batched_meshes += g.items.size();
+    draws++;
+  }
+  glBindVertexArray(0);
+  buffer.end();
+  groups.clear();
+}
+void Model::batch_static(float cell_size) {
+  finish();
+  update_nodes();
+  std::vector<MeshData> sources;
+  std::vector<glm::mat4> world;
+  std::vector<std::shared_ptr<Mesh>> kept;
+  for (auto &m : meshes) {
+    if (m->skinned() || !m->resident()) {
+      kept.push_back(m);
+      continue;
+    }
+    MeshData d;
+    MeshLod l = m->level(0);
+    d.vertices = m->cpu_vertices();
+    d.indices.assign(m->cpu_indices().begin() + l.first_index,
+                     m->cpu_indices().begin() + l.first_index + l.index_count);
+    d.min = m->min;
+    d.max = m->max;
+    m->copy_material(d);
+    sources.push_back(std::move(d));
+    world.push_back(node_world(*m));
+  }
+  if (sources.empty()) {
+    std::cout << "ERROR::MODEL::No resident static meshes in " << path
+              << std::endl;
+    return;
+  }
+  size_t before = meshes.size();
+  auto merged = build_static_batches(sources, world, cell_size);
+  meshes = std::move(kept);
+  for (auto &d : merged)
+    loadMeshData(d);
+  for (auto &v : views)
+    v.lod.clear();
+  batches_dirty = true;
+  printf("%s: static batching %zu -> %zu meshes\n", path.c_str(), before,
+         meshes.size());
+}
+bool Model::bake_impostor(const std::string &out, uint32_t grid,
+                          uint32_t cell_size) {
+  finish();
+  if (format != VertexFormat::Full || meshes.empty()) {
+    std::cout << "ERROR::IMPOSTOR::Can't bake " << path << std::endl;
+    return false;
+  }
+  update_nodes();
+  glm::vec3 lo(INFINITY), hi(-INFINITY);
+  for (auto &m : meshes) {
+    glm::mat4 world = node_world(*m);
+    for (int c = 0; c < 8; c++) {
+      glm::vec3 corner(c & 1 ? m->max.x : m->min.x, c & 2 ? m->max.y : m->min.y,
+                       c & 4 ? m->max.z : m->min.z);
+      glm::vec3 p = glm::vec3(world * glm::vec4(corner, 1.0f));
+      lo = glm::min(lo, p);
+      hi = glm::max(hi, p);
+    }
+  }
+  ImpostorAtlas atlas;
+  auto &h = atlas.header;
+  memcpy(h.magic, "IMPO", 4);
+  h.version = IMPOSTOR_VERSION;
+  h.grid = grid;
+  h.cell_size = cell_size;
+  glm::vec3 center = (lo + hi) * 0.5f;
+  float r = std::max(glm::length(hi - lo) * 0.5f, 1e-4f);
+  memcpy(h.center, &center[0], sizeof(h.center));
+  h.radius = r;
+  uint32_t size = h.size();
+  auto bake = std::make_shared<ShaderProgram>();
+  bake->load_shader("assets/glsl/model/vertex_impostor_bake.glsl",
+                    GL_VERTEX_SHADER);
+  bake->load_shader("assets/glsl/model/fragment_impostor_bake.glsl",
+                    GL_FRAGMENT_SHADER);
+  bake->link();
+  // 颜色、法线、深度三个颜色附件，另外一个深度缓冲做遮挡
+  const GLenum formats[3][3] = {{GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE},
+                                {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE},
+                                {GL_R16, GL_RED, GL_UNSIGNED_SHORT}};
+  const GLenum attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1,
+                                 GL_COLOR_ATTACHMENT2};
+  unsigned int fbo, rbo, textures[3];
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glGenTextures(3, textures);
+  for (int i = 0; i < 3; i++) {
+    glBindTexture(GL_TEXTURE_2D, textures[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, formats[i][0], size, size, 0,
+                 formats[i][1], formats[i][2], nullptr);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D,
+                           textures[i], 0);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glGenRenderbuffers(1, &rbo);
+  glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, rbo);
+  glDrawBuffers(3, attachments);
+  bool complete =
+      glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  if (complete) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const float clear[3][4] = {
+        {0.0f, 0.0f, 0.0f, 0.0f}, {0.5f, 0.5f, 0.5f, 0.0f}, {1.0f}};
+    for (int i = 0; i < 3; i++)
+      glClearBufferfv(GL_COLOR, i, clear[i]);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    bake->use();
+    glm::mat4 projection = glm::ortho(-r, r, -r, r, r, 3.0f * r);
+    bake->set("projection", projection);
+    for (uint32_t y = 0; y < grid; y++) {
+      for (uint32_t x = 0; x < grid; x++) {
+        glm::vec3 dir =
+            octahedron_decode((glm::vec2(x, y) + 0.5f) / (float)grid);
+        glm::vec3 up = std::fabs(dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f)
+                                                : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 view = glm::lookAt(center + dir * 2.0f * r, center, up);
+        bake->set("view", view);
+        glViewport(x * cell_size, y * cell_size, cell_size, cell_size);
+        for (auto &m : meshes) {
+          m->activate(bake);
+          glm::mat4 world = node_world(*m);
+          bake->set("model", world);
+          m->draw();
+        }
+      }
+    }
+    size_t pixels = (size_t)size * size;
+    atlas.color.resize(pixels * 4);
+    atlas.normal.resize(pixels * 4);
+    atlas.depth.resize(pixels);
+    void *targets[3] = {atlas.color.data(), atlas.normal.data(),
+                        atlas.depth.data()};
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int i = 0; i < 3; i++) {
+      glReadBuffer(attachments[i]);
+      glReadPixels(0, 0, size, size, formats[i][1], formats[i][2],
+                   targets[i]);
+    }
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteRenderbuffers(1, &rbo);
+  glDeleteTextures(3, textures);
+  glDeleteFramebuffers(1, &fbo);
+  if (!complete) {
+    std::cout << "ERROR::IMPOSTOR::Framebuffer incomplete" << std::endl;
+    return false;
+  }
+  if (!write_impostor(out, atlas))
+    return false;
+  printf("%s: baked %u x %u impostor views into %s\n", path.c_str(), grid,
+         grid, out.c_str());
+  return true;
+}
+Impostor::Impostor(const ImpostorAtlas &atlas, size_t _max_instances)
+    : header(atlas.header), max_instances(_max_instances),
+      instances(_max_instances * ImpostorInstanceLayout::stride) {
+  uint32_t size = header.size();
+  auto create = [size](GLenum internal, GLenum format, GLenum type,
+                       const void *data) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal, size, size, 0, format, type,
+                 data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+  };
+  color = create(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, atlas.color.data());
+  normal = create(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, atlas.normal.data());
+  depth = create(GL_R16, GL_RED, GL_UNSIGNED_SHORT, atlas.depth.data());
+  glBindTexture(GL_TEXTURE_2D, 0);
+  const float corners[] = {-1.0f, -1.0f, 1.0f, -1.0f,
+                           -1.0f, 1.0f,  1.0f, 1.0f};
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &quad);
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, quad);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+  ImpostorCornerLayout::setup();
+  glBindBuffer(GL_ARRAY_BUFFER, instances.id());
+  ImpostorInstanceLayout::setup(0, 1);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  program = std::make_shared<ShaderProgram>();
+  program->load_shader("assets/glsl/model/vertex_impostor.glsl",
+                       GL_VERTEX_SHADER);
+  program->load_shader("assets/glsl/model/fragment_impostor.glsl",
+                       GL_FRAGMENT_SHADER);
+  program->link();
+}
+Impostor::~Impostor() {
+  unsigned int textures[3] = {color, normal, depth};
+  glDeleteTextures(3, textures);
+  glDeleteBuffers(1, &quad);
+  glDeleteVertexArrays(1, &vao);
+}
+std::shared_ptr<Impostor> Impostor::load(const std::string &path) {
+  ImpostorAtlas atlas;
+  if (!read_impostor(path, atlas))
+    return nullptr;
+  return std::make_shared<Impostor>(atlas);
+}
+bool Impostor::add(const glm::mat4 &transform, glm::vec3 camera) {
+  if (queued.size() / 2 >= max_instances)
+    return false;
+  glm::vec3 center = glm::vec3(
+      transform *
+      glm::vec4(header.center[0], header.center[1], header.center[2], 1.0f));
+  float scale = std::max({glm::length(glm::vec3(transform[0])),
+                          glm::length(glm::vec3(transform[1])),
+                          glm::length(glm::vec3(transform[2]))});
+  float radius = header.radius * scale;
+  glm::vec3 to_camera = camera - center;
+  if (glm::length(to_camera) - radius < distance)
+    return false;
+  // 烘焙的方向在模型空间
+  glm::vec3 dir = glm::inverse(glm::mat3(transform)) * to_camera;
+  glm::uvec2 cell = impostor_cell(glm::normalize(dir), header.grid);
+  queued.push_back(glm::vec4(center, radius));
+  queued.push_back(glm::vec4(cell.x, cell.y, 0.0f, 0.0f));
+  return true;
+}
+void Impostor::draw(glm::mat4 &view, glm::mat4 &projection) {
+  drawn = queued.size() / 2;
+  if (!drawn)
+    return;
+  instances.begin();
+  size_t offset = 0;
+  size_t bytes = queued.size() * sizeof(glm::vec4);
+  void *dst =
+      instances.allocate(bytes, ImpostorInstanceLayout::stride, offset);
+  memcpy(dst, queued.data(), bytes);
+  program->use();
+  program->set("view", view);
+  program->set("projection", projection);
+  program->set("grid", (float)header.grid);
+  program->set("impostor_color", 0);
+  program->set("impostor_depth", 1);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, color);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, depth);
+  glBindVertexArray(vao);
+  glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, drawn,
+                                    offset / ImpostorInstanceLayout::stride);
+  glBindVertexArray(0);
+  instances.end();
+  queued.clear();
+}
+void Model::animate(float dt) {
+  if (!animator)
+    return;
+  animator->update(dt);
+  animator->upload();
+}
 void Model::set(glm::mat4 &v, glm::mat4 &p, glm::mat4 &model, glm::vec3 &cp) {
   program->set("view", v);
   program->set("projection", p);
   program->set("model", model);
+  model_matrix = model;
   // program->set("viewPos", cp);
 }
-void Model::activate() {
-  for (auto &m : meshes) {
-    m->activate(program);
-  }
-}
 void Program::set_light(std::shared_ptr<ShaderProgram> &program) {
   int i = 0;
   for (auto &l : light_src) {
@@ -120,6 +1145,15 @@ void Program::set_light(std::shared_ptr<ShaderProgram> &program) {
     i++;
   }
 }
+void Program::enable_virtual_texture(std::string vertex,
+                                     uint32_t slots_per_side) {
+  mgr.vt_system = std::make_shared<VirtualTextureSystem>(slots_per_side);
+  feedback = std::make_shared<ShaderProgram>();
+  feedback->load_shader(vertex, GL_VERTEX_SHADER);
+  feedback->load_shader("assets/glsl/model/fragment_vt_feedback.glsl",
+                        GL_FRAGMENT_SHADER);
+  feedback->link();
+}
 void Program::process() {
   if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     glfwSetWindowShouldClose(window, true);
@@ -130,19 +1164,80 @@ void Program::process() {
   camera->process(window);
 }
 void Program::run() {
-  model->link();
+  if (placements.empty())
+    placements.push_back({model});
+  // 共享的Model只需要link、载入和推进动画一次
+  // 同一个Model的每次摆放各用一份LOD、剔除结果和indirect命令
+  std::set<Model *> models;
+  std::map<Model *, size_t> views;
+  for (auto &p : placements) {
+    models.insert(p.model.get());
+    p.view = views[p.model.get()]++;
+  }
+  for (auto m : models)
+    m->link();
   // for (auto &l : light_src) {
   //   l->program->link();
   // }
+  double last_frame = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glm::mat4 m = glm::mat4(1.0f);
-    model->use();
-    model->set(camera->view, camera->projection, m, camera->cameraPos);
-    // set_light(model->program);
-    model->activate();
-    model->draw();
+    glm::mat4 view_projection = camera->projection * camera->view;
+    Frustum frustum = camera->frustum();
+    // 后台载入时已经上传的mesh先画出来，标题栏显示进度
+    if (!model->loaded()) {
+      model->update();
+      std::string title = "Loading " +
+                          std::to_string((int)(model->progress() * 100)) + "%";
+      glfwSetWindowTitle(window, model->loaded() ? "Hello Window"
+                                                 : title.c_str());
+    }
+    double now = glfwGetTime();
+    for (auto m : models) {
+      if (m != model.get() && !m->loaded())
+        m->update();
+      m->animate((float)(now - last_frame));
+    }
+    last_frame = now;
+    if (mgr.vt_system) {
+      mgr.vt_system->begin_feedback(scr_size);
+      feedback->use();
+      feedback->set("view", camera->view);
+      feedback->set("projection", camera->projection);
+      feedback->set("vt_bias", -3.0f);
+      for (auto &p : placements) {
+        p.model->select_view(p.view);
+        p.model->select_lod(p.transform, camera->cameraPos, camera->get_fov(),
+                            scr_size.y);
+        p.model->draw_feedback(feedback, p.transform);
+      }
+      mgr.vt_system->end_feedback(scr_size);
+      mgr.vt_system->update();
+    }
+    for (auto &p : placements) {
+      if (p.model->impostor &&
+          p.model->impostor->add(p.transform, camera->cameraPos))
+        continue;
+      p.model->select_view(p.view);
+      p.model->select_lod(p.transform, camera->cameraPos, camera->get_fov(),
+                          scr_size.y);
+      p.model->cull(frustum, view_projection, p.transform, camera->cameraPos);
+      p.model->animation_instance = p.animation_instance;
+      p.model->use();
+      p.model->set(camera->view, camera->projection, p.transform,
+                   camera->cameraPos);
+      // set_light(p.model->program);
+      if (dynamic_batcher &&
+          p.model->batch_dynamic(*dynamic_batcher, p.transform))
+        continue;
+      p.model->draw();
+    }
+    if (dynamic_batcher)
+      dynamic_batcher->flush();
+    for (auto m : models)
+      if (m->impostor)
+        m->impostor->draw(camera->view, camera->projection);
     // for (auto &l : light_src) {
     //   if (l->light_type != 0) {
     //     l->program->use();
@@ -159,13 +1254,84 @@ void Program::run() {
     checkError("run");
   }
 }
-int main() {
-  Program program({800, 600});
+int main(int argc, char **argv) {
+  std::set<std::string> args(argv + 1, argv + argc);
+  // 只烘焙impostor时不显示窗口，烘焙完就退出
+  bool bake = args.contains("--bake-impostor");
+  Program program({800, 600}, !bake);
+  bool vt = args.contains("--virtual-texture");
+  // meshlet剔除的结果以indirect命令的形式提交
+  bool meshlets = args.contains("--meshlets");
+  bool indirect = meshlets || args.contains("--indirect");
+  // 骨骼动画只在逐个mesh绘制的完整格式下做GPU蒙皮
+  bool animate = args.contains("--animate");
+  VertexFormat format = args.contains("--quantized") ? VertexFormat::Quantized
+                                                     : VertexFormat::Full;
+  std::string vertex = format == VertexFormat::Quantized
+                           ? "assets/glsl/model/vertex_quantized.glsl"
+                           : "assets/glsl/model/vertex.glsl";
+  // feedback pass仍然逐个mesh绘制，使用普通的vertex shader
+  if (vt)
+    program.enable_virtual_texture(vertex);
+  if (indirect)
+    vertex = format == VertexFormat::Quantized
+                 ? "assets/glsl/model/vertex_indirect_quantized.glsl"
+                 : "assets/glsl/model/vertex_indirect.glsl";
+  else if (animate && format == VertexFormat::Full)
+    vertex = "assets/glsl/model/vertex_skinned.glsl";
   auto shader = std::make_shared<ShaderProgram>();
-  shader->load_shader("assets/glsl/model/vertex.glsl", GL_VERTEX_SHADER);
-  shader->load_shader("assets/glsl/model/fragment.glsl", GL_FRAGMENT_SHADER);
-  auto model = std::make_shared<Model>("assets/model/backpack/backpack.obj");
+  shader->load_shader(vertex, GL_VERTEX_SHADER);
+  shader->load_shader(vt ? "assets/glsl/model/fragment_vt.glsl"
+                         : "assets/glsl/model/fragment.glsl",
+                      GL_FRAGMENT_SHADER);
+  // 导入参数，见import_profile.h
+  std::string profile = "default";
+  for (int i = 1; i + 1 < argc; i++) {
+    if (std::string(argv[i]) == "--profile")
+      profile = argv[i + 1];
+  }
+  // 静态合批需要CPU端的顶点，要等载入完成才能合并
+  bool static_batch = args.contains("--static-batch");
+  // 动态合批每帧从CPU端的顶点重新变换
+  bool dynamic_batch = args.contains("--dynamic-batch");
+  Residency residency = static_batch || dynamic_batch ? Residency::Keep
+                                                      : Residency::Release;
+  if (dynamic_batch)
+    program.dynamic_batcher = std::make_shared<DynamicBatcher>();
+  // 后台载入，窗口先出现，mesh和贴图做好一个显示一个
+  auto model = ModelCache::getInstance().load(
+      "assets/model/backpack/backpack.obj", false, format, true, residency,
+      profile);
+  if (static_batch)
+    model->batch_static();
   model->program = std::move(shader);
+  model->indirect = indirect;
+  model->meshlet_culling = meshlets;
+  // 远处的摆放换成impostor，还没有烘焙过时先烘焙
+  if (bake || args.contains("--impostor")) {
+    std::string impostor = "assets/model/backpack/backpack.obj.impostor";
+    if (bake || !std::filesystem::exists(impostor))
+      model->bake_impostor(impostor);
+    if (bake)
+      return 0;
+    model->impostor = Impostor::load(impostor);
+  }
+  // 同一个模型摆多份，只导入和上传一次
+  int copies = 1;
+  for (int i = 1; i + 1 < argc; i++) {
+    if (std::string(argv[i]) == "--copies")
+      copies = std::max(1, atoi(argv[i + 1]));
+  }
+  for (int i = 0; i < copies; i++) {
+    Placement p;
+    p.model = ModelCache::getInstance().load(
+        "assets/model/backpack/backpack.obj", false, format, true, residency,
+        profile);
+    p.transform = glm::translate(glm::mat4(1.0f),
+                                 glm::vec3(4.0f * (i - (copies - 1) / 2.0f),
+                                           0.0f, 0.0f));
+    program.placements.push_back(p);
+  }
   program.model = std::move(model);
   program.run();
-}
\ No newline at end of file
+}
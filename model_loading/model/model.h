@@ -1,23 +1,52 @@
 #ifndef CAMERA_H
 #define CAMERA_H
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <vector>
 #define GLAD_GL_IMPLEMENTATION
 #include "glad/gl.h"
+#undef GLAD_GL_IMPLEMENTATION
 #include <GLFW/glfw3.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#define MAX_BONE_INFLUENCE 4
+#include "animation.h"
+#include "dynamic_batch.h"
+#include "frustum_cull.h"
+#include "geometry_arena.h"
+#include "gltf.h"
+#include "impostor.h"
+#include "import_arena.h"
+#include "import_profile.h"
+#include "mesh_cache.h"
+#include "mesh_data.h"
+#include "mesh_optimize.h"
+#include "mesh_simplify.h"
+#include "meshlet.h"
+#include "obj_loader.h"
+#include "scene_graph.h"
+#include "static_batch.h"
+#include "streaming_buffer.h"
+#include "thread_pool.h"
+#include "vertex_layout.h"
+#include "vertex_quant.h"
+#include "virtual_texture.h"
 /**
  * @brief
  * model化之前的成果，然后这里我需要阐述将会出现的设计，因为这里并不是之前代码简单的
@@ -35,18 +64,6 @@
   全局gl错误检查函数，当然可以进行错误阻截，尽早触发的获取错误会禁止后面的重复报错？
 */
 void checkError(std::string function);
-struct Vertex {
-  glm::vec3 Position;
-  glm::vec3 Normal;
-  glm::vec2 TexCoords;
-  glm::vec3 Tangent;
-  // bitangent
-  glm::vec3 Bitangent;
-  // bone indexes which will influence this vertex
-  int m_BoneIDs[MAX_BONE_INFLUENCE];
-  // weights from each bone
-  float m_Weights[MAX_BONE_INFLUENCE];
-};
 class ShaderProgram {
   unsigned int id;
   void check(void fun(unsigned int, unsigned int, int *), unsigned int sid,
@@ -94,6 +111,9 @@ public:
     glUniform4f(glGetUniformLocation(id, name.c_str()), value.x, value.y,
                 value.z, value.w);
   }
+  void set(std::string name, glm::fvec2 value) const {
+    glUniform2f(glGetUniformLocation(id, name.c_str()), value.x, value.y);
+  }
   void set(std::string name, glm::fvec3 value) const {
     glUniform3f(glGetUniformLocation(id, name.c_str()), value.x, value.y,
                 value.z);
@@ -112,13 +132,58 @@ public:
                        glm::value_ptr(value));
   }
 };
+/*
+  CPU端的几何数据上传之后是否保留。只有需要在CPU上做碰撞或者拾取时才用Keep，
+  否则上传完就释放，显存和内存里不会各有一份。
+*/
+enum class Residency { Release, Keep };
+// 各个对象自己报告占用的字节数，gpu是估计值（不知道驱动内部的对齐和压缩）
+struct MemoryUsage {
+  size_t gpu = 0, cpu = 0;
+  void operator+=(const MemoryUsage &o) {
+    gpu += o.gpu;
+    cpu += o.cpu;
+  }
+};
+// 解码好的图片，可以在工作线程读取，Texture在主线程上传
+struct TextureImage {
+  int width = 0, height = 0, channels = 0;
+  unsigned char *pixels = nullptr;
+  TextureImage() = default;
+  // glTF的uv原点在左上角，图片不需要翻转
+  TextureImage(const std::string &filename, bool flip = true) {
+    // 翻转设置是线程局部的，工作线程之间互不影响
+    stbi_set_flip_vertically_on_load_thread(flip);
+    pixels = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+  }
+  // 从内存中的png、jpg解码，比如glTF内嵌的图片
+  TextureImage(const unsigned char *data, size_t size, bool flip) {
+    stbi_set_flip_vertically_on_load_thread(flip);
+    pixels = stbi_load_from_memory(data, (int)size, &width, &height,
+                                   &channels, 0);
+  }
+  TextureImage(TextureImage &&o)
+      : width(o.width), height(o.height), channels(o.channels),
+        pixels(o.pixels) {
+    o.pixels = nullptr;
+  }
+  TextureImage(const TextureImage &) = delete;
+  void operator=(const TextureImage &) = delete;
+  ~TextureImage() {
+    if (pixels)
+      stbi_image_free(pixels);
+  }
+};
 class Texture {
   unsigned int id; // gl初始化时候自动赋值，用来区分不同的texture
+  int width = 0, height = 0;
 
 public:
   int index; // 用来对应不同的texture0，后面的数字就是index，用来激活
   int type; // aiTextureType_DIFFUSE
-  Texture(std::string filename, int _type) : type(_type) {
+  Texture(std::string filename, int _type)
+      : Texture(TextureImage(filename), _type) {}
+  Texture(const TextureImage &image, int _type) : type(_type) {
     glGenTextures(1, &id);
     glBindTexture(GL_TEXTURE_2D, id);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -126,19 +191,19 @@ public:
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
                     GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char *data =
-        stbi_load(filename.c_str(), &width, &height, &nrChannels, 0);
-    if (data) {
-      int mode = nrChannels == 3 ? GL_RGB : GL_RGBA;
-      glTexImage2D(GL_TEXTURE_2D, 0, mode, width, height, 0, mode,
-                   GL_UNSIGNED_BYTE, data);
+    if (image.pixels) {
+      width = image.width;
+      height = image.height;
+      int mode = image.channels == 3 ? GL_RGB : GL_RGBA;
+      // 宽度乘以通道数不一定是4的倍数
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexImage2D(GL_TEXTURE_2D, 0, mode, image.width, image.height, 0, mode,
+                   GL_UNSIGNED_BYTE, image.pixels);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
       glGenerateMipmap(GL_TEXTURE_2D);
     } else {
       std::cout << "Failed to load texture" << std::endl;
     }
-    stbi_image_free(data);
   }
   void activate(int idx) {
     glActiveTexture(GL_TEXTURE0 + idx);
@@ -146,14 +211,26 @@ public:
     index = idx;
   }
   ~Texture() { glDeleteTextures(1, &id); }
+  // 解码的像素上传后就释放了，CPU端不占空间。RGB在显存中一般也按4字节存放
+  MemoryUsage memory() const {
+    MemoryUsage usage;
+    for (int w = width, h = height; w > 0 || h > 0; w >>= 1, h >>= 1)
+      usage.gpu += (size_t)std::max(w, 1) * std::max(h, 1) * 4;
+    return usage;
+  }
 };
 class TextureMgr {
   std::map<std::string, std::shared_ptr<Texture>> texture_lut;
+  std::map<std::string, std::shared_ptr<VirtualTexture>> virtual_lut;
+  // 贴图还没有载入完成时使用的1x1纹理，按类型区分
+  std::map<int, std::shared_ptr<Texture>> placeholders;
   TextureMgr() {};
   TextureMgr(TextureMgr &) = delete;
   void operator=(TextureMgr const &) = delete;
 
 public:
+  // 不为空时diffuse贴图走虚拟纹理，显存占用由物理page缓存决定
+  std::shared_ptr<VirtualTextureSystem> vt_system;
   static TextureMgr &getInstance() {
     static TextureMgr stance;
     return stance;
@@ -162,6 +239,9 @@ public:
     for (auto &t : texture_lut) {
       t.second.reset();
     }
+    virtual_lut.clear();
+    placeholders.clear();
+    vt_system.reset();
   }
   ~TextureMgr() {
     
@@ -169,73 +249,379 @@ public:
   void set(std::string name, std::shared_ptr<Texture> &texture) {
     texture_lut[name] = std::move(texture);
   }
+  // 虚拟纹理的显存是整个系统共享的物理缓存，不算在单张贴图上
+  MemoryUsage memory(const std::string &name) const {
+    auto it = texture_lut.find(name);
+    return it != texture_lut.end() && it->second ? it->second->memory()
+                                                  : MemoryUsage();
+  }
   bool has(std::string name) { return texture_lut.contains(name); }
   std::shared_ptr<Texture> &get(std::string name) { return texture_lut[name]; }
+  // 和get不同，不存在时不会插入空的条目，而是返回占位纹理
+  std::shared_ptr<Texture> &find(const std::string &name, int type) {
+    auto it = texture_lut.find(name);
+    if (it != texture_lut.end() && it->second)
+      return it->second;
+    auto &p = placeholders[type];
+    if (!p) {
+      // 法线贴图用平的法线，其他用中性的灰色
+      TextureImage image;
+      static unsigned char flat[] = {128, 128, 255, 255};
+      static unsigned char gray[] = {160, 160, 160, 255};
+      image.width = image.height = 1;
+      image.channels = 4;
+      image.pixels = type == aiTextureType_HEIGHT ? flat : gray;
+      p = std::make_shared<Texture>(image, type);
+      image.pixels = nullptr;
+    }
+    return p;
+  }
+  void set_virtual(std::string name, std::shared_ptr<VirtualTexture> texture) {
+    virtual_lut[name] = std::move(texture);
+  }
+  bool has_virtual(std::string name) { return virtual_lut.contains(name); }
+  std::shared_ptr<VirtualTexture> &get_virtual(std::string name) {
+    return virtual_lut[name];
+  }
+};
+/*
+  Mesh的几种顶点布局，location和glsl一致。前三种都是Vertex的前缀，
+  静态mesh不再为骨骼和切线付出56字节。
+*/
+using StaticVertexLayout =
+    VertexLayout<Attr<0, GL_FLOAT, 3>, Attr<1, GL_FLOAT, 3>,
+                 Attr<2, GL_FLOAT, 2>>;
+using TangentVertexLayout =
+    VertexLayout<Attr<0, GL_FLOAT, 3>, Attr<1, GL_FLOAT, 3>,
+                 Attr<2, GL_FLOAT, 2>, Attr<3, GL_FLOAT, 3>,
+                 Attr<4, GL_FLOAT, 3>>;
+using SkinnedVertexLayout =
+    VertexLayout<Attr<0, GL_FLOAT, 3>, Attr<1, GL_FLOAT, 3>,
+                 Attr<2, GL_FLOAT, 2>, Attr<3, GL_FLOAT, 3>,
+                 Attr<4, GL_FLOAT, 3>, IAttr<5, GL_INT, MAX_BONE_INFLUENCE>,
+                 Attr<6, GL_FLOAT, MAX_BONE_INFLUENCE>>;
+static_assert(StaticVertexLayout::offset<1> == offsetof(Vertex, Normal));
+static_assert(StaticVertexLayout::offset<2> == offsetof(Vertex, TexCoords));
+static_assert(TangentVertexLayout::offset<3> == offsetof(Vertex, Tangent));
+static_assert(TangentVertexLayout::offset<4> == offsetof(Vertex, Bitangent));
+static_assert(SkinnedVertexLayout::offset<5> == offsetof(Vertex, m_BoneIDs));
+static_assert(SkinnedVertexLayout::offset<6> == offsetof(Vertex, m_Weights));
+static_assert(SkinnedVertexLayout::stride == sizeof(Vertex));
+static_assert(StaticVertexLayout::stride == GLTF_STATIC_STRIDE);
+// 压缩格式，注意uv在tangent之后
+using QuantizedVertexLayout =
+    VertexLayout<Attr<0, GL_SHORT, 4, true>, Attr<1, GL_SHORT, 2, true>,
+                 Attr<3, GL_SHORT, 2, true>, Attr<2, GL_HALF_FLOAT, 2>>;
+using QuantizedSkinnedVertexLayout =
+    VertexLayout<Attr<0, GL_SHORT, 4, true>, Attr<1, GL_SHORT, 2, true>,
+                 Attr<3, GL_SHORT, 2, true>, Attr<2, GL_HALF_FLOAT, 2>,
+                 IAttr<5, GL_UNSIGNED_SHORT, MAX_BONE_INFLUENCE>,
+                 Attr<6, GL_UNSIGNED_BYTE, MAX_BONE_INFLUENCE, true>>;
+static_assert(QuantizedVertexLayout::offset<2> ==
+              offsetof(QuantizedVertex, tangent));
+static_assert(QuantizedVertexLayout::offset<3> == offsetof(QuantizedVertex, uv));
+static_assert(QuantizedVertexLayout::stride == sizeof(QuantizedVertex));
+static_assert(QuantizedSkinnedVertexLayout::offset<4> ==
+              offsetof(QuantizedSkinnedVertex, skin));
+static_assert(QuantizedSkinnedVertexLayout::stride ==
+              sizeof(QuantizedSkinnedVertex));
+enum class ArenaFormat {
+  Static,
+  Tangent,
+  Skinned,
+  Quantized,
+  QuantizedSkinned,
+  Count
+};
+/*
+  每种顶点布局和index宽度一个GeometryArena，和TextureMgr一样在Program析构时free
+*/
+class GeometryMgr {
+  std::unique_ptr<GeometryArena> arenas[(size_t)ArenaFormat::Count][2];
+  GeometryMgr() {};
+  GeometryMgr(GeometryMgr &) = delete;
+  void operator=(GeometryMgr const &) = delete;
+  template <typename Layout>
+  static std::unique_ptr<GeometryArena> create(bool index16) {
+    return std::make_unique<GeometryArena>(
+        Layout::stride, &Layout::setup,
+        index16 ? sizeof(uint16_t) : sizeof(unsigned int));
+  }
+
+public:
+  static GeometryMgr &getInstance() {
+    static GeometryMgr stance;
+    return stance;
+  }
+  void free() {
+    for (auto &a : arenas) {
+      a[0].reset();
+      a[1].reset();
+    }
+  }
+  GeometryArena &get(ArenaFormat format, bool index16) {
+    auto &arena = arenas[(size_t)format][index16];
+    if (!arena) {
+      switch (format) {
+      case ArenaFormat::Static:
+        arena = create<StaticVertexLayout>(index16);
+        break;
+      case ArenaFormat::Tangent:
+        arena = create<TangentVertexLayout>(index16);
+        break;
+      case ArenaFormat::Skinned:
+        arena = create<SkinnedVertexLayout>(index16);
+        break;
+      case ArenaFormat::Quantized:
+        arena = create<QuantizedVertexLayout>(index16);
+        break;
+      default:
+        arena = create<QuantizedSkinnedVertexLayout>(index16);
+        break;
+      }
+    }
+    return *arena;
+  }
 };
 class Mesh {
   // FIXME 过去的删除reset的代码并没有解决问题，之后就是手动控制了
+  // CPU端的副本，只有Residency::Keep时上传之后还保留
   std::vector<Vertex> vertices;
   std::vector<unsigned int> indices;
   std::vector<std::string> diffuse;
   std::vector<std::string> specular;
   std::vector<std::string> normal;
   std::vector<std::string> ambient;
-  unsigned int vao;
+  // 顶点和索引在共享的arena里面，mesh只记录自己的那一段
+  GeometryArena *arena = nullptr;
+  ArenaRange range;
+  VertexFormat format = VertexFormat::Full;
+  glm::vec3 decode_offset = glm::vec3(0.0f), decode_scale = glm::vec3(1.0f);
+  bool skin = false; // 顶点带骨骼权重
+  void upload(const Vertex *_vertices, size_t vertex_count,
+              const unsigned int *_indices, size_t _index_count) {
+    if (format == VertexFormat::Quantized) {
+      upload_quantized(_vertices, vertex_count, _indices, _index_count);
+      return;
+    }
+    // 只上传mesh真正用到的属性，没有骨骼和切线的静态mesh只占32字节
+    bool skinned = false, tangent = false;
+    for (size_t i = 0; i < vertex_count && !skinned; i++) {
+      for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+        skinned |= _vertices[i].m_Weights[j] > 0.0f;
+      tangent |= _vertices[i].Tangent != glm::vec3(0.0f);
+    }
+    skin = skinned;
+    if (skinned)
+      upload_packed<SkinnedVertexLayout>(ArenaFormat::Skinned, _vertices,
+                                         vertex_count, _indices, _index_count);
+    else if (tangent)
+      upload_packed<TangentVertexLayout>(ArenaFormat::Tangent, _vertices,
+                                         vertex_count, _indices, _index_count);
+    else
+      upload_packed<StaticVertexLayout>(ArenaFormat::Static, _vertices,
+                                        vertex_count, _indices, _index_count);
+  }
+  // 不超过65536个顶点的mesh使用16位index，index是mesh内部的下标所以总是放得下
+  void allocate(ArenaFormat _format, const void *_vertices,
+                size_t vertex_count, const unsigned int *_indices,
+                size_t _index_count) {
+    if (vertex_count > 65536) {
+      allocate(_format, _vertices, vertex_count, _indices, _index_count, false);
+      return;
+    }
+    std::vector<uint16_t> narrow(_indices, _indices + _index_count);
+    allocate(_format, _vertices, vertex_count, narrow.data(), _index_count,
+             true);
+  }
+  // index已经是arena的宽度，index16时是uint16_t
+  void allocate(ArenaFormat _format, const void *_vertices,
+                size_t vertex_count, const void *_indices, size_t _index_count,
+                bool index16) {
+    GeometryArena &target = GeometryMgr::getInstance().get(_format, index16);
+    bool ok = target.allocate(_vertices, vertex_count, _indices, _index_count,
+                              range);
+    arena = ok ? &target : nullptr;
+  }
+  // 布局是Vertex的前缀，按stride截断每个顶点即可
+  template <typename Layout>
+  void upload_packed(ArenaFormat _format, const Vertex *_vertices,
+                     size_t vertex_count, const unsigned int *_indices,
+                     size_t _index_count) {
+    static_assert(Layout::stride <= sizeof(Vertex));
+    if constexpr (Layout::stride == sizeof(Vertex)) {
+      allocate(_format, _vertices, vertex_count, _indices, _index_count);
+    } else {
+      std::vector<unsigned char> packed(Layout::stride * vertex_count);
+      for (size_t i = 0; i < vertex_count; i++)
+        memcpy(packed.data() + Layout::stride * i, &_vertices[i],
+               Layout::stride);
+      allocate(_format, packed.data(), vertex_count, _indices, _index_count);
+    }
+  }
+  // 压缩格式，属性的location和完整格式一致，有骨骼时和顶点交错存放
+  void upload_quantized(const Vertex *_vertices, size_t vertex_count,
+                        const unsigned int *_indices, size_t _index_count) {
+    QuantizedMesh q = quantize(_vertices, vertex_count);
+    decode_offset = q.offset;
+    decode_scale = q.scale;
+    skin = !q.skin.empty();
+    if (q.skin.empty()) {
+      allocate(ArenaFormat::Quantized, q.vertices.data(), vertex_count,
+               _indices, _index_count);
+      return;
+    }
+    std::vector<QuantizedSkinnedVertex> skinned(vertex_count);
+    for (size_t i = 0; i < vertex_count; i++)
+      skinned[i] = {q.vertices[i], q.skin[i]};
+    allocate(ArenaFormat::QuantizedSkinned, skinned.data(), vertex_count,
+             _indices, _index_count);
+  }
 
 public:
+  glm::vec3 min = glm::vec3(0.0f), max = glm::vec3(0.0f);
+  float radius = 0.0f; // 包围球，球心是包围盒中心
+  // 所在的节点，包围盒、LOD误差和meshlet都在这个节点的局部空间
+  uint32_t node = 0;
+  // index范围相对于这个mesh，为空时只有LOD0
+  std::vector<MeshLod> lods;
+  std::vector<Meshlet> meshlets;
   Mesh(std::vector<Vertex> _vertices, std::vector<unsigned int> _indices,
        std::vector<std::string> &d, std::vector<std::string> &s,
-       std::vector<std::string> &n, std::vector<std::string> &a)
+       std::vector<std::string> &n, std::vector<std::string> &a,
+       Residency residency = Residency::Release)
       : vertices(std::move(_vertices)), indices(std::move(_indices)),
         diffuse(std::move(d)), specular(std::move(s)), normal(std::move(n)),
         ambient(std::move(a)) {
-    unsigned int vbo, ebo;
-    glGenBuffers(1, &vbo);
-    glGenBuffers(1, &ebo);
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(),
-                 vertices.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
-                 indices.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, Normal));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, TexCoords));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, Tangent));
-    // vertex bitangent
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, Bitangent));
-    // ids
-    glEnableVertexAttribArray(5);
-    glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex),
-                           (void *)offsetof(Vertex, m_BoneIDs));
-
-    // weights
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, m_Weights));
-    glBindVertexArray(0);
-    glDeleteBuffers(1, &vbo);
-    glDeleteBuffers(1, &ebo);
+    upload(vertices.data(), vertices.size(), indices.data(), indices.size());
+    if (residency == Residency::Release)
+      release_cpu();
+  }
+  Mesh(MeshData &data, VertexFormat _format = VertexFormat::Full,
+       Residency residency = Residency::Release)
+      : vertices(std::move(data.vertices)), indices(std::move(data.indices)),
+        diffuse(std::move(data.diffuse)), specular(std::move(data.specular)),
+        normal(std::move(data.normal)), ambient(std::move(data.ambient)),
+        format(_format), lods(std::move(data.lods)),
+        meshlets(std::move(data.meshlets)) {
+    upload(vertices.data(), vertices.size(), indices.data(), indices.size());
+    if (residency == Residency::Release)
+      release_cpu();
+    min = data.min;
+    max = data.max;
+    radius = data.radius;
+  }
+  // 从mesh缓存映射的内存或者载入线程的数据直接上传，Keep时才复制一份
+  Mesh(const Vertex *_vertices, size_t vertex_count,
+       const unsigned int *_indices, size_t _index_count,
+       std::vector<std::string> d, std::vector<std::string> s,
+       std::vector<std::string> n, std::vector<std::string> a,
+       VertexFormat _format = VertexFormat::Full,
+       Residency residency = Residency::Release)
+      : diffuse(std::move(d)), specular(std::move(s)), normal(std::move(n)),
+        ambient(std::move(a)), format(_format) {
+    upload(_vertices, vertex_count, _indices, _index_count);
+    if (residency == Residency::Keep) {
+      vertices.assign(_vertices, _vertices + vertex_count);
+      indices.assign(_indices, _indices + _index_count);
+    }
+  }
+  // 顶点已经按_format的布局打包好，比如glTF映射的buffer，原样上传不再转换
+  Mesh(ArenaFormat _format, const void *_vertices, size_t vertex_count,
+       const void *_indices, size_t _index_count, bool index16,
+       std::vector<std::string> d, std::vector<std::string> s,
+       std::vector<std::string> n, std::vector<std::string> a)
+      : diffuse(std::move(d)), specular(std::move(s)), normal(std::move(n)),
+        ambient(std::move(a)) {
+    allocate(_format, _vertices, vertex_count, _indices, _index_count,
+             index16);
+  }
+  // 碰撞或者拾取不再需要CPU数据时也可以手动释放
+  void release_cpu() {
+    std::vector<Vertex>().swap(vertices);
+    std::vector<unsigned int>().swap(indices);
+  }
+  bool resident() const { return !vertices.empty(); }
+  // 只有resident时不为空，indices里是全部LOD，LOD0是level(0)的范围
+  const std::vector<Vertex> &cpu_vertices() const { return vertices; }
+  const std::vector<unsigned int> &cpu_indices() const { return indices; }
+  MemoryUsage memory() const {
+    MemoryUsage usage;
+    if (arena)
+      usage.gpu = range.vertex_count * arena->vertex_size() +
+                  arena->index_offset(range.index_count);
+    usage.cpu = vertices.capacity() * sizeof(Vertex) +
+                indices.capacity() * sizeof(unsigned int) +
+                lods.capacity() * sizeof(MeshLod) +
+                meshlets.capacity() * sizeof(Meshlet);
+    return usage;
+  }
+  void copy_material(MeshData &data) const {
+    data.diffuse = diffuse;
+    data.specular = specular;
+    data.normal = normal;
+    data.ambient = ambient;
+  }
+  template <typename Fn> void for_each_texture(Fn fn) const {
+    for (auto *list : {&diffuse, &specular, &normal, &ambient})
+      for (auto &name : *list)
+        fn(name);
+  }
+  ~Mesh() {
+    if (arena)
+      arena->release(range);
   }
-  ~Mesh() { glDeleteVertexArrays(1, &vao); }
   void process(GLFWwindow *) {}
-  void draw() {
-    glBindVertexArray(vao);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+  MeshLod level(size_t lod) const {
+    if (lods.empty())
+      return {0, range.index_count, 0.0f};
+    return lods[std::min(lod, lods.size() - 1)];
+  }
+  // 误差投影到屏幕上不超过threshold像素的最粗一级
+  size_t select_lod(float distance, float pixels_per_unit,
+                    float threshold) const {
+    size_t lod = 0;
+    for (size_t i = 1; i < lods.size(); i++) {
+      if (lods[i].error * pixels_per_unit <= threshold * distance)
+        lod = i;
+    }
+    return lod;
+  }
+  void draw(size_t lod = 0) {
+    if (!arena)
+      return;
+    MeshLod l = level(lod);
+    arena->bind();
+    glDrawElementsBaseVertex(
+        GL_TRIANGLES, l.index_count, arena->index_type(),
+        (void *)arena->index_offset(range.first_index + l.first_index),
+        range.first_vertex);
     glBindVertexArray(0);
   }
+  // 给glMultiDrawElementsIndirect使用，object是per-object SSBO中的下标
+  bool command(uint32_t object, DrawElementsIndirectCommand &cmd,
+               size_t lod = 0) const {
+    MeshLod l = level(lod);
+    cmd = {l.index_count, 1, range.first_index + l.first_index,
+           (int32_t)range.first_vertex, object};
+    return arena != nullptr;
+  }
+  GeometryArena *get_arena() const { return arena; }
+  bool skinned() const { return skin; }
+  glm::vec3 get_decode_offset() const { return decode_offset; }
+  glm::vec3 get_decode_scale() const { return decode_scale; }
+  // 贴图完全相同的mesh可以放在同一个indirect draw里面
+  bool same_material(const Mesh &o) const {
+    return diffuse == o.diffuse && specular == o.specular &&
+           normal == o.normal && ambient == o.ambient;
+  }
   void activate(std::shared_ptr<ShaderProgram> program) {
+    if (format == VertexFormat::Quantized) {
+      program->set("decode_offset", decode_offset);
+      program->set("decode_scale", decode_scale);
+    }
+    // 静态mesh没有启用location 5和6，shader不能读骨骼属性
+    program->set("skinned", skin);
     int idx = 0;
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
@@ -243,28 +629,56 @@ public:
     unsigned int heightNr = 1;
     TextureMgr &mgr = TextureMgr::getInstance();
     for (auto &d : diffuse) {
-      mgr.get(d)->activate(idx);
+      if (mgr.has_virtual(d)) {
+        auto &vt = mgr.get_virtual(d);
+        mgr.vt_system->activate(vt, idx);
+        program->set("vt_indirection", idx++);
+        program->set("vt_physical", idx++);
+        program->set("vt_info", vt->info());
+        program->set("vt_cache", mgr.vt_system->cache_info());
+        program->set("vt_scale", vt->scale());
+        diffuseNr++;
+        continue;
+      }
+      mgr.find(d, aiTextureType_DIFFUSE)->activate(idx);
       program->set("diffuse" + std::to_string(diffuseNr++), idx++);
     }
     for (auto &s : specular) {
-      mgr.get(s)->activate(idx);
+      mgr.find(s, aiTextureType_SPECULAR)->activate(idx);
       program->set("specular" + std::to_string(specularNr++), idx++);
     }
     for (auto &n : normal) {
-      mgr.get(n)->activate(idx);
+      mgr.find(n, aiTextureType_HEIGHT)->activate(idx);
       program->set("normal" + std::to_string(normalNr++), idx++);
     }
     for (auto &a : ambient) {
-      mgr.get(a)->activate(idx);
+      mgr.find(a, aiTextureType_AMBIENT)->activate(idx);
       program->set("ambient" + std::to_string(heightNr++), idx++);
     }
   }
+  // feedback pass只需要第一张diffuse对应的虚拟纹理
+  void activate_feedback(std::shared_ptr<ShaderProgram> program) {
+    if (format == VertexFormat::Quantized) {
+      program->set("decode_offset", decode_offset);
+      program->set("decode_scale", decode_scale);
+    }
+    TextureMgr &mgr = TextureMgr::getInstance();
+    if (diffuse.empty() || !mgr.has_virtual(diffuse[0])) {
+      program->set("vt_id", -1);
+      return;
+    }
+    auto &vt = mgr.get_virtual(diffuse[0]);
+    program->set("vt_id", (int)vt->id);
+    program->set("vt_info", vt->info());
+    program->set("vt_scale", vt->scale());
+  }
 };
 
 class Light {
   // 上一节没有介绍对于Light的任何抽象，那么我将沿用自己的设计
-  std::vector<float> vertices;
-  std::vector<unsigned int> indices;
+  // 上传之后只需要index的数量，顶点和index不再保留
+  size_t index_count;
+  size_t gpu_bytes;
   unsigned int vao;
 
 public:
@@ -282,8 +696,10 @@ public:
   float outerCutoff;
   int light_type = 1;
   std::shared_ptr<ShaderProgram> program = std::make_shared<ShaderProgram>();
-  Light(std::vector<float> _vertices, std::vector<unsigned int> _indices)
-      : vertices(std::move(_vertices)), indices(std::move(_indices)) {
+  Light(std::vector<float> vertices, std::vector<unsigned int> indices)
+      : index_count(indices.size()),
+        gpu_bytes(sizeof(float) * vertices.size() +
+                  sizeof(unsigned int) * indices.size()) {
     unsigned int vbo, ebo;
     glGenBuffers(1, &vbo);
     glGenBuffers(1, &ebo);
@@ -295,9 +711,7 @@ public:
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
                  indices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
-                          (void *)0);
-    glEnableVertexAttribArray(0);
+    PositionLayout::setup();
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glDeleteBuffers(1, &vbo);
@@ -307,6 +721,7 @@ public:
     // program.reset();
     glDeleteVertexArrays(1, &vao);
   }
+  MemoryUsage memory() const { return {gpu_bytes, 0}; }
   void process(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
       light_color.x -= light_color.x > 0.0f ? 0.01f : 0.0f;
@@ -357,43 +772,412 @@ public:
   }
   void draw() {
     glBindVertexArray(vao);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
   }
 };
+/*
+  小mesh的动态合批，见dynamic_batch.h。add只记录mesh和变换，flush时按
+  (program, 材质)分组，变换后的顶点和index写进StreamingBuffer，每组一次
+  glDrawElementsBaseVertex。顶点和index在同一个buffer里，VAO只设置一次。
+  mesh需要保留CPU数据，不能有骨骼，顶点数不超过max_vertices。
+*/
+class DynamicBatcher {
+  struct Item {
+    std::shared_ptr<Mesh> mesh;
+    glm::mat4 transform;
+  };
+  struct Group {
+    std::shared_ptr<ShaderProgram> program;
+    std::shared_ptr<Mesh> material;
+    std::vector<Item> items;
+  };
+  std::vector<Group> groups;
+  StreamingBuffer buffer;
+  unsigned int vao = 0;
+
+public:
+  size_t max_vertices = DYNAMIC_BATCH_MAX_VERTICES;
+  // 上一次flush的结果
+  size_t batched_meshes = 0, draws = 0;
+  explicit DynamicBatcher(size_t bytes_per_frame = 4 << 20)
+      : buffer(bytes_per_frame) {
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.id());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.id());
+    StaticVertexLayout::setup();
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    static_assert(StaticVertexLayout::stride == DYNAMIC_BATCH_STRIDE);
+  }
+  DynamicBatcher(const DynamicBatcher &) = delete;
+  void operator=(const DynamicBatcher &) = delete;
+  ~DynamicBatcher() { glDeleteVertexArrays(1, &vao); }
+  bool eligible(const Mesh &m) const {
+    return m.resident() && !m.skinned() &&
+           m.cpu_vertices().size() <= max_vertices;
+  }
+  void add(std::shared_ptr<ShaderProgram> program, std::shared_ptr<Mesh> mesh,
+           const glm::mat4 &transform);
+  // 每帧所有add之后调用一次，view和projection已经设置在各自的program上
+  void flush();
+  size_t gpu_bytes() const { return buffer.bytes(); }
+  size_t stalls() const { return buffer.stalls; }
+};
+using ImpostorCornerLayout = VertexLayout<Attr<0, GL_FLOAT, 2>>;
+// 包围球和格子，每个实例一份
+using ImpostorInstanceLayout =
+    VertexLayout<Attr<1, GL_FLOAT, 4>, Attr<2, GL_FLOAT, 4>>;
+/*
+  远处的摆放换成impostor，见impostor.h。add记录这一帧超过distance的摆放，
+  draw用一次实例化绘制画完所有四边形。实例数据写进StreamingBuffer，
+  用base instance指向这一帧的位置，VAO只设置一次。
+*/
+class Impostor {
+  ImpostorHeader header;
+  size_t max_instances;
+  unsigned int color = 0, normal = 0, depth = 0;
+  unsigned int vao = 0, quad = 0;
+  StreamingBuffer instances;
+  std::vector<glm::vec4> queued; // 每个实例两个vec4
+  std::shared_ptr<ShaderProgram> program;
+
+public:
+  // 包围球到相机的距离超过这个值时使用impostor，单位是世界空间
+  float distance = 30.0f;
+  size_t drawn = 0; // 上一次draw的实例数
+  explicit Impostor(const ImpostorAtlas &atlas, size_t max_instances = 4096);
+  Impostor(const Impostor &) = delete;
+  void operator=(const Impostor &) = delete;
+  ~Impostor();
+  // 文件不存在或者损坏时返回nullptr
+  static std::shared_ptr<Impostor> load(const std::string &path);
+  // 足够远时记录下来并返回true，否则调用者照常画模型
+  bool add(const glm::mat4 &transform, glm::vec3 camera);
+  void draw(glm::mat4 &view, glm::mat4 &projection);
+  // 法线图集给有光照的shader使用，fragment.glsl不计算光照
+  unsigned int normal_atlas() const { return normal; }
+};
 class Model {
   // mesh但是包含了数据的载入，自然最好也包含图片，模型，渲染代码
   bool gammaCorrection;
+  std::string path;
   std::string directory;
-  void loadModel(std::string path); // 调用节点处理载入模型
-  void processNode(aiNode *node, const aiScene *scene);
-  // 调用mesh处理并递归访问
-  std::shared_ptr<Mesh> processMesh(aiMesh *mesh,
-                                    const aiScene *scene); // 处理点与材质
-  std::vector<std::string> loadMaterialTextures(aiMaterial *mat,
-                                                aiTextureType type);
+  Residency residency;
+  /*
+    后台载入的状态。载入线程解析模型（或者打开mesh缓存），每做完一个aiMesh就把
+    下标放进ready_meshes；贴图在线程池里解码后放进ready_textures。
+    gl对象只能在主线程创建，由update每帧取走一部分上传。
+  */
+  struct DecodedTexture {
+    std::string name;
+    int type;
+    TextureImage image;
+    // 虚拟纹理：烘焙好并打开的.vtex和它最粗的page，image为空
+    std::shared_ptr<VirtualTextureFile> vtex;
+    std::vector<unsigned char> vtex_top;
+  };
+  struct Stream {
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable signal;
+    std::vector<size_t> ready_meshes;
+    std::vector<DecodedTexture> ready_textures;
+    bool meshes_done = false;
+    std::atomic<size_t> total = 0;
+    std::atomic<bool> cancel = false;
+    // 启动线程之前设置
+    ImportProfile profile = import_profile("default");
+    // 导入或者从缓存解压的结果，ready_meshes是它的下标
+    std::vector<std::vector<MeshData>> imported;
+    // 有骨骼时在转换mesh之前设置，之后不再改变
+    std::shared_ptr<const Skeleton> skeleton;
+    std::shared_ptr<const std::vector<AnimationClip>> clips;
+    // 在发布第一个mesh之前设置，主线程取走一次
+    SceneGraph graph;
+    // glTF的accessor直接指向映射的文件，这时ready_meshes是primitive下标
+    std::shared_ptr<const GltfAsset> gltf;
+    // 以下只在主线程访问
+    size_t uploaded = 0;
+    size_t direct_vertices = 0, direct_indices = 0;
+    size_t textures_pending = 0;
+    std::set<std::string> requested;
+    bool reported = false;
+  };
+  std::shared_ptr<Stream> stream;
+  // 启动载入线程，profile见import_profile.h
+  void loadModel(std::string path, const std::string &profile);
+  // 在载入线程运行，不能访问Model的成员
+  static void importModel(std::shared_ptr<Stream> s, std::string path);
+  // 优化之后的mesh切块、建meshlet和LOD，放进imported[i]并发布
+  // optimize为false时原样发布
+  static void buildMesh(Stream &s, size_t i, MeshData &data, bool optimize);
+  // 只解析JSON和映射文件，所有primitive一次发布
+  static void importGltf(std::shared_ptr<Stream> s, std::string path);
+  void loadGltfPrimitive(const GltfAsset &asset, size_t i);
+  void loadMeshData(const MeshData &data);
+  // 先序访问节点，记录节点层级和每个mesh所在的节点，转换交给线程池
+  static void processNode(aiNode *node, const aiScene *scene,
+                          std::vector<aiMesh *> &list,
+                          std::vector<uint32_t> &list_node, SceneGraph &graph,
+                          int32_t parent);
+  // 只记录贴图名，贴图由主线程在mesh上传时请求
+  static void processMaterial(aiMesh *mesh, const aiScene *scene,
+                              MeshData &data);
+  static std::vector<std::string> loadMaterialTextures(aiMaterial *mat,
+                                                       aiTextureType type);
+  // 贴图交给线程池解码或者烘焙成虚拟纹理
+  void loadTexture(const std::string &name, int type);
+  // 在线程池上解码，或者烘焙、打开虚拟纹理，结果放进ready_textures
+  void queueTexture(const std::string &name, int type, bool virtual_texture);
   // 处理材质，将会写入信息到texturemgr中。使用材质名称加diffuse类型访问
+  // 同一个arena并且贴图相同的mesh是一个batch，对应indirect buffer里连续的命令
+  struct Batch {
+    GeometryArena *arena;
+    std::shared_ptr<Mesh> material;
+    size_t first_mesh, mesh_count; // 在batch_order中的范围
+  };
+  std::vector<Batch> batches;
+  std::vector<uint32_t> batch_order; // 按batch排好的mesh下标
+  /*
+    同一个Model摆放多次时，LOD、剔除结果和indirect命令每次摆放各存一份，
+    indirect buffer里每次摆放占固定的一段。各段互不覆盖，命令没有变化的摆放
+    不再上传，不会在读这段命令的draw之间反复改写同一个范围。
+  */
+  struct View {
+    // 每个mesh当前使用的LOD，select_lod之前都是0
+    std::vector<uint8_t> lod;
+    // 上一次cull的结果，之后载入的mesh在下一次cull之前都算可见
+    std::vector<uint8_t> mesh_visible;
+    // 模型空间到裁剪空间的矩阵和模型空间的相机位置，由cull设置
+    glm::mat4 culling_transform = glm::mat4(1.0f);
+    glm::vec3 culling_camera = glm::vec3(0.0f);
+    bool commands_dirty = true;
+    // 每个batch在indirect buffer中的范围（命令的下标和个数）
+    std::vector<std::pair<size_t, size_t>> ranges;
+    // 这一段里现在的命令，重新生成的结果相同时跳过上传
+    std::vector<DrawElementsIndirectCommand> commands;
+  };
+  std::vector<View> views = std::vector<View>(1);
+  size_t current_view = 0;
+  View &view() { return views[current_view]; }
+  const View &view() const { return views[current_view]; }
+  void mark_commands_dirty() {
+    for (auto &v : views)
+      v.commands_dirty = true;
+  }
+  unsigned int indirect_buffer = 0, object_buffer = 0;
+  size_t indirect_bytes = 0; // 两个buffer一共的大小
+  size_t view_capacity = 0;  // 每次摆放预留的命令数
+  size_t buffer_views = 0;   // indirect buffer按几次摆放分配
+  bool batches_dirty = true, objects_dirty = true;
+  void build_batches();
+  void allocate_commands();
+  void upload_commands();
+  // 节点矩阵变化时重写object SSBO
+  void upload_objects();
+  void draw_indirect();
+  FrustumCuller culler;
+  std::vector<uint32_t> visible_list;
+  bool visible(size_t i) const {
+    auto &v = view().mesh_visible;
+    return i >= v.size() || v[i];
+  }
+  size_t lod_of(size_t i) const {
+    auto &lod = view().lod;
+    return i < lod.size() ? lod[i] : 0;
+  }
+  // set传进来的模型矩阵，逐个mesh绘制时再乘上节点矩阵
+  glm::mat4 model_matrix = glm::mat4(1.0f);
+  // mesh所在节点的世界矩阵。蒙皮mesh的位置完全由骨骼决定，不再乘节点矩阵
+  glm::mat4 node_world(const Mesh &m) const {
+    if (m.skinned() || m.node >= graph.size())
+      return glm::mat4(1.0f);
+    return graph.world(m.node);
+  }
+  void update_nodes() {
+    if (graph.update()) {
+      objects_dirty = true;
+      mark_commands_dirty();
+    }
+  }
+  // 蒙皮矩阵绑定在SSBO binding 1，还没有Animator时bone_base为-1，按绑定姿势画
+  void bind_bones() {
+    if (animator)
+      animator->bind(1);
+    int base = animator ? (int)animator->bone_base(animation_instance) : -1;
+    program->set("bone_base", base);
+  }
+
 public:
   std::vector<std::shared_ptr<Mesh>> meshes;
   std::shared_ptr<ShaderProgram> program;
-  Model(std::string path, bool gamma = false) : gammaCorrection(gamma) {
-    loadModel(path);
+  VertexFormat format;
+  // aiNode的层级，用set_local移动节点，下一次画的时候生效
+  SceneGraph graph;
+  // async为true时立即返回，mesh在之后的update中逐渐出现
+  Model(std::string _path, bool gamma = false,
+        VertexFormat _format = VertexFormat::Full, bool async = false,
+        Residency _residency = Residency::Release,
+        const std::string &profile = "default")
+      : gammaCorrection(gamma), residency(_residency), format(_format) {
+    loadModel(_path, profile);
+    if (!async)
+      finish();
   }
+  // 每次update最多上传几个aiMesh，避免一帧里卡太久
+  size_t uploads_per_frame = 4;
+  // 主线程每帧调用，上传已经准备好的mesh和贴图
+  void update(size_t budget);
+  void update() { update(uploads_per_frame); }
+  // 阻塞到全部载入完成
+  void finish();
+  bool loaded() const;
+  // 已经上传的aiMesh占总数的比例，还不知道总数时为0
+  float progress() const;
+  // mesh、用到的贴图和indirect buffer，共享的贴图在每个用到它的模型里都算一次
+  MemoryUsage memory() const;
+  // 为true时整个模型用几次glMultiDrawElementsIndirect画完，需要vertex_indirect
+  bool indirect = false;
+  // 允许的屏幕空间误差，单位是像素
+  float lod_threshold = 1.0f;
+  // 为true时indirect绘制逐meshlet剔除，只对LOD0生效
+  bool meshlet_culling = false;
+  size_t visible_meshlets = 0, total_meshlets = 0;
+  // 有骨骼的模型载入时创建，默认有一个播放第一个clip的实例。
+  // 同一个模型画多个角色时add更多实例，画之前设置animation_instance
+  std::shared_ptr<Animator> animator;
+  size_t animation_instance = 0;
+  // 推进所有实例并上传蒙皮矩阵，每帧画之前调用，dt单位是秒
+  void animate(float dt);
+  // 远处替换成这个impostor，为空时总是画完整的模型
+  std::shared_ptr<Impostor> impostor;
+  // 在离屏的framebuffer里从grid x grid个方向画整个模型，写成.impostor，
+  // 见impostor.h。只支持完整格式，蒙皮mesh按绑定姿势烘焙
+  bool bake_impostor(const std::string &out, uint32_t grid = 8,
+                     uint32_t cell_size = 128);
+  // 所有mesh都能动态合批时加进batcher并返回true，否则调用者照常draw。
+  // 只支持完整格式的逐个mesh绘制，画之前要先set
+  bool batch_dynamic(DynamicBatcher &batcher, const glm::mat4 &transform);
+  // 把不动的mesh按材质和cell_size大小的格子合并成世界空间的大mesh，见
+  // static_batch.h。需要Residency::Keep，蒙皮和没有CPU数据的mesh保持原样，
+  // 之后移动节点对合并过的mesh不再生效
+  void batch_static(float cell_size = 16.0f);
   ~Model() {
+    // Assimp的导入不能中断，只能等它返回，剩下的mesh不再处理
+    if (stream && stream->worker.joinable()) {
+      stream->cancel = true;
+      stream->worker.join();
+    }
     program.reset();
     for (auto &m : meshes) {
       m.reset();
     }
+    if (indirect_buffer)
+      glDeleteBuffers(1, &indirect_buffer);
+    if (object_buffer)
+      glDeleteBuffers(1, &object_buffer);
   }
+  // 每个mesh的贴图和解码参数不同，activate要和draw一一对应
   void draw() {
-    for (auto &m : meshes) {
-      m->draw();
+    update_nodes();
+    bind_bones();
+    if (indirect) {
+      draw_indirect();
+      return;
     }
+    for (size_t i = 0; i < meshes.size(); i++) {
+      if (!visible(i))
+        continue;
+      meshes[i]->activate(program);
+      glm::mat4 m = model_matrix * node_world(*meshes[i]);
+      program->set("model", m);
+      meshes[i]->draw(lod_of(i));
+    }
+  }
+  void draw_feedback(std::shared_ptr<ShaderProgram> feedback,
+                     const glm::mat4 &transform) {
+    update_nodes();
+    for (size_t i = 0; i < meshes.size(); i++) {
+      meshes[i]->activate_feedback(feedback);
+      glm::mat4 m = transform * node_world(*meshes[i]);
+      feedback->set("model", m);
+      meshes[i]->draw(lod_of(i));
+    }
+  }
+  // 第k次摆放，之后的select_lod、cull、draw和draw_feedback都使用它自己的状态
+  void select_view(size_t k) {
+    if (k >= views.size())
+      views.resize(k + 1);
+    current_view = k;
   }
+  // 按包围球到相机的距离和竖直方向的fov（角度）为每个mesh选LOD，每帧画之前调用
+  void select_lod(const glm::mat4 &transform, glm::vec3 camera_pos, float fov,
+                  float screen_height);
+  // 为true时cull逐mesh做视锥剔除，见frustum_cull.h
+  bool frustum_culling = true;
+  size_t visible_meshes = 0;
+  // 每帧画之前调用，frustum是世界空间的视锥，transform是这次摆放的模型矩阵
+  void cull(const Frustum &frustum, const glm::mat4 &view_projection,
+            const glm::mat4 &transform, glm::vec3 camera_pos);
   void set(glm::mat4 &v, glm::mat4 &p, glm::mat4 &m, glm::vec3 &cp);
   void use() { program->use(); }
   void process(GLFWwindow *) {}
   void link() { program->link(); }
-  void activate();
+};
+/*
+  同一个模型文件只导入、上传一次。ModelCache按路径和载入参数记录weak_ptr，
+  还有人在用时直接返回同一个Model，mesh、贴图和arena里的几何都是共享的；
+  最后一个shared_ptr释放时显存跟着释放。program、indirect这些设置也是共享的。
+  每次摆放只是一个Placement，记录自己的变换，画之前传给Model::set。
+*/
+class ModelCache {
+  std::map<std::string, std::weak_ptr<Model>> models;
+  ModelCache() {};
+  ModelCache(ModelCache &) = delete;
+  void operator=(ModelCache const &) = delete;
+
+public:
+  static ModelCache &getInstance() {
+    static ModelCache stance;
+    return stance;
+  }
+  std::shared_ptr<Model> load(const std::string &path, bool gamma = false,
+                              VertexFormat format = VertexFormat::Full,
+                              bool async = false,
+                              Residency residency = Residency::Release,
+                              const std::string &profile = "default") {
+    std::string key = path + "|" + std::to_string(gamma) + "|" +
+                      std::to_string((int)format) + "|" +
+                      std::to_string((int)residency) + "|" + profile;
+    auto it = models.find(key);
+    if (it != models.end()) {
+      if (auto model = it->second.lock()) {
+        // 之前是后台载入的，这次要求同步时等它完成
+        if (!async)
+          model->finish();
+        return model;
+      }
+    }
+    auto model = std::make_shared<Model>(path, gamma, format, async, residency,
+                                         profile);
+    models[key] = model;
+    return model;
+  }
+  // 还在使用的模型数，过期的条目顺便删掉
+  size_t size() {
+    std::erase_if(models, [](auto &m) { return m.second.expired(); });
+    return models.size();
+  }
+  void free() { models.clear(); }
+};
+struct Placement {
+  std::shared_ptr<Model> model;
+  glm::mat4 transform = glm::mat4(1.0f);
+  // 有骨骼动画时使用的Animator实例
+  size_t animation_instance = 0;
+  // 同一个Model的第几次摆放，Program::run设置
+  size_t view = 0;
 };
 class Camera {
   bool firstMouse = true;
@@ -404,9 +1188,12 @@ class Camera {
   const float cameraSpeed = 0.05f;
 
 public:
+  float get_fov() const { return fov; }
   glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
   glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 5.0f);
   glm::mat4 view = glm::mat4(1.0f), projection = glm::mat4(1.0f);
+  // 世界空间的视锥，平面从projection * view中提取
+  Frustum frustum() const { return extract_frustum(projection * view); }
   Camera(glm::ivec2 _scr_size) : scr_size(_scr_size) {
     // TODO 我想设计一个更加方便的办法，而不是需要设置这个指针
     lastX = scr_size.x / 2.0;
@@ -493,15 +1280,23 @@ class Program {
       program->framebuffer_size_callback(window, x, y);
   }
   void framebuffer_size_callback(GLFWwindow *, int width, int height) {
+    scr_size = {width, height};
     glViewport(0, 0, width, height);
   }
 
 public:
   GLFWwindow *window;
   std::shared_ptr<Model> model = nullptr;
+  // 为空时model画在原点，否则按每个Placement各画一次
+  std::vector<Placement> placements;
   std::vector<std::shared_ptr<Light>> light_src;
-  Program(glm::ivec2 _size) : scr_size(_size) {
+  std::shared_ptr<ShaderProgram> feedback = nullptr;
+  // 不为空时满足条件的摆放合并到一起画，见DynamicBatcher
+  std::shared_ptr<DynamicBatcher> dynamic_batcher = nullptr;
+  // visible为false时窗口不显示，只用来创建离屏渲染的context
+  Program(glm::ivec2 _size, bool visible = true) : scr_size(_size) {
     glfwInit();
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
     window = glfwCreateWindow(scr_size.x, scr_size.y, "Hello Window", nullptr,
                               nullptr);
     glfwMakeContextCurrent(window);
@@ -516,13 +1311,21 @@ public:
     camera = std::make_shared<Camera>(scr_size);
   }
   ~Program() {
+    placements.clear();
     model.reset();
+    dynamic_batcher.reset();
+    feedback.reset();
     camera.reset();
+    ModelCache::getInstance().free();
     mgr.free();
+    GeometryMgr::getInstance().free();
     glfwTerminate();
   }
   void push_back(std::shared_ptr<Light> &light) { light_src.push_back(light); }
   void set_light(std::shared_ptr<ShaderProgram> &program);
+  // 需要在Model创建之前调用，这样载入材质的时候diffuse贴图会烘焙成虚拟纹理
+  void enable_virtual_texture(std::string vertex,
+                              uint32_t slots_per_side = 16);
   void process();
   void run();
 };
@@ -0,0 +1,394 @@
+#include "obj_loader.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "thread_pool.h"
+namespace {
+// o/g和usemtl在第triangle个三角形之前生效
+struct Switch {
+  uint32_t triangle;
+  bool object;
+  std::string name;
+};
+struct Chunk {
+  std::vector<float> positions, texcoords, normals;
+  // 每个三角形三个角，每个角是(v, vt, vn)，从0开始，-1表示没有
+  std::vector<int32_t> corners;
+  // corners中写成负数下标的位置，合并时再加上之前各块的数量
+  std::vector<uint32_t> relative;
+  std::vector<Switch> switches;
+  std::vector<std::string> mtllibs;
+  size_t bad_lines = 0, bad_indices = 0;
+};
+struct ObjMaterial {
+  std::string diffuse, specular, normal, ambient;
+};
+bool space(char c) { return c == ' ' || c == '\t'; }
+const char *skip(const char *p, const char *end) {
+  while (p < end && space(*p))
+    p++;
+  return p;
+}
+// 关键字后面必须是空白
+bool keyword(const char *&p, const char *end, const char *word) {
+  size_t n = strlen(word);
+  if ((size_t)(end - p) <= n || memcmp(p, word, n) != 0 || !space(p[n]))
+    return false;
+  p += n;
+  return true;
+}
+// from_chars不接受前导的'+'
+template <typename T> bool number(const char *&p, const char *end, T &out) {
+  p = skip(p, end);
+  if (p < end && *p == '+')
+    p++;
+  auto r = std::from_chars(p, end, out);
+  if (r.ec != std::errc())
+    return false;
+  p = r.ptr;
+  return true;
+}
+// 去掉首尾空白
+std::string rest(const char *p, const char *end) {
+  p = skip(p, end);
+  while (end > p && space(end[-1]))
+    end--;
+  return std::string(p, end);
+}
+void parse_line(const char *p, const char *end, Chunk &c,
+                std::vector<int32_t> &polygon, std::vector<bool> &negative) {
+  p = skip(p, end);
+  if (p >= end || *p == '#')
+    return;
+  bool ok = true;
+  if (keyword(p, end, "v")) {
+    float x, y, z;
+    ok = number(p, end, x) && number(p, end, y) && number(p, end, z);
+    if (ok)
+      c.positions.insert(c.positions.end(), {x, y, z});
+  } else if (keyword(p, end, "vt")) {
+    // v可以省略，后面的w忽略
+    float u, v = 0.0f;
+    ok = number(p, end, u);
+    number(p, end, v);
+    if (ok)
+      c.texcoords.insert(c.texcoords.end(), {u, v});
+  } else if (keyword(p, end, "vn")) {
+    float x, y, z;
+    ok = number(p, end, x) && number(p, end, y) && number(p, end, z);
+    if (ok)
+      c.normals.insert(c.normals.end(), {x, y, z});
+  } else if (keyword(p, end, "f")) {
+    // v、v/vt、v//vn、v/vt/vn，负数相对于当前的数量
+    polygon.clear();
+    negative.clear();
+    size_t counts[3] = {c.positions.size() / 3, c.texcoords.size() / 2,
+                        c.normals.size() / 3};
+    while ((p = skip(p, end)) < end && ok) {
+      int32_t index[3] = {0, 0, 0};
+      ok = number(p, end, index[0]);
+      if (ok && p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/')
+          ok = number(p, end, index[1]);
+        if (ok && p < end && *p == '/') {
+          p++;
+          ok = number(p, end, index[2]);
+        }
+      }
+      for (int a = 0; a < 3; a++) {
+        polygon.push_back(index[a] > 0   ? index[a] - 1
+                          : index[a] < 0 ? (int32_t)counts[a] + index[a]
+                                         : -1);
+        negative.push_back(index[a] < 0);
+      }
+    }
+    ok = ok && polygon.size() >= 9;
+    // 按扇形三角化
+    size_t n = polygon.size() / 3;
+    for (size_t k = 1; ok && k + 1 < n; k++) {
+      for (size_t corner : {(size_t)0, k, k + 1}) {
+        for (int a = 0; a < 3; a++) {
+          if (negative[corner * 3 + a])
+            c.relative.push_back((uint32_t)c.corners.size());
+          c.corners.push_back(polygon[corner * 3 + a]);
+        }
+      }
+    }
+  } else if (keyword(p, end, "o") || keyword(p, end, "g")) {
+    c.switches.push_back(
+        {(uint32_t)(c.corners.size() / 9), true, rest(p, end)});
+  } else if (keyword(p, end, "usemtl")) {
+    c.switches.push_back(
+        {(uint32_t)(c.corners.size() / 9), false, rest(p, end)});
+  } else if (keyword(p, end, "mtllib")) {
+    c.mtllibs.push_back(rest(p, end));
+  }
+  // s、l、p和其他不认识的行忽略
+  c.bad_lines += !ok;
+}
+void parse_chunk(const char *p, const char *end, Chunk &c) {
+  std::vector<int32_t> polygon;
+  std::vector<bool> negative;
+  while (p < end) {
+    auto *eol = (const char *)memchr(p, '\n', end - p);
+    if (!eol)
+      eol = end;
+    const char *line_end = eol;
+    if (line_end > p && line_end[-1] == '\r')
+      line_end--;
+    parse_line(p, line_end, c, polygon, negative);
+    p = eol + 1;
+  }
+}
+// 贴图参数（-bm 1.0之类）在文件名前面，只取最后一个词
+std::string texture_name(const std::string &line) {
+  size_t last = line.find_last_of(" \t");
+  return last == std::string::npos ? line : line.substr(last + 1);
+}
+void parse_mtl(const std::string &filename,
+               std::map<std::string, ObjMaterial> &materials) {
+  std::ifstream stream(filename);
+  if (!stream.is_open()) {
+    std::cout << "ERROR::OBJ::Failed to open " << filename << std::endl;
+    return;
+  }
+  ObjMaterial *current = nullptr;
+  std::string line;
+  while (std::getline(stream, line)) {
+    const char *p = line.c_str(), *end = p + line.size();
+    if (end > p && end[-1] == '\r')
+      end--;
+    p = skip(p, end);
+    const char *word = p;
+    while (p < end && !space(*p))
+      p++;
+    std::string key(word, p);
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    std::string value = rest(p, end);
+    if (key == "newmtl") {
+      current = &materials[value];
+    } else if (!current || value.empty()) {
+      continue;
+    } else if (key == "map_kd") {
+      current->diffuse = texture_name(value);
+    } else if (key == "map_ks") {
+      current->specular = texture_name(value);
+    } else if (key == "map_bump" || key == "bump") {
+      current->normal = texture_name(value);
+    } else if (key == "map_ka") {
+      current->ambient = texture_name(value);
+    }
+  }
+}
+// 一个mesh在某一块里连续的一段三角形
+struct Run {
+  size_t chunk;
+  uint32_t first, count;
+};
+} // namespace
+bool is_obj(const std::string &path) {
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos)
+    return false;
+  std::string ext = path.substr(dot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  return ext == "obj";
+}
+bool load_obj(const std::string &path, std::vector<MeshData> &meshes,
+              SceneGraph &graph) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0)
+      close(fd);
+    std::cout << "ERROR::OBJ::Failed to open " << path << std::endl;
+    return false;
+  }
+  size_t size = st.st_size;
+  void *data = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                    : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED) {
+    std::cout << "ERROR::OBJ::Failed to map " << path << std::endl;
+    return false;
+  }
+  const char *text = (const char *)data, *text_end = text + size;
+  // 每块至少1MiB，块数是线程数的几倍，解析快慢不一时也能分得均匀
+  ThreadPool &pool = ThreadPool::getInstance();
+  size_t count = std::clamp<size_t>(size >> 20, 1, pool.size() * 4);
+  std::vector<const char *> bounds(count + 1, text_end);
+  bounds[0] = text;
+  for (size_t i = 1; i < count; i++) {
+    const char *p = std::max(text + size / count * i, bounds[i - 1]);
+    auto *eol = (const char *)memchr(p, '\n', text_end - p);
+    bounds[i] = eol ? eol + 1 : text_end;
+  }
+  std::vector<Chunk> chunks(count);
+  pool.parallel_for(count, [&](size_t i) {
+    parse_chunk(bounds[i], bounds[i + 1], chunks[i]);
+  });
+  munmap(data, size);
+  // 每块之前的v/vt/vn数量，补上负数下标后把所有块拼起来
+  std::vector<size_t> base[3];
+  size_t total[3] = {0, 0, 0};
+  for (auto &c : chunks) {
+    size_t counts[3] = {c.positions.size() / 3, c.texcoords.size() / 2,
+                        c.normals.size() / 3};
+    for (int a = 0; a < 3; a++) {
+      base[a].push_back(total[a]);
+      total[a] += counts[a];
+    }
+  }
+  std::vector<float> positions(total[0] * 3), texcoords(total[1] * 2),
+      normals(total[2] * 3);
+  pool.parallel_for(count, [&](size_t i) {
+    auto &c = chunks[i];
+    std::copy(c.positions.begin(), c.positions.end(),
+              positions.begin() + base[0][i] * 3);
+    std::copy(c.texcoords.begin(), c.texcoords.end(),
+              texcoords.begin() + base[1][i] * 2);
+    std::copy(c.normals.begin(), c.normals.end(),
+              normals.begin() + base[2][i] * 3);
+    std::vector<float>().swap(c.positions);
+    std::vector<float>().swap(c.texcoords);
+    std::vector<float>().swap(c.normals);
+    for (auto slot : c.relative)
+      c.corners[slot] += (int32_t)base[slot % 3][i];
+    for (size_t k = 0; k < c.corners.size(); k++) {
+      int64_t v = c.corners[k];
+      c.bad_indices += v < (k % 3 ? -1 : 0) || v >= (int64_t)total[k % 3];
+    }
+  });
+  size_t bad_lines = 0, bad_indices = 0;
+  for (auto &c : chunks) {
+    bad_lines += c.bad_lines;
+    bad_indices += c.bad_indices;
+  }
+  if (bad_indices) {
+    std::cout << "ERROR::OBJ::" << bad_indices << " indices out of range in "
+              << path << std::endl;
+    return false;
+  }
+  if (bad_lines)
+    std::cout << "ERROR::OBJ::Skipped " << bad_lines << " malformed lines in "
+              << path << std::endl;
+  // 按顺序重放o/g和usemtl，每个(物体, 材质)一个mesh
+  std::vector<std::string> objects, materials;
+  auto find = [](std::vector<std::string> &list, const std::string &name) {
+    auto it = std::find(list.begin(), list.end(), name);
+    if (it != list.end())
+      return (int)(it - list.begin());
+    list.push_back(name);
+    return (int)list.size() - 1;
+  };
+  std::map<std::pair<int, int>, size_t> lookup;
+  std::vector<std::pair<int, int>> keys;
+  std::vector<std::vector<Run>> runs;
+  int object = -1, material = -1;
+  for (size_t i = 0; i < count; i++) {
+    auto &c = chunks[i];
+    uint32_t start = 0;
+    auto flush = [&](uint32_t stop) {
+      if (stop > start) {
+        if (object < 0)
+          object = find(objects, "defaultobject");
+        auto key = std::make_pair(object, material);
+        auto it = lookup.find(key);
+        if (it == lookup.end()) {
+          it = lookup.emplace(key, keys.size()).first;
+          keys.push_back(key);
+          runs.emplace_back();
+        }
+        runs[it->second].push_back({i, start, stop - start});
+      }
+      start = stop;
+    };
+    for (auto &sw : c.switches) {
+      flush(sw.triangle);
+      if (sw.object)
+        object = find(objects, sw.name);
+      else
+        material = find(materials, sw.name);
+    }
+    flush((uint32_t)(c.corners.size() / 9));
+  }
+  std::map<std::string, ObjMaterial> library;
+  std::set<std::string> mtllibs;
+  std::string directory = path.substr(0, path.find_last_of('/'));
+  for (auto &c : chunks)
+    for (auto &name : c.mtllibs)
+      if (mtllibs.insert(name).second)
+        parse_mtl(directory + "/" + name, library);
+  std::string root = path.substr(path.find_last_of('/') + 1);
+  graph = SceneGraph();
+  graph.add(-1, glm::mat4(1.0f), root);
+  for (auto &name : objects)
+    graph.add(0, glm::mat4(1.0f), name);
+  // 用开放寻址的hash表按(v, vt, vn)去重，每个mesh一张表
+  meshes.assign(keys.size(), MeshData());
+  pool.parallel_for(keys.size(), [&](size_t m) {
+    MeshData &d = meshes[m];
+    size_t corners = 0;
+    for (auto &r : runs[m])
+      corners += r.count * 3;
+    size_t capacity = 16;
+    while (capacity < corners * 2)
+      capacity <<= 1;
+    std::vector<int32_t> table(capacity, -1);
+    std::vector<const int32_t *> unique;
+    d.indices.reserve(corners);
+    for (auto &r : runs[m]) {
+      const int32_t *c = chunks[r.chunk].corners.data() + r.first * 9;
+      for (size_t k = 0; k < r.count * 3; k++, c += 3) {
+        uint64_t h = (uint64_t)(uint32_t)c[0] * 0x9E3779B97F4A7C15ull ^
+                     (uint64_t)(uint32_t)c[1] * 0xC2B2AE3D27D4EB4Full ^
+                     (uint64_t)(uint32_t)c[2] * 0x165667B19E3779F9ull;
+        size_t slot = (h ^ h >> 32) & (capacity - 1);
+        while (table[slot] >= 0 && memcmp(unique[table[slot]], c, 12) != 0)
+          slot = (slot + 1) & (capacity - 1);
+        if (table[slot] < 0) {
+          table[slot] = (int32_t)unique.size();
+          unique.push_back(c);
+        }
+        d.indices.push_back((unsigned int)table[slot]);
+      }
+    }
+    d.vertices.resize(unique.size());
+    for (size_t k = 0; k < unique.size(); k++) {
+      const int32_t *c = unique[k];
+      Vertex &v = d.vertices[k];
+      v = Vertex{};
+      memcpy(&v.Position.x, &positions[c[0] * 3], sizeof(float) * 3);
+      // 和aiProcess_FlipUVs一致
+      if (c[1] >= 0)
+        v.TexCoords = glm::vec2(texcoords[c[1] * 2],
+                                1.0f - texcoords[c[1] * 2 + 1]);
+      if (c[2] >= 0)
+        memcpy(&v.Normal.x, &normals[c[2] * 3], sizeof(float) * 3);
+    }
+    int mat = keys[m].second;
+    auto it = mat >= 0 ? library.find(materials[mat]) : library.end();
+    if (it != library.end()) {
+      auto push = [](std::vector<std::string> &list, const std::string &n) {
+        if (!n.empty())
+          list.push_back(n);
+      };
+      push(d.diffuse, it->second.diffuse);
+      push(d.specular, it->second.specular);
+      push(d.normal, it->second.normal);
+      push(d.ambient, it->second.ambient);
+    }
+    d.node = 1 + keys[m].first;
+    d.bounds();
+  });
+  return true;
+}
@@ -0,0 +1,23 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+#include <string>
+#include <vector>
+#include "mesh_data.h"
+#include "scene_graph.h"
+/**
+ * @brief 并行的Wavefront OBJ/MTL解析，代替Assimp的OBJ导入
+ * 映射的文件按行切成若干块，每块在线程池上独立解析v/vt/vn和f，面直接按扇形
+ * 三角化。负数（相对）下标和o/g/usemtl的状态要知道之前的块才能确定，先各自记下
+ * 来，所有块解析完再按顺序补上。最后每个(物体, 材质)一个mesh，并行地按
+ * (v, vt, vn)三元组去重生成顶点。
+ *
+ * 输出和Assimp的aiProcess_Triangulate | aiProcess_FlipUVs一致：uv的v翻转，
+ * 没有法线时为0，不计算切线；map_Kd、map_Ks、map_Bump、map_Ka对应
+ * diffuse、specular、normal（aiTextureType_HEIGHT）、ambient。
+ * 节点层级是一个根节点，下面每个物体一个子节点。
+ */
+bool is_obj(const std::string &path);
+// 失败时输出错误并返回false，meshes的indices只有LOD0，还没有优化
+bool load_obj(const std::string &path, std::vector<MeshData> &meshes,
+              SceneGraph &graph);
+#endif
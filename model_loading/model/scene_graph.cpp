@@ -0,0 +1,48 @@
+#include "scene_graph.h"
+#include <algorithm>
+#include <iostream>
+uint32_t SceneGraph::add(int32_t parent, const glm::mat4 &local,
+                         std::string name) {
+  uint32_t node = parents.size();
+  // 父节点的子树必须正好结束在末尾，否则新节点会插进别人的子树
+  if (parent >= (int32_t)node ||
+      (parent >= 0 && subtree_end[parent] != node)) {
+    std::cout << "ERROR::SCENEGRAPH::Node " << name
+              << " is not added in pre-order" << std::endl;
+    return UINT32_MAX;
+  }
+  parents.push_back(parent);
+  subtree_end.push_back(node + 1);
+  locals.push_back(local);
+  worlds.push_back(parent >= 0 ? worlds[parent] * local : local);
+  names.push_back(std::move(name));
+  for (int32_t p = parent; p >= 0; p = parents[p])
+    subtree_end[p] = node + 1;
+  return node;
+}
+void SceneGraph::set_local(uint32_t node, const glm::mat4 &local) {
+  locals[node] = local;
+  dirty.push_back(node);
+}
+bool SceneGraph::update() {
+  if (dirty.empty())
+    return false;
+  std::sort(dirty.begin(), dirty.end());
+  uint32_t covered = 0;
+  for (uint32_t node : dirty) {
+    // 在前一个子树里面，已经算过了
+    if (node < covered)
+      continue;
+    for (uint32_t n = node; n < subtree_end[node]; n++) {
+      int32_t p = parents[n];
+      worlds[n] = p >= 0 ? worlds[p] * locals[n] : locals[n];
+    }
+    covered = subtree_end[node];
+  }
+  dirty.clear();
+  return true;
+}
+int32_t SceneGraph::find(const std::string &name) const {
+  auto it = std::find(names.begin(), names.end(), name);
+  return it == names.end() ? -1 : (int32_t)(it - names.begin());
+}
@@ -0,0 +1,92 @@
+#include "static_batch.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <tuple>
+#include "mesh_simplify.h"
+#include "meshlet.h"
+#include "thread_pool.h"
+static std::string material_key(const MeshData &m) {
+  std::string key;
+  for (auto *list : {&m.diffuse, &m.specular, &m.normal, &m.ambient}) {
+    for (auto &name : *list)
+      key += name + '\n';
+    key += '\0';
+  }
+  return key;
+}
+static glm::vec3 transform_direction(const glm::mat3 &m, glm::vec3 v) {
+  if (v == glm::vec3(0.0f))
+    return v;
+  return glm::normalize(m * v);
+}
+// 把一个mesh的LOD0变换之后追加到out
+static void append(MeshData &out, const MeshData &m, const glm::mat4 &world) {
+  glm::mat3 linear(world);
+  glm::mat3 normal = glm::transpose(glm::inverse(linear));
+  bool mirrored = glm::determinant(linear) < 0.0f;
+  uint32_t base = out.vertices.size();
+  for (auto v : m.vertices) {
+    v.Position = glm::vec3(world * glm::vec4(v.Position, 1.0f));
+    v.Normal = transform_direction(normal, v.Normal);
+    v.Tangent = transform_direction(linear, v.Tangent);
+    v.Bitangent = transform_direction(linear, v.Bitangent);
+    out.vertices.push_back(v);
+  }
+  size_t count = m.lods.empty() ? m.indices.size() : m.lods[0].index_count;
+  for (size_t i = 0; i + 2 < count; i += 3) {
+    out.indices.push_back(base + m.indices[i]);
+    out.indices.push_back(base + m.indices[i + (mirrored ? 2 : 1)]);
+    out.indices.push_back(base + m.indices[i + (mirrored ? 1 : 2)]);
+  }
+}
+std::vector<MeshData> build_static_batches(const std::vector<MeshData> &meshes,
+                                           const std::vector<glm::mat4> &world,
+                                           float cell_size) {
+  // (材质, 格子) -> mesh下标，map保证同一材质的组相邻
+  std::map<std::tuple<std::string, int, int, int>, std::vector<size_t>> groups;
+  for (size_t i = 0; i < meshes.size(); i++) {
+    auto &m = meshes[i];
+    if (m.vertices.empty())
+      continue;
+    glm::vec3 lo(INFINITY), hi(-INFINITY);
+    for (int c = 0; c < 8; c++) {
+      glm::vec3 corner(c & 1 ? m.max.x : m.min.x, c & 2 ? m.max.y : m.min.y,
+                       c & 4 ? m.max.z : m.min.z);
+      glm::vec3 p = glm::vec3(world[i] * glm::vec4(corner, 1.0f));
+      lo = glm::min(lo, p);
+      hi = glm::max(hi, p);
+    }
+    glm::ivec3 cell = glm::ivec3(glm::floor((lo + hi) * 0.5f / cell_size));
+    groups[{material_key(m), cell.x, cell.y, cell.z}].push_back(i);
+  }
+  std::vector<MeshData> batches;
+  for (auto &[key, list] : groups) {
+    auto &first = meshes[list[0]];
+    size_t start = batches.size();
+    for (auto i : list) {
+      auto &m = meshes[i];
+      if (batches.size() == start ||
+          batches.back().vertices.size() + m.vertices.size() >
+              STATIC_BATCH_MAX_VERTICES) {
+        batches.emplace_back();
+        auto &b = batches.back();
+        b.diffuse = first.diffuse;
+        b.specular = first.specular;
+        b.normal = first.normal;
+        b.ambient = first.ambient;
+        b.node = STATIC_BATCH_NODE;
+      }
+      append(batches.back(), m, world[i]);
+    }
+  }
+  ThreadPool::getInstance().parallel_for(batches.size(), [&](size_t i) {
+    auto &b = batches[i];
+    b.bounds();
+    b.meshlets = build_meshlets(b.vertices.data(), b.vertices.size(),
+                                b.indices.data(), b.indices.size());
+    build_lod_chain(b);
+  });
+  return batches;
+}
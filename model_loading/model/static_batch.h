@@ -0,0 +1,22 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "mesh_data.h"
+/**
+ * @brief 不会移动的mesh预先变换到世界空间，按材质和空间位置合并
+ * 贴图完全相同的mesh按世界空间包围盒中心所在的格子分组，同一组依次拼在一起，
+ * 超过65536个顶点时另起一块，合并之后仍然使用16位index。按格子分开是为了
+ * 合并后的包围盒不至于覆盖整个场景，LOD选择和剔除依然有效。
+ * 法线用逆转置矩阵变换，镜像变换（行列式为负）时翻转三角形的绕序。
+ * 输出的mesh重新建立meshlet和LOD，node为STATIC_BATCH_NODE，不再跟随节点移动。
+ */
+constexpr uint32_t STATIC_BATCH_NODE = UINT32_MAX;
+constexpr size_t STATIC_BATCH_MAX_VERTICES = 65536;
+// meshes只使用LOD0，world是每个mesh的世界矩阵
+std::vector<MeshData> build_static_batches(const std::vector<MeshData> &meshes,
+                                           const std::vector<glm::mat4> &world,
+                                           float cell_size);
+#endif
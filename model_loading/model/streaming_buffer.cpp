@@ -0,0 +1,57 @@
+#include "streaming_buffer.h"
+#include <iostream>
+// 每段的起点按256字节对齐，段内对齐的偏移在整个buffer里也是对齐的
+StreamingBuffer::StreamingBuffer(size_t bytes_per_frame)
+    : region_size((bytes_per_frame + 255) & ~(size_t)255) {
+  GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, bytes(), nullptr, flags);
+  mapped = (unsigned char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bytes(),
+                                             flags);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  if (!mapped)
+    std::cout << "ERROR::STREAMING_BUFFER::Failed to map " << bytes()
+              << " bytes" << std::endl;
+}
+StreamingBuffer::~StreamingBuffer() {
+  for (auto &f : fences)
+    if (f)
+      glDeleteSync(f);
+  if (mapped) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &buffer);
+}
+void StreamingBuffer::begin() {
+  used = 0;
+  GLsync &fence = fences[region];
+  if (!fence)
+    return;
+  // 先不等待地查询一次，只有真的没完成时才刷新命令并阻塞
+  GLenum state = glClientWaitSync(fence, 0, 0);
+  if (state == GL_TIMEOUT_EXPIRED) {
+    stalls++;
+    do {
+      state = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    } while (state == GL_TIMEOUT_EXPIRED);
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+void *StreamingBuffer::allocate(size_t bytes, size_t align, size_t &offset) {
+  size_t start = (used + align - 1) / align * align;
+  if (!mapped || start + bytes > region_size)
+    return nullptr;
+  used = start + bytes;
+  offset = region * region_size + start;
+  return mapped + offset;
+}
+void StreamingBuffer::end() {
+  if (used)
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  region = (region + 1) % STREAMING_REGIONS;
+}
@@ -0,0 +1,36 @@
+#ifndef STREAMING_BUFFER_H
+#define STREAMING_BUFFER_H
+#include <cstddef>
+#include "glad/gl.h"
+/**
+ * @brief 每帧重写的数据用的环形buffer
+ * glBufferStorage分配一块持久、一致映射的buffer，分成STREAMING_REGIONS段，每帧
+ * 写一段。end在这一段的绘制命令之后插入fence，再次轮到这一段时begin先等fence，
+ * GPU读完之前CPU不会覆盖。段数大于驱动排队的帧数时几乎不会真正等待，
+ * glBufferSubData和glMapBuffer那样的隐式同步也就不存在了。
+ */
+constexpr size_t STREAMING_REGIONS = 3;
+class StreamingBuffer {
+  unsigned int buffer = 0;
+  unsigned char *mapped = nullptr;
+  size_t region_size;
+  GLsync fences[STREAMING_REGIONS] = {};
+  size_t region = 0, used = 0;
+
+public:
+  // begin时fence还没有signal，需要等待的次数
+  size_t stalls = 0;
+  explicit StreamingBuffer(size_t bytes_per_frame);
+  StreamingBuffer(const StreamingBuffer &) = delete;
+  void operator=(const StreamingBuffer &) = delete;
+  ~StreamingBuffer();
+  // 每帧写之前调用，等待当前段上一次的绘制完成
+  void begin();
+  // 在当前段分配，offset是相对于整个buffer的字节偏移，空间不够时返回nullptr
+  void *allocate(size_t bytes, size_t align, size_t &offset);
+  // 这一帧的绘制命令都提交之后调用
+  void end();
+  unsigned int id() const { return buffer; }
+  size_t bytes() const { return region_size * STREAMING_REGIONS; }
+};
+#endif
@@ -0,0 +1,98 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+/*
+  全局的工作线程池，和TextureMgr一样用getInstance获取。
+  只做CPU上的工作，所有gl调用仍然必须留在有context的主线程。
+*/
+class ThreadPool {
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex lock;
+  std::condition_variable cv;
+  bool quit = false;
+  ThreadPool(unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+      workers.emplace_back([this] {
+        while (true) {
+          std::function<void()> task;
+          {
+            std::unique_lock<std::mutex> guard(lock);
+            cv.wait(guard, [this] { return quit || !tasks.empty(); });
+            if (quit && tasks.empty())
+              return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+          }
+          task();
+        }
+      });
+    }
+  }
+  ThreadPool(ThreadPool &) = delete;
+  void operator=(ThreadPool const &) = delete;
+
+public:
+  static ThreadPool &getInstance() {
+    static ThreadPool stance(std::max(1u, std::thread::hardware_concurrency()));
+    return stance;
+  }
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      quit = true;
+    }
+    cv.notify_all();
+    for (auto &w : workers) {
+      w.join();
+    }
+  }
+  size_t size() const { return workers.size(); }
+  void push(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      tasks.push_back(std::move(task));
+    }
+    cv.notify_one();
+  }
+  // 对[0, n)并行调用fn，调用线程也参与工作，全部完成后返回
+  void parallel_for(size_t n, const std::function<void(size_t)> &fn) {
+    if (n == 0)
+      return;
+    // 晚启动的worker可能在函数返回之后才运行，状态不能放在栈上
+    struct State {
+      std::atomic<size_t> next = 0;
+      std::atomic<size_t> finished = 0;
+      std::mutex lock;
+      std::condition_variable done;
+    };
+    auto state = std::make_shared<State>();
+    const std::function<void(size_t)> *work = &fn;
+    auto run = [state, work, n] {
+      size_t i;
+      while ((i = state->next++) < n) {
+        (*work)(i);
+        if (++state->finished == n) {
+          std::lock_guard<std::mutex> guard(state->lock);
+          state->done.notify_all();
+        }
+      }
+    };
+    size_t helpers = std::min(n - 1, workers.size());
+    for (size_t i = 0; i < helpers; i++) {
+      push(run);
+    }
+    run();
+    std::unique_lock<std::mutex> guard(state->lock);
+    state->done.wait(guard, [&] { return state->finished == n; });
+  }
+};
+#endif
@@ -0,0 +1,112 @@
+#ifndef VERTEX_QUANT_H
+#define VERTEX_QUANT_H
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include "mesh_data.h"
+/**
+ * @brief 压缩顶点格式
+ * Vertex有88字节，大部分模型用不到骨骼，法线也不需要32位精度。
+ *   位置：相对mesh包围盒的归一化int16，w分量保存bitangent的方向
+ *   法线/切线：八面体映射后的snorm16
+ *   UV：half float
+ * 一共20字节，解码参数(包围盒中心和半长)通过每个mesh的uniform传入。
+ * 骨骼数据只有mesh真的有权重时才生成（QuantizedMesh::skin），上传到共享几何
+ * 缓冲时和顶点交错成32字节的QuantizedSkinnedVertex，和没有骨骼的mesh分开放。
+ */
+enum class VertexFormat { Full, Quantized };
+struct QuantizedVertex {
+  int16_t position[4];
+  int16_t normal[2];
+  int16_t tangent[2];
+  uint16_t uv[2];
+};
+struct QuantizedSkin {
+  uint16_t ids[MAX_BONE_INFLUENCE];
+  uint8_t weights[MAX_BONE_INFLUENCE];
+};
+// 进入共享几何缓冲时骨骼数据和顶点交错存放
+struct QuantizedSkinnedVertex {
+  QuantizedVertex vertex;
+  QuantizedSkin skin;
+};
+struct QuantizedMesh {
+  std::vector<QuantizedVertex> vertices;
+  std::vector<QuantizedSkin> skin; // 没有骨骼时为空
+  glm::vec3 offset = glm::vec3(0.0f); // 解码：position * scale + offset
+  glm::vec3 scale = glm::vec3(1.0f);
+};
+inline int16_t quantize_snorm16(float v) {
+  return (int16_t)std::lround(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+// 八面体映射，输入需要是单位向量
+inline glm::vec2 oct_encode(glm::vec3 n) {
+  float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (l1 == 0.0f)
+    return glm::vec2(0.0f);
+  glm::vec2 p = glm::vec2(n.x, n.y) / l1;
+  if (n.z < 0.0f) {
+    p = glm::vec2((1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+                  (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+  }
+  return p;
+}
+inline glm::vec3 oct_decode(glm::vec2 e) {
+  glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+  if (n.z < 0.0f) {
+    float x = n.x;
+    n.x = (1.0f - std::abs(n.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    n.y = (1.0f - std::abs(x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+  }
+  return glm::normalize(n);
+}
+inline QuantizedMesh quantize(const Vertex *vertices, size_t count) {
+  QuantizedMesh out;
+  if (count == 0)
+    return out;
+  glm::vec3 min = vertices[0].Position, max = vertices[0].Position;
+  bool skinned = false;
+  for (size_t i = 0; i < count; i++) {
+    min = glm::min(min, vertices[i].Position);
+    max = glm::max(max, vertices[i].Position);
+    for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+      skinned |= vertices[i].m_Weights[j] > 0.0f;
+  }
+  out.offset = (min + max) * 0.5f;
+  out.scale = glm::max((max - min) * 0.5f, glm::vec3(1e-8f));
+  out.vertices.resize(count);
+  if (skinned)
+    out.skin.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    const Vertex &v = vertices[i];
+    QuantizedVertex &q = out.vertices[i];
+    glm::vec3 p = (v.Position - out.offset) / out.scale;
+    q.position[0] = quantize_snorm16(p.x);
+    q.position[1] = quantize_snorm16(p.y);
+    q.position[2] = quantize_snorm16(p.z);
+    // bitangent = cross(normal, tangent) * w
+    float handed =
+        glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -1.0f
+                                                                      : 1.0f;
+    q.position[3] = quantize_snorm16(handed);
+    glm::vec2 n = oct_encode(v.Normal);
+    glm::vec2 t = oct_encode(v.Tangent);
+    q.normal[0] = quantize_snorm16(n.x);
+    q.normal[1] = quantize_snorm16(n.y);
+    q.tangent[0] = quantize_snorm16(t.x);
+    q.tangent[1] = quantize_snorm16(t.y);
+    q.uv[0] = glm::packHalf1x16(v.TexCoords.x);
+    q.uv[1] = glm::packHalf1x16(v.TexCoords.y);
+    if (skinned) {
+      for (int j = 0; j < MAX_BONE_INFLUENCE; j++) {
+        out.skin[i].ids[j] = v.m_BoneIDs[j] < 0 ? 0 : v.m_BoneIDs[j];
+        out.skin[i].weights[j] = (uint8_t)std::lround(
+            glm::clamp(v.m_Weights[j], 0.0f, 1.0f) * 255.0f);
+      }
+    }
+  }
+  return out;
+}
+#endif
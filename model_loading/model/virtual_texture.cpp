@@ -0,0 +1,559 @@
+#include "virtual_texture.h"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include "stb_image.h"
+/*
+  烘焙：原图补成边长为page_size*2^k的正方形，补出来的部分复制边缘像素，
+  然后逐级box filter生成mip，每一级切成带border的page写入文件
+*/
+bool bake_virtual_texture(const std::string &image, const std::string &out,
+                          uint32_t page_size, uint32_t border) {
+  int width, height, channels;
+  // 在线程池上烘焙，翻转设置用线程局部的
+  stbi_set_flip_vertically_on_load_thread(true);
+  unsigned char *data = stbi_load(image.c_str(), &width, &height, &channels, 4);
+  if (!data) {
+    std::cout << "ERROR::VTEX::Failed to load " << image << std::endl;
+    return false;
+  }
+  uint32_t pages = 1;
+  while (pages * page_size < (uint32_t)std::max(width, height))
+    pages <<= 1;
+  uint32_t size = pages * page_size;
+  std::vector<unsigned char> level(size * size * 4);
+  for (uint32_t y = 0; y < size; y++) {
+    uint32_t sy = std::min<uint32_t>(y, height - 1);
+    for (uint32_t x = 0; x < size; x++) {
+      uint32_t sx = std::min<uint32_t>(x, width - 1);
+      memcpy(&level[(y * size + x) * 4], &data[(sy * width + sx) * 4], 4);
+    }
+  }
+  stbi_image_free(data);
+  VtexHeader header = {};
+  memcpy(header.magic, "VTEX", 4);
+  header.version = VTEX_VERSION;
+  header.width = width;
+  header.height = height;
+  header.page_size = page_size;
+  header.border = border;
+  header.pages_x = header.pages_y = pages;
+  header.levels = 0;
+  for (uint32_t p = pages; p > 0; p >>= 1)
+    header.levels++;
+  size_t total = 0;
+  for (uint32_t l = 0; l < header.levels; l++)
+    total += (size_t)(pages >> l) * (pages >> l);
+  // 先写临时文件再rename，别的线程不会打开写到一半的.vtex
+  std::string tmp = out + ".tmp";
+  std::ofstream stream(tmp, std::ios::binary);
+  if (!stream.is_open()) {
+    std::cout << "ERROR::VTEX::Failed to open " << tmp << std::endl;
+    return false;
+  }
+  std::vector<uint64_t> offsets(total);
+  stream.write((const char *)&header, sizeof(header));
+  stream.write((const char *)offsets.data(), sizeof(uint64_t) * total);
+  uint32_t tile = page_size + 2 * border;
+  std::vector<unsigned char> pixels(tile * tile * 4);
+  size_t index = 0;
+  for (uint32_t l = 0; l < header.levels; l++) {
+    uint32_t count = pages >> l;
+    uint32_t lsize = size >> l;
+    for (uint32_t py = 0; py < count; py++) {
+      for (uint32_t px = 0; px < count; px++) {
+        for (uint32_t y = 0; y < tile; y++) {
+          int sy = std::clamp<int>((int)(py * page_size + y) - (int)border, 0,
+                                  lsize - 1);
+          for (uint32_t x = 0; x < tile; x++) {
+            int sx = std::clamp<int>((int)(px * page_size + x) - (int)border,
+                                     0, lsize - 1);
+            memcpy(&pixels[(y * tile + x) * 4], &level[(sy * lsize + sx) * 4],
+                   4);
+          }
+        }
+        offsets[index++] = stream.tellp();
+        stream.write((const char *)pixels.data(), pixels.size());
+      }
+    }
+    if (l + 1 == header.levels)
+      break;
+    uint32_t half = lsize / 2;
+    std::vector<unsigned char> next(half * half * 4);
+    for (uint32_t y = 0; y < half; y++) {
+      for (uint32_t x = 0; x < half; x++) {
+        for (uint32_t c = 0; c < 4; c++) {
+          unsigned sum = level[((2 * y) * lsize + 2 * x) * 4 + c] +
+                         level[((2 * y) * lsize + 2 * x + 1) * 4 + c] +
+                         level[((2 * y + 1) * lsize + 2 * x) * 4 + c] +
+                         level[((2 * y + 1) * lsize + 2 * x + 1) * 4 + c];
+          next[(y * half + x) * 4 + c] = (sum + 2) / 4;
+        }
+      }
+    }
+    level = std::move(next);
+  }
+  stream.seekp(sizeof(header));
+  stream.write((const char *)offsets.data(), sizeof(uint64_t) * total);
+  stream.close();
+  if (!stream.good() || rename(tmp.c_str(), out.c_str()) != 0) {
+    std::cout << "ERROR::VTEX::Failed to write " << out << std::endl;
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+VirtualTextureFile::VirtualTextureFile(const std::string &_filename)
+    : filename(_filename) {
+  fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, "VTEX", 4) != 0 || header.version != VTEX_VERSION ||
+      header.levels == 0 || header.levels > 11) {
+    std::cout << "ERROR::VTEX::Bad header " << filename << std::endl;
+    close(fd);
+    fd = -1;
+    return;
+  }
+  size_t total = 0;
+  for (uint32_t l = 0; l < header.levels; l++) {
+    level_offset.push_back(total);
+    total += (size_t)pages_x(l) * pages_y(l);
+  }
+  offsets.resize(total);
+  ssize_t bytes = sizeof(uint64_t) * total;
+  if (pread(fd, offsets.data(), bytes, sizeof(header)) != bytes) {
+    close(fd);
+    fd = -1;
+  }
+}
+VirtualTextureFile::~VirtualTextureFile() {
+  if (fd >= 0)
+    close(fd);
+}
+bool VirtualTextureFile::read_page(uint32_t level, uint32_t x, uint32_t y,
+                                   std::vector<unsigned char> &pixels) const {
+  if (level >= header.levels || x >= pages_x(level) || y >= pages_y(level))
+    return false;
+  ssize_t bytes = tile_size() * tile_size() * 4;
+  pixels.resize(bytes);
+  uint64_t offset = offsets[level_offset[level] + y * pages_x(level) + x];
+  return pread(fd, pixels.data(), bytes, offset) == bytes;
+}
+PageLoader::PageLoader() : worker(&PageLoader::loop, this) {}
+PageLoader::~PageLoader() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    quit = true;
+  }
+  cv.notify_all();
+  worker.join();
+}
+void PageLoader::request(uint32_t key,
+                         std::shared_ptr<VirtualTextureFile> file) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    requests.push_back({key, std::move(file)});
+  }
+  cv.notify_one();
+}
+void PageLoader::loop() {
+  while (true) {
+    Request r;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      cv.wait(guard, [this] { return quit || !requests.empty(); });
+      if (quit)
+        return;
+      r = std::move(requests.front());
+      requests.pop_front();
+    }
+    Loaded l;
+    l.key = r.key;
+    if (!r.file->read_page(vt_key_level(r.key), vt_key_x(r.key),
+                           vt_key_y(r.key), l.pixels))
+      l.pixels.clear();
+    std::lock_guard<std::mutex> guard(lock);
+    done.push_back(std::move(l));
+  }
+}
+VirtualTexture::VirtualTexture(uint32_t _id,
+                               std::shared_ptr<VirtualTextureFile> _file)
+    : file(std::move(_file)), id(_id) {
+  auto &h = file->header;
+  glGenTextures(1, &indirection);
+  glBindTexture(GL_TEXTURE_2D, indirection);
+  glTexStorage2D(GL_TEXTURE_2D, h.levels, GL_RGBA8, h.pages_x, h.pages_y);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  for (uint32_t l = 0; l < h.levels; l++) {
+    size_t count = (size_t)file->pages_x(l) * file->pages_y(l);
+    page_table.emplace_back(count, -1);
+    indirection_data.emplace_back(count, 0);
+  }
+}
+VirtualTexture::~VirtualTexture() {
+  glDeleteTextures(1, &indirection);
+  if (sparse)
+    glDeleteTextures(1, &sparse);
+}
+glm::vec4 VirtualTexture::info() const {
+  auto &h = file->header;
+  return glm::vec4(h.pages_x, h.pages_y, h.levels, h.page_size);
+}
+glm::vec2 VirtualTexture::scale() const {
+  auto &h = file->header;
+  return glm::vec2((float)h.width / (h.pages_x * h.page_size),
+                   (float)h.height / (h.pages_y * h.page_size));
+}
+VirtualTextureSystem::VirtualTextureSystem(uint32_t _slots_per_side)
+    : slots_per_side(_slots_per_side) {
+  slots.resize(slots_per_side * slots_per_side);
+  use_sparse = GLAD_GL_ARB_sparse_texture;
+  loader = std::make_unique<PageLoader>();
+}
+VirtualTextureSystem::~VirtualTextureSystem() {
+  loader.reset();
+  textures.clear();
+  if (physical)
+    glDeleteTextures(1, &physical);
+  release_feedback();
+}
+void VirtualTextureSystem::release_feedback() {
+  if (!feedback_fbo)
+    return;
+  glDeleteFramebuffers(1, &feedback_fbo);
+  glDeleteTextures(1, &feedback_color);
+  glDeleteRenderbuffers(1, &feedback_depth);
+  glDeleteBuffers(VT_FEEDBACK_FRAMES, feedback_pbo);
+  for (auto &fence : feedback_fences) {
+    if (fence)
+      glDeleteSync(fence);
+    fence = nullptr;
+  }
+  feedback_fbo = 0;
+}
+std::shared_ptr<VirtualTexture>
+VirtualTextureSystem::load(std::shared_ptr<VirtualTextureFile> file,
+                           std::vector<unsigned char> &top_page) {
+  if (textures.size() >= 255) {
+    std::cout << "ERROR::VTEX::Too many virtual textures" << std::endl;
+    return nullptr;
+  }
+  if (textures.empty()) {
+    page_size = file->header.page_size;
+    border = file->header.border;
+  } else if (page_size != file->header.page_size ||
+             border != file->header.border) {
+    std::cout << "ERROR::VTEX::Page size mismatch " << file->filename
+              << std::endl;
+    return nullptr;
+  }
+  auto vt = std::make_shared<VirtualTexture>(textures.size(), file);
+  if (use_sparse)
+    create_sparse(*vt);
+  if (!use_sparse && !physical) {
+    uint32_t size = slots_per_side * file->tile_size();
+    glGenTextures(1, &physical);
+    glBindTexture(GL_TEXTURE_2D, physical);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, size, size);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  textures.push_back(vt);
+  // 最粗的一级只有一个page，常驻，保证任何位置都有可以采样的数据
+  uint32_t top = file->header.levels - 1;
+  upload(vt_page_key(vt->id, top, 0, 0), top_page);
+  int slot = vt->page_table[top][0];
+  if (slot >= 0)
+    slots[slot].pinned = true;
+  rebuild_indirection(*vt);
+  return vt;
+}
+/*
+  sparse模式：每张虚拟纹理一张稀疏纹理，硬件page必须能整除我们的page
+*/
+void VirtualTextureSystem::create_sparse(VirtualTexture &vt) {
+  auto &h = vt.header();
+  int px = 0, py = 0;
+  glGetInternalformativ(GL_TEXTURE_2D, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_X_ARB, 1,
+                        &px);
+  glGetInternalformativ(GL_TEXTURE_2D, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_Y_ARB, 1,
+                        &py);
+  if (px <= 0 || py <= 0 || h.page_size % px || h.page_size % py) {
+    std::cout << "VTEX: sparse page " << px << "x" << py
+              << " does not match, use indirection fallback" << std::endl;
+    use_sparse = false;
+    return;
+  }
+  glGenTextures(1, &vt.sparse);
+  glBindTexture(GL_TEXTURE_2D, vt.sparse);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+  glTexParameteri(GL_TEXTURE_2D, GL_VIRTUAL_PAGE_SIZE_INDEX_ARB, 0);
+  // 只采样一个level，不会读到下一级可能没有commit的page
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, h.levels - 1);
+  glTexStorage2D(GL_TEXTURE_2D, h.levels, GL_RGBA8, h.pages_x * h.page_size,
+                 h.pages_y * h.page_size);
+  glGetTexParameteriv(GL_TEXTURE_2D, GL_NUM_SPARSE_LEVELS_ARB,
+                      &vt.sparse_levels);
+  for (uint32_t l = vt.sparse_levels; l < h.levels; l++) {
+    GLsizei w = (h.pages_x * h.page_size) >> l;
+    GLsizei ht = (h.pages_y * h.page_size) >> l;
+    glTexPageCommitmentARB(GL_TEXTURE_2D, l, 0, 0, 0, w, ht, 1, GL_TRUE);
+  }
+}
+int VirtualTextureSystem::find_slot() {
+  int best = -1;
+  for (size_t i = 0; i < slots.size(); i++) {
+    Slot &s = slots[i];
+    if (s.key == VT_NO_PAGE)
+      return i;
+    if (s.pinned || s.last_used == frame)
+      continue;
+    if (best < 0 || s.last_used < slots[best].last_used)
+      best = i;
+  }
+  if (best >= 0)
+    evict(slots[best]);
+  return best;
+}
+void VirtualTextureSystem::evict(Slot &slot) {
+  auto &vt = *textures[vt_key_tex(slot.key)];
+  uint32_t level = vt_key_level(slot.key);
+  uint32_t x = vt_key_x(slot.key), y = vt_key_y(slot.key);
+  vt.page_table[level][y * vt.file->pages_x(level) + x] = -1;
+  if (use_sparse && (int)level < vt.sparse_levels) {
+    glBindTexture(GL_TEXTURE_2D, vt.sparse);
+    glTexPageCommitmentARB(GL_TEXTURE_2D, level, x * page_size, y * page_size,
+                           0, page_size, page_size, 1, GL_FALSE);
+  }
+  vt.dirty = true;
+  slot.key = VT_NO_PAGE;
+}
+void VirtualTextureSystem::upload(uint32_t key,
+                                  std::vector<unsigned char> &pixels) {
+  pending.erase(key);
+  if (pixels.empty() || vt_key_tex(key) >= textures.size())
+    return;
+  auto &vt = *textures[vt_key_tex(key)];
+  uint32_t level = vt_key_level(key);
+  uint32_t x = vt_key_x(key), y = vt_key_y(key);
+  int &entry = vt.page_table[level][y * vt.file->pages_x(level) + x];
+  if (entry >= 0)
+    return;
+  int slot = find_slot();
+  if (slot < 0)
+    return;
+  uint32_t tile = vt.file->tile_size();
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (use_sparse) {
+    glBindTexture(GL_TEXTURE_2D, vt.sparse);
+    if ((int)level < vt.sparse_levels)
+      glTexPageCommitmentARB(GL_TEXTURE_2D, level, x * page_size,
+                             y * page_size, 0, page_size, page_size, 1,
+                             GL_TRUE);
+    // 只上传page内部，border是给indirection模式的双线性过滤用的
+    GLsizei w = std::min<GLsizei>(page_size, (vt.header().pages_x * page_size) >> level);
+    GLsizei h = std::min<GLsizei>(page_size, (vt.header().pages_y * page_size) >> level);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, tile);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, border);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, border);
+    glTexSubImage2D(GL_TEXTURE_2D, level, x * page_size, y * page_size, w, h,
+                    GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+  } else {
+    glBindTexture(GL_TEXTURE_2D, physical);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % slots_per_side) * tile,
+                    (slot / slots_per_side) * tile, tile, tile, GL_RGBA,
+                    GL_UNSIGNED_BYTE, pixels.data());
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  entry = slot;
+  slots[slot].key = key;
+  slots[slot].last_used = frame;
+  slots[slot].pinned = false;
+  vt.dirty = true;
+}
+/*
+  从最粗的level往下，不在显存中的page使用父page的映射
+*/
+void VirtualTextureSystem::rebuild_indirection(VirtualTexture &vt) {
+  auto &h = vt.header();
+  glBindTexture(GL_TEXTURE_2D, vt.indirection);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for (int l = h.levels - 1; l >= 0; l--) {
+    uint32_t w = vt.file->pages_x(l), ht = vt.file->pages_y(l);
+    for (uint32_t y = 0; y < ht; y++) {
+      for (uint32_t x = 0; x < w; x++) {
+        int slot = vt.page_table[l][y * w + x];
+        uint32_t &out = vt.indirection_data[l][y * w + x];
+        if (slot >= 0) {
+          out = (slot % slots_per_side) | ((slot / slots_per_side) << 8) |
+                (l << 16) | (0xffu << 24);
+        } else if (l + 1 < (int)h.levels) {
+          uint32_t pw = vt.file->pages_x(l + 1);
+          out = vt.indirection_data[l + 1][(y / 2) * pw + x / 2];
+        } else {
+          out = 0;
+        }
+      }
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, w, ht, GL_RGBA, GL_UNSIGNED_BYTE,
+                    vt.indirection_data[l].data());
+  }
+  vt.dirty = false;
+}
+void VirtualTextureSystem::begin_feedback(glm::ivec2 scr_size) {
+  glm::ivec2 size = glm::max(scr_size / 8, glm::ivec2(1));
+  if (size != feedback_size) {
+    // 尺寸变了，还没读回的几帧直接丢掉
+    release_feedback();
+    feedback_size = size;
+    glGenFramebuffers(1, &feedback_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo);
+    glGenTextures(1, &feedback_color);
+    glBindTexture(GL_TEXTURE_2D, feedback_color);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, size.x, size.y);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           feedback_color, 0);
+    glGenRenderbuffers(1, &feedback_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedback_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.x,
+                          size.y);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, feedback_depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      std::cout << "ERROR::VTEX::Feedback framebuffer incomplete" << std::endl;
+    glGenBuffers(VT_FEEDBACK_FRAMES, feedback_pbo);
+    for (auto pbo : feedback_pbo) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+      glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(uint32_t) * size.x * size.y,
+                   nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedback_head = 0;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo);
+  glViewport(0, 0, size.x, size.y);
+  GLuint clear[4] = {VT_NO_PAGE, 0, 0, 0};
+  glClearBufferuiv(GL_COLOR, 0, clear);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+void VirtualTextureSystem::end_feedback(glm::ivec2 scr_size) {
+  size_t pixels = (size_t)feedback_size.x * feedback_size.y;
+  // 写入环里最旧的一格，它上次的读回如果还没完成就放弃
+  GLsync &fence = feedback_fences[feedback_head];
+  if (fence) {
+    feedback_dropped++;
+    glDeleteSync(fence);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbo[feedback_head]);
+  glReadPixels(0, 0, feedback_size.x, feedback_size.y, GL_RED_INTEGER,
+               GL_UNSIGNED_INT, nullptr);
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  feedback_head = (feedback_head + 1) % VT_FEEDBACK_FRAMES;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, scr_size.x, scr_size.y);
+  // 下一格是VT_FEEDBACK_FRAMES - 1帧之前写的，只在已经完成时映射
+  GLsync &oldest = feedback_fences[feedback_head];
+  if (oldest && glClientWaitSync(oldest, 0, 0) != GL_TIMEOUT_EXPIRED) {
+    glDeleteSync(oldest);
+    oldest = nullptr;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbo[feedback_head]);
+    auto *mapped = (const uint32_t *)glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, sizeof(uint32_t) * pixels, GL_MAP_READ_BIT);
+    if (mapped) {
+      feedback_pixels.assign(mapped, mapped + pixels);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      request_pages(feedback_pixels);
+    }
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+void VirtualTextureSystem::request_pages(std::vector<uint32_t> &keys) {
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  // 父page一直到最粗的一级也都需要：缺页时indirection退回到父page，
+  // sparse模式下没有commit的父page采样出来是未定义的数据
+  for (size_t i = 0, n = keys.size(); i < n; i++) {
+    uint32_t key = keys[i];
+    if (key == VT_NO_PAGE || vt_key_tex(key) >= textures.size())
+      continue;
+    uint32_t levels = textures[vt_key_tex(key)]->header().levels;
+    for (uint32_t l = vt_key_level(key) + 1, s = 1; l < levels; l++, s++)
+      keys.push_back(vt_page_key(vt_key_tex(key), l, vt_key_x(key) >> s,
+                                 vt_key_y(key) >> s));
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  // 粗的level先请求，这样缺页的时候能尽快有一个模糊的版本
+  std::sort(keys.begin(), keys.end(), [](uint32_t a, uint32_t b) {
+    return vt_key_level(a) > vt_key_level(b);
+  });
+  for (uint32_t key : keys) {
+    if (key == VT_NO_PAGE || vt_key_tex(key) >= textures.size())
+      continue;
+    auto &vt = *textures[vt_key_tex(key)];
+    uint32_t level = vt_key_level(key);
+    uint32_t x = vt_key_x(key), y = vt_key_y(key);
+    if (level >= vt.header().levels || x >= vt.file->pages_x(level) ||
+        y >= vt.file->pages_y(level))
+      continue;
+    // 父page已经在keys里面，各自标记为这一帧使用过
+    int slot = vt.page_table[level][y * vt.file->pages_x(level) + x];
+    if (slot >= 0)
+      slots[slot].last_used = frame;
+    if (slot < 0 && !pending.contains(key)) {
+      pending[key] = frame;
+      loader->request(key, vt.file);
+    }
+  }
+}
+void VirtualTextureSystem::update() {
+  loader->drain(uploads_per_frame,
+                [this](uint32_t key, std::vector<unsigned char> &pixels) {
+                  upload(key, pixels);
+                });
+  for (auto &vt : textures) {
+    if (vt->dirty)
+      rebuild_indirection(*vt);
+  }
+  frame++;
+}
+void VirtualTextureSystem::activate(const std::shared_ptr<VirtualTexture> &vt,
+                                    int idx) {
+  glActiveTexture(GL_TEXTURE0 + idx);
+  glBindTexture(GL_TEXTURE_2D, vt->indirection);
+  glActiveTexture(GL_TEXTURE0 + idx + 1);
+  glBindTexture(GL_TEXTURE_2D, use_sparse ? vt->sparse : physical);
+}
+glm::vec4 VirtualTextureSystem::cache_info() const {
+  float tile = page_size + 2 * border;
+  return glm::vec4(tile, border, tile * slots_per_side, use_sparse ? 1.0f : 0.0f);
+}
+size_t VirtualTextureSystem::resident_bytes() const {
+  size_t bytes = 0;
+  if (use_sparse) {
+    for (auto &s : slots)
+      if (s.key != VT_NO_PAGE)
+        bytes += (size_t)page_size * page_size * 4;
+  } else if (physical) {
+    size_t side = (size_t)slots_per_side * (page_size + 2 * border);
+    bytes += side * side * 4;
+  }
+  for (auto &vt : textures)
+    for (auto &l : vt->indirection_data)
+      bytes += l.size() * 4;
+  return bytes;
+}
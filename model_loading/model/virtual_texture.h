@@ -0,0 +1,196 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "glad/gl.h"
+#include <glm/glm.hpp>
+/**
+ * @brief 虚拟纹理
+ * 大量材质的情况下，TextureMgr会把所有图片整张放进显存。这里把图片切成page保存在
+ * 磁盘上（.vtex），由一个低分辨率的feedback pass统计当前画面真正需要的page，
+ * 后台线程读取，主线程上传到固定大小的物理page缓存，显存占用只和缓存大小有关。
+ *
+ * 支持ARB_sparse_texture时page直接commit到稀疏纹理里面，否则使用
+ * indirection纹理+物理page图集。两种情况共用同一份页表和LRU逻辑。
+ *
+ * .vtex 文件格式：
+ *   VtexHeader
+ *   uint64_t offsets[总page数]  按level从细到粗，每个level行优先
+ *   page数据，每个page为(page_size+2*border)^2的RGBA8
+ */
+struct VtexHeader {
+  char magic[4]; // "VTEX"
+  uint32_t version;
+  uint32_t width, height; // 原图尺寸
+  uint32_t page_size;     // page内部的尺寸，不包括border
+  uint32_t border;
+  uint32_t levels;
+  uint32_t pages_x, pages_y; // level 0的page数量
+};
+constexpr uint32_t VTEX_VERSION = 1;
+/*
+  page的key：纹理id(8) | level(4) | x(10) | y(10)，feedback纹理里面也是这个编码
+*/
+inline uint32_t vt_page_key(uint32_t tex, uint32_t level, uint32_t x,
+                            uint32_t y) {
+  return (tex << 24) | (level << 20) | (x << 10) | y;
+}
+inline uint32_t vt_key_tex(uint32_t key) { return key >> 24; }
+inline uint32_t vt_key_level(uint32_t key) { return (key >> 20) & 0xf; }
+inline uint32_t vt_key_x(uint32_t key) { return (key >> 10) & 0x3ff; }
+inline uint32_t vt_key_y(uint32_t key) { return key & 0x3ff; }
+constexpr uint32_t VT_NO_PAGE = 0xffffffffu;
+// feedback异步读回的环，读的是VT_FEEDBACK_FRAMES - 1帧之前的结果
+constexpr int VT_FEEDBACK_FRAMES = 3;
+
+// 把普通图片烘焙成.vtex，成功返回true
+bool bake_virtual_texture(const std::string &image, const std::string &out,
+                          uint32_t page_size = 128, uint32_t border = 1);
+
+class VirtualTextureFile {
+  int fd = -1;
+
+public:
+  std::string filename;
+  VtexHeader header = {};
+  std::vector<uint64_t> offsets;
+  std::vector<uint32_t> level_offset; // 每个level第一个page在offsets里的下标
+  VirtualTextureFile(const std::string &filename);
+  ~VirtualTextureFile();
+  bool valid() const { return fd >= 0; }
+  uint32_t pages_x(uint32_t level) const {
+    return std::max(1u, header.pages_x >> level);
+  }
+  uint32_t pages_y(uint32_t level) const {
+    return std::max(1u, header.pages_y >> level);
+  }
+  uint32_t tile_size() const { return header.page_size + 2 * header.border; }
+  // 线程安全，使用pread
+  bool read_page(uint32_t level, uint32_t x, uint32_t y,
+                 std::vector<unsigned char> &pixels) const;
+  // 最粗的一级，只有一个page
+  bool read_top(std::vector<unsigned char> &pixels) const {
+    return read_page(header.levels - 1, 0, 0, pixels);
+  }
+};
+/*
+  后台读取page的线程，请求和结果都是队列
+*/
+class PageLoader {
+  struct Request {
+    uint32_t key;
+    std::shared_ptr<VirtualTextureFile> file;
+  };
+  struct Loaded {
+    uint32_t key;
+    std::vector<unsigned char> pixels;
+  };
+  std::deque<Request> requests;
+  std::deque<Loaded> done;
+  std::mutex lock;
+  std::condition_variable cv;
+  bool quit = false;
+  std::thread worker;
+  void loop();
+
+public:
+  PageLoader();
+  ~PageLoader();
+  void request(uint32_t key, std::shared_ptr<VirtualTextureFile> file);
+  // 主线程调用，取出最多max个已经读好的page
+  template <typename F> void drain(size_t max, F &&upload) {
+    std::deque<Loaded> ready;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      while (!done.empty() && ready.size() < max) {
+        ready.push_back(std::move(done.front()));
+        done.pop_front();
+      }
+    }
+    for (auto &l : ready) {
+      upload(l.key, l.pixels);
+    }
+  }
+};
+class VirtualTexture {
+  friend class VirtualTextureSystem;
+  std::shared_ptr<VirtualTextureFile> file;
+  unsigned int indirection = 0; // RGBA8: slot.x, slot.y, 实际level, 有效位
+  unsigned int sparse = 0;      // 稀疏纹理，只在sparse模式下使用
+  int sparse_levels = 0;        // 大于等于这个level的属于mip tail，创建时commit
+  // CPU端的页表，每个page对应物理slot，-1表示不在显存中
+  std::vector<std::vector<int>> page_table;
+  std::vector<std::vector<uint32_t>> indirection_data;
+  bool dirty = true;
+
+public:
+  uint32_t id;
+  VirtualTexture(uint32_t _id, std::shared_ptr<VirtualTextureFile> _file);
+  ~VirtualTexture();
+  const VtexHeader &header() const { return file->header; }
+  // pages_x, pages_y, levels, page_size
+  glm::vec4 info() const;
+  // 原图在虚拟纹理中占的比例
+  glm::vec2 scale() const;
+};
+class VirtualTextureSystem {
+  struct Slot {
+    uint32_t key = VT_NO_PAGE;
+    uint64_t last_used = 0;
+    bool pinned = false;
+  };
+  std::vector<std::shared_ptr<VirtualTexture>> textures;
+  std::vector<Slot> slots;
+  std::map<uint32_t, uint64_t> pending; // 已经请求还没有上传的page
+  std::unique_ptr<PageLoader> loader;
+  uint32_t page_size = 0, border = 0;
+  uint64_t frame = 0;
+  // feedback
+  unsigned int feedback_fbo = 0, feedback_color = 0, feedback_depth = 0;
+  glm::ivec2 feedback_size = {};
+  // 每帧读到一个pixel pack buffer里，fence完成之后才映射，不等待GPU
+  unsigned int feedback_pbo[VT_FEEDBACK_FRAMES] = {};
+  GLsync feedback_fences[VT_FEEDBACK_FRAMES] = {};
+  int feedback_head = 0;
+  std::vector<uint32_t> feedback_pixels;
+  // 物理缓存
+  unsigned int physical = 0;
+  bool use_sparse = false;
+  int find_slot();
+  void upload(uint32_t key, std::vector<unsigned char> &pixels);
+  void evict(Slot &slot);
+  void rebuild_indirection(VirtualTexture &vt);
+  void create_sparse(VirtualTexture &vt);
+  void release_feedback();
+  void request_pages(std::vector<uint32_t> &keys);
+
+public:
+  uint32_t slots_per_side;
+  size_t uploads_per_frame = 16;
+  size_t feedback_dropped = 0; // GPU没来得及完成就被覆盖的读回
+  VirtualTextureSystem(uint32_t _slots_per_side = 16);
+  ~VirtualTextureSystem();
+  bool sparse() const { return use_sparse; }
+  // 文件可以在别的线程打开，top_page是read_top的结果，这里只创建gl对象
+  std::shared_ptr<VirtualTexture> load(std::shared_ptr<VirtualTextureFile> file,
+                                       std::vector<unsigned char> &top_page);
+  // 开始feedback pass，scr_size是窗口尺寸，feedback使用1/8分辨率
+  void begin_feedback(glm::ivec2 scr_size);
+  // 异步读回这一帧的feedback，请求几帧之前已经读回的feedback里缺失的page
+  void end_feedback(glm::ivec2 scr_size);
+  void update();
+  // 绑定一张虚拟纹理到texture unit idx与idx+1
+  void activate(const std::shared_ptr<VirtualTexture> &vt, int idx);
+  // tile_size, border, 缓存边长(像素), 是否sparse
+  glm::vec4 cache_info() const;
+  size_t resident_bytes() const;
+};
+#endif